@@ -0,0 +1,88 @@
+// Keyword classification microbenchmark.
+//
+// Compares the lexer's length/first-char switch (lookupKeyword) against the
+// std::string + std::unordered_map probe it replaced, on the identifier and
+// keyword lexemes of a synthetic identifier-heavy Codepie program.
+//
+//   g++ -std=c++17 -O2 -Iinclude bench/keyword_bench.cpp src/Lexer.cpp src/ScanKernels.cpp -o keyword_bench
+//   ./keyword_bench [statements]
+
+#include "Lexer.h"
+#include "ScanKernels.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const std::unordered_map<std::string, TokenType> mapKeywords = {
+    {"let", TokenType::LET}, {"be", TokenType::BE}, {"input", TokenType::INPUT},
+    {"output", TokenType::OUTPUT}, {"add", TokenType::ADD}, {"subtract", TokenType::SUBTRACT},
+    {"multiply", TokenType::MULTIPLY}, {"divide", TokenType::DIVIDE}, {"store", TokenType::STORE},
+    {"in", TokenType::IN}, {"and", TokenType::AND}, {"if", TokenType::IF},
+    {"else", TokenType::ELSE}, {"otherwise", TokenType::OTHERWISE}, {"then", TokenType::THEN},
+    {"repeat", TokenType::REPEAT}, {"from", TokenType::FROM}, {"to", TokenType::TO},
+    {"jump", TokenType::JUMP}, {"until", TokenType::UNTIL}
+};
+
+static TokenType mapLookup(std::string_view word) {
+    std::string lexeme(word);
+    auto it = mapKeywords.find(lexeme);
+    return it != mapKeywords.end() ? it->second : TokenType::IDENTIFIER;
+}
+
+static std::string makeSource(size_t statements) {
+    static const char* names[] = {"total", "i", "counter_value", "in2", "tox", "x", "letter", "andrew"};
+    std::string src;
+    for (size_t i = 0; i < statements; ++i) {
+        const char* a = names[i % 8];
+        const char* b = names[(i + 3) % 8];
+        switch (i % 3) {
+            case 0: src += "let v" + std::to_string(i) + " be " + std::to_string(i) + "\n"; break;
+            case 1: src += std::string("add ") + a + " and " + b + " store in " + a + "\n"; break;
+            default: src += std::string("if ") + a + " < " + b + " then output " + b + "\n"; break;
+        }
+    }
+    return src;
+}
+
+template <typename F>
+static double timeLookups(const std::vector<std::string_view>& words, int rounds, F lookup, long& checksum) {
+    auto begin = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (std::string_view w : words) checksum += static_cast<long>(lookup(w));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / (double(words.size()) * rounds);
+}
+
+int main(int argc, char* argv[]) {
+    size_t statements = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    std::string source = makeSource(statements);
+
+    Lexer lexer(source);
+    auto lexBegin = std::chrono::steady_clock::now();
+    auto tokens = lexer.tokenize();
+    auto lexEnd = std::chrono::steady_clock::now();
+
+    std::vector<std::string_view> words;
+    for (const auto& token : tokens) {
+        if (token.type == TokenType::IDENTIFIER || lookupKeyword(token.lexeme) != TokenType::IDENTIFIER)
+            words.push_back(token.lexeme);
+    }
+
+    long mapSum = 0, switchSum = 0;
+    const int rounds = 5;
+    double mapNs = timeLookups(words, rounds, mapLookup, mapSum);
+    double switchNs = timeLookups(words, rounds, lookupKeyword, switchSum);
+    double lexSeconds = std::chrono::duration<double>(lexEnd - lexBegin).count();
+
+    std::cout << "words:            " << words.size() << "\n";
+    std::cout << "map lookup:       " << mapNs << " ns/word\n";
+    std::cout << "lookupKeyword:    " << switchNs << " ns/word\n";
+    std::cout << "speedup:          " << mapNs / switchNs << "x\n";
+    std::cout << "tokenize:         " << source.size() / lexSeconds / 1e6 << " MB/s ("
+              << activeScanKernel() << " scanners)\n";
+    return mapSum == switchSum ? 0 : 1;
+}
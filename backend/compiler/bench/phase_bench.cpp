@@ -0,0 +1,367 @@
+// Per-phase compiler benchmark.
+//
+// Generates a synthetic Codepie program of a given size and shape, runs each
+// pipeline stage on its own over the previous stage's output, and prints one
+// JSON document with wall time, throughput and heap allocations per stage.
+// Several sizes can be measured in one go to check how each stage scales.
+//
+//   g++ -std=c++17 -O2 -Iinclude bench/phase_bench.cpp src/Lexer.cpp src/ScanKernels.cpp src/Arena.cpp src/Parser.cpp src/SemanticAnalyzer.cpp src/IntermediateCodeGen.cpp src/ControlFlowGraph.cpp src/SSA.cpp src/Optimizer.cpp src/CodeGenerator.cpp -o phase_bench
+//   ./phase_bench [--shape=mixed|chain|nested|loops|strings] [--statements=N[,N...]]
+//                 [--depth=D] [--string-length=L] [--runs=R] [--seed=S] [--dump-source]
+//
+// Shapes:
+//   chain    long let / add ... store in dependency chains
+//   nested   if ... then nested --depth levels deep
+//   loops    repeat from / repeat until loops
+//   strings  heavy string literals, string variables and string comparisons
+//   mixed    all of the above, round-robin
+
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "IntermediateCodeGen.h"
+#include "Optimizer.h"
+#include "CodeGenerator.h"
+#include "ScanKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every heap allocation in the process goes through these, so each stage's
+// allocation count is the difference of the counters around it. GCC cannot
+// tell that this replacement pairs malloc with free on purpose.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static size_t allocationCount = 0;
+static size_t allocationBytes = 0;
+
+void* operator new(size_t size) {
+    ++allocationCount;
+    allocationBytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+struct GeneratorOptions {
+    std::string shape = "mixed";
+    size_t statements = 100000;
+    int depth = 8;
+    size_t stringLength = 120;
+    unsigned seed = 1;
+};
+
+// Small deterministic generator so a seed always produces the same source.
+struct Lcg {
+    unsigned long long state;
+    explicit Lcg(unsigned seed) : state(seed * 6364136223846793005ULL + 1442695040888963407ULL) {}
+    unsigned next(unsigned bound) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<unsigned>(state >> 33) % bound;
+    }
+};
+
+static const unsigned kPoolSize = 64;
+
+static std::string poolVar(unsigned i) {
+    return "w" + std::to_string(i % kPoolSize);
+}
+
+static void emitChain(std::string& src, size_t i, Lcg& rng) {
+    std::string n = std::to_string(i);
+    if (i % 4 == 0) {
+        src += "let c" + n + " be " + std::to_string(rng.next(1000)) + "\n";
+    } else {
+        // Each link reads the previous one, so the chain never breaks.
+        src += "add c" + std::to_string(i - 1) + " and " + poolVar(rng.next(kPoolSize)) + " store in c" + n + "\n";
+    }
+}
+
+static void emitNested(std::string& src, const GeneratorOptions& opts, Lcg& rng) {
+    for (int d = 0; d < opts.depth; ++d) {
+        src += "if " + poolVar(rng.next(kPoolSize)) + " < " + poolVar(rng.next(kPoolSize)) + " then ";
+    }
+    src += "output " + poolVar(rng.next(kPoolSize)) + "\n";
+}
+
+static void emitLoop(std::string& src, size_t i, Lcg& rng) {
+    std::string a = poolVar(rng.next(kPoolSize));
+    std::string b = poolVar(rng.next(kPoolSize));
+    if (i % 2 == 0) {
+        src += "repeat from k = 1 to " + std::to_string(10 + rng.next(1000)) + " jump 1 add " + a + " and k store in " + b + "\n";
+    } else {
+        src += "repeat until " + a + " > " + std::to_string(100 + rng.next(10000)) + " add " + a + " and " + b + " store in " + a + "\n";
+    }
+}
+
+static std::string randomText(size_t length, Lcg& rng) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789 .,;:!?-";
+    std::string text;
+    text.reserve(length);
+    for (size_t i = 0; i < length; ++i) text += alphabet[rng.next(sizeof(alphabet) - 1)];
+    return text;
+}
+
+static void emitStrings(std::string& src, size_t i, const GeneratorOptions& opts, Lcg& rng) {
+    std::string n = std::to_string(i);
+    switch (i % 3) {
+        case 0: src += "let s" + n + " be \"" + randomText(opts.stringLength, rng) + "\"\n"; break;
+        case 1: src += "output \"" + randomText(opts.stringLength, rng) + "\"\n"; break;
+        default: src += "if s" + std::to_string(i - 2) + " == s" + std::to_string(i - 2) + " then output s" + std::to_string(i - 2) + "\n"; break;
+    }
+}
+
+// Returns the source; every generated program passes semantic analysis.
+static std::string makeSource(const GeneratorOptions& opts) {
+    Lcg rng(opts.seed);
+    std::string src;
+    for (unsigned i = 0; i < kPoolSize; ++i) {
+        src += "let " + poolVar(i) + " be " + std::to_string(i + 1) + "\n";
+    }
+    src += "let k be 0\n";
+
+    static const char* mixedShapes[] = {"chain", "nested", "loops", "strings"};
+    for (size_t i = 0; i < opts.statements; ++i) {
+        std::string shape = opts.shape;
+        size_t index = i;
+        if (shape == "mixed") {
+            // Keep each shape's own counter so chains and string references stay valid.
+            shape = mixedShapes[i % 4];
+            index = i / 4;
+        }
+        if (shape == "chain") emitChain(src, index, rng);
+        else if (shape == "nested") emitNested(src, opts, rng);
+        else if (shape == "loops") emitLoop(src, index, rng);
+        else emitStrings(src, index, opts, rng);
+    }
+    return src;
+}
+
+struct PhaseResult {
+    const char* name;
+    const char* unit;
+    double items = 0;
+    std::vector<double> seconds;
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+
+    PhaseResult(const char* n, const char* u) : name(n), unit(u) {}
+};
+
+struct SizeResult {
+    size_t statements;
+    size_t sourceBytes;
+    size_t tokens;
+    size_t irInstructions;
+    size_t optimizedInstructions;
+    size_t cBytes;
+    size_t errors;
+    std::vector<PhaseResult> phases;
+};
+
+template <typename F>
+static void measure(PhaseResult& phase, F body) {
+    size_t count = allocationCount;
+    size_t bytes = allocationBytes;
+    auto begin = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    phase.seconds.push_back(std::chrono::duration<double>(end - begin).count());
+    phase.allocations = allocationCount - count;
+    phase.allocatedBytes = allocationBytes - bytes;
+}
+
+static SizeResult runSize(const GeneratorOptions& opts, int runs) {
+    std::string source = makeSource(opts);
+
+    SizeResult result{};
+    result.statements = opts.statements;
+    result.sourceBytes = source.size();
+    result.phases = {
+        {"lex", "tokens"}, {"parse", "tokens"}, {"semantic", "statements"},
+        {"ir", "ir_instructions"}, {"optimize", "ir_instructions"}, {"codegen", "ir_instructions"},
+    };
+    PhaseResult& lex = result.phases[0];
+    PhaseResult& parse = result.phases[1];
+    PhaseResult& sema = result.phases[2];
+    PhaseResult& icg = result.phases[3];
+    PhaseResult& opt = result.phases[4];
+    PhaseResult& codegen = result.phases[5];
+
+    for (int run = 0; run < runs; ++run) {
+        Lexer lexer(source);
+        std::vector<Token> tokens;
+        measure(lex, [&] { tokens = lexer.tokenize(); });
+
+        Arena arena;
+        Parser parser(tokens, arena);
+        Program* ast = nullptr;
+        measure(parse, [&] { ast = parser.parse(); });
+
+        SemanticAnalyzer analyzer;
+        measure(sema, [&] { analyzer.analyze(ast); });
+
+        IntermediateCodeGen generator;
+        IRProgram ir;
+        measure(icg, [&] {
+            generator.generate(ast);
+            ir = generator.takeIR();
+        });
+
+        // The optimizer consumes its input, so it gets a copy made off the clock.
+        IRProgram input = ir;
+        Optimizer optimizer;
+        measure(opt, [&] { optimizer.optimize(std::move(input)); });
+
+        CodeGenerator emitter;
+        measure(codegen, [&] { emitter.generate(optimizer.getOptimizedIR()); });
+
+        result.tokens = tokens.size();
+        result.irInstructions = ir.code.size();
+        result.optimizedInstructions = optimizer.getOptimizedIR().code.size();
+        result.cBytes = emitter.getCCode().size();
+        result.errors = parser.getErrors().size() + analyzer.getErrors().size();
+        lex.items = parse.items = static_cast<double>(tokens.size());
+        sema.items = static_cast<double>(ast->statements.size());
+        icg.items = opt.items = static_cast<double>(ir.code.size());
+        codegen.items = static_cast<double>(optimizer.getOptimizedIR().code.size());
+    }
+    return result;
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+static void writeJson(std::ostream& out, const GeneratorOptions& opts, int runs, const std::vector<SizeResult>& results) {
+    char buf[64];
+    auto num = [&](double v) {
+        std::snprintf(buf, sizeof(buf), "%.9g", v);
+        return std::string(buf);
+    };
+
+    out << "{\n";
+    out << "  \"benchmark\": \"phase_bench\",\n";
+    out << "  \"shape\": \"" << opts.shape << "\",\n";
+    out << "  \"depth\": " << opts.depth << ",\n";
+    out << "  \"string_length\": " << opts.stringLength << ",\n";
+    out << "  \"seed\": " << opts.seed << ",\n";
+    out << "  \"runs\": " << runs << ",\n";
+    out << "  \"scan_kernel\": \"" << activeScanKernel() << "\",\n";
+    out << "  \"results\": [\n";
+    for (size_t r = 0; r < results.size(); ++r) {
+        const SizeResult& res = results[r];
+        double total = 0;
+        out << "    {\n";
+        out << "      \"statements\": " << res.statements << ",\n";
+        out << "      \"source_bytes\": " << res.sourceBytes << ",\n";
+        out << "      \"tokens\": " << res.tokens << ",\n";
+        out << "      \"ir_instructions\": " << res.irInstructions << ",\n";
+        out << "      \"optimized_ir_instructions\": " << res.optimizedInstructions << ",\n";
+        out << "      \"c_bytes\": " << res.cBytes << ",\n";
+        out << "      \"errors\": " << res.errors << ",\n";
+        out << "      \"phases\": [\n";
+        for (size_t p = 0; p < res.phases.size(); ++p) {
+            const PhaseResult& phase = res.phases[p];
+            double best = *std::min_element(phase.seconds.begin(), phase.seconds.end());
+            total += best;
+            out << "        {\"name\": \"" << phase.name << "\""
+                << ", \"seconds_min\": " << num(best)
+                << ", \"seconds_median\": " << num(median(phase.seconds))
+                << ", \"unit\": \"" << phase.unit << "\""
+                << ", \"items\": " << num(phase.items)
+                << ", \"items_per_second\": " << num(best > 0 ? phase.items / best : 0)
+                << ", \"allocations\": " << phase.allocations
+                << ", \"allocated_bytes\": " << phase.allocatedBytes;
+            if (p == 0) out << ", \"bytes_per_second\": " << num(best > 0 ? res.sourceBytes / best : 0);
+            out << "}" << (p + 1 < res.phases.size() ? "," : "") << "\n";
+        }
+        out << "      ],\n";
+        out << "      \"total_seconds\": " << num(total) << "\n";
+        out << "    }" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static bool parseSizes(const std::string& list, std::vector<size_t>& sizes) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string item = list.substr(start, comma - start);
+        char* end = nullptr;
+        unsigned long long value = std::strtoull(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value == 0) return false;
+        sizes.push_back(static_cast<size_t>(value));
+        start = comma + 1;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions opts;
+    std::vector<size_t> sizes;
+    int runs = 5;
+    bool dumpSource = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg.compare(0, 8, "--shape=") == 0) {
+            opts.shape = arg.substr(8);
+            ok = opts.shape == "mixed" || opts.shape == "chain" || opts.shape == "nested" ||
+                 opts.shape == "loops" || opts.shape == "strings";
+        } else if (arg.compare(0, 13, "--statements=") == 0) {
+            ok = parseSizes(arg.substr(13), sizes);
+        } else if (arg.compare(0, 8, "--depth=") == 0) {
+            opts.depth = std::atoi(arg.c_str() + 8);
+            ok = opts.depth > 0;
+        } else if (arg.compare(0, 16, "--string-length=") == 0) {
+            opts.stringLength = std::strtoul(arg.c_str() + 16, nullptr, 10);
+        } else if (arg.compare(0, 7, "--runs=") == 0) {
+            runs = std::atoi(arg.c_str() + 7);
+            ok = runs > 0;
+        } else if (arg.compare(0, 7, "--seed=") == 0) {
+            opts.seed = static_cast<unsigned>(std::strtoul(arg.c_str() + 7, nullptr, 10));
+        } else if (arg == "--dump-source") {
+            dumpSource = true;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Bad argument: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (sizes.empty()) sizes.push_back(opts.statements);
+
+    if (dumpSource) {
+        opts.statements = sizes.front();
+        std::cout << makeSource(opts);
+        return 0;
+    }
+
+    std::vector<SizeResult> results;
+    for (size_t statements : sizes) {
+        opts.statements = statements;
+        results.push_back(runSize(opts, runs));
+    }
+    writeJson(std::cout, opts, runs, results);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef AST_VISITOR_H
+#define AST_VISITOR_H
+
+#include "Parser.h"
+
+// CRTP dispatch for passes over a Program. Each node is routed to the
+// matching visitXxx member of Derived with a single switch on its kind.
+// Derived must provide every visit function below; statements return void
+// and expressions return ExprResult. Callers handle null nodes themselves.
+//
+//   class MyPass : ASTVisitor<MyPass, Value> {
+//       friend class ASTVisitor<MyPass, Value>;
+//       void visitVarDecl(const VarDecl* node);
+//       Value visitIdentifier(const Identifier* node);
+//       ...
+//   };
+template <typename Derived, typename ExprResult = void>
+class ASTVisitor {
+protected:
+    void visitStatement(const Statement* stmt) {
+        Derived* self = static_cast<Derived*>(this);
+        switch (stmt->kind) {
+            case NodeKind::VAR_DECL: return self->visitVarDecl(static_cast<const VarDecl*>(stmt));
+            case NodeKind::INPUT: return self->visitInput(static_cast<const InputStmt*>(stmt));
+            case NodeKind::OUTPUT: return self->visitOutput(static_cast<const OutputStmt*>(stmt));
+            case NodeKind::BIN_OP: return self->visitBinOp(static_cast<const BinOpStmt*>(stmt));
+            case NodeKind::IF: return self->visitIf(static_cast<const IfStmt*>(stmt));
+            case NodeKind::REPEAT: return self->visitRepeat(static_cast<const RepeatStmt*>(stmt));
+            default: return;
+        }
+    }
+
+    ExprResult visitExpression(const Expression* expr) {
+        Derived* self = static_cast<Derived*>(this);
+        switch (expr->kind) {
+            case NodeKind::IDENTIFIER: return self->visitIdentifier(static_cast<const Identifier*>(expr));
+            case NodeKind::NUMBER: return self->visitNumber(static_cast<const NumberLiteral*>(expr));
+            case NodeKind::STRING: return self->visitString(static_cast<const StringLiteral*>(expr));
+            case NodeKind::REL_OP: return self->visitRelOp(static_cast<const RelOpExpr*>(expr));
+            default: return ExprResult();
+        }
+    }
+};
+
+#endif
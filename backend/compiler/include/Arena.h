@@ -0,0 +1,80 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bump allocator owned by a compilation. Objects placed in it are never
+// destroyed individually: reset() rewinds to the first block in O(1) and
+// keeps every block for the next compile, and the destructor frees the
+// blocks themselves.
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(limit)) return allocateSlow(size, align);
+        cursor = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    void reset();
+    size_t bytesReserved() const;
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current;
+    char* cursor;
+    char* limit;
+    size_t blockSize;
+
+    void* allocateSlow(size_t size, size_t align);
+};
+
+// Growable array whose storage lives in an Arena. It has no destructor, so
+// it can sit inside arena-allocated nodes; growth copies into a fresh
+// arena allocation and abandons the old one.
+template <typename T>
+struct ArenaList {
+    T* items = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+
+    void push_back(Arena& arena, T value) {
+        if (count == capacity) {
+            uint32_t newCapacity = capacity ? capacity * 2 : 4;
+            T* grown = static_cast<T*>(arena.allocate(sizeof(T) * newCapacity, alignof(T)));
+            if (count) std::memcpy(static_cast<void*>(grown), items, sizeof(T) * count);
+            items = grown;
+            capacity = newCapacity;
+        }
+        items[count++] = value;
+    }
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+
+class CompileCache;
+
+// Compiles many programs in one process on a work-stealing ThreadPool, one
+// CompilerDriver (and so one set of stage instances and AST arena) per
+// worker thread.
+//
+// `input` is either a directory, searched recursively for .code files, or a
+// manifest listing one source path per line (relative paths are resolved
+// against the manifest's directory; blank lines and lines starting with #
+// are skipped). Jobs are named by their path relative to that directory,
+// without the extension; a file outside it is named by its file name. A name
+// already taken (compared case-insensitively) gets a -2, -3, ... suffix.
+//
+// With an output directory, each job gets the classic artifact files under
+// <outputDir>/<name>/. With "-", one aggregated stream goes to stdout, in
+// input order:
+//
+//   CODEPIE-BATCH <jobCount>\n
+//   file <byteLength>\n<name>          then the job's own section stream,
+//                                      or CODEPIE 1\nerror ... if unreadable
+//
+// `jobs` is the thread count; 0 means one per hardware thread. Every worker
+// looks its jobs up in `cache` first, when given. Returns the process exit
+// code: 1 if the input or any listed file could not be read.
+int runBatchCompile(const std::string& input, const std::string& outputDir, unsigned emit, unsigned jobs,
+                    CompileCache* cache);
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "IntermediateCodeGen.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bytecode opcodes. Suffixes name the C type an instruction works in: _I
+// int, _D double, _S string (strings compare and branch as ints). B<rel>
+// jumps when the relation holds and BN<rel> when it does not (only doubles
+// need both: with NaN, !(a < b) is not a >= b).
+#define CODEPIE_OPCODES(X)                                                                        \
+    X(HALT) X(MOV) X(I2D) X(D2I) X(CLEAR)                                                         \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(ADD_D) X(SUB_D) X(MUL_D) X(DIV_D) X(ADD_MOV_I)          \
+    X(LT_I) X(LE_I) X(GT_I) X(GE_I) X(EQ_I) X(NE_I)                                               \
+    X(LT_D) X(LE_D) X(GT_D) X(GE_D) X(EQ_D) X(NE_D)                                               \
+    X(JMP) X(JZ_I) X(JNZ_I) X(JZ_D) X(JNZ_D)                                                      \
+    X(BLT_I) X(BLE_I) X(BGT_I) X(BGE_I) X(BEQ_I) X(BNE_I)                                         \
+    X(BLT_D) X(BLE_D) X(BGT_D) X(BGE_D) X(BEQ_D) X(BNE_D)                                         \
+    X(BNLT_D) X(BNLE_D) X(BNGT_D) X(BNGE_D) X(BNEQ_D) X(BNNE_D)                                   \
+    X(IN_I) X(IN_D) X(IN_S) X(OUT_I) X(OUT_D) X(OUT_S) X(OUT_FMT)
+
+// A whole program's IR as typed register code, the form the direct backends
+// run: IRInterpreter dispatches it, and X64Jit and ElfWriter translate it
+// to machine code. Every value is computed, converted and printed the way the
+// C CodeGenerator emits for the same IR does: variables keep the IR's C
+// types, int arithmetic wraps, a double stored into an int truncates.
+//
+// Symbols, temps and literals are numbered registers, the literals a
+// constant pool at the top of the register file. Every instruction is
+// specialized to the C types it works in, with conversions made explicit,
+// and jumps hold their target's index. Superinstructions cover what
+// repeat-from loops lower to: a comparison into a temp only the next
+// branch reads is one compare-and-branch, and `ADD a, b, t; ASSIGN t, x`
+// one instruction. A JMP to a compare-and-branch that exits right after
+// the JMP becomes the inverted test, so a loop runs one jump less per
+// iteration.
+struct Bytecode {
+#define CODEPIE_OPCODE_ENUM(name) name,
+    enum Op : uint8_t { CODEPIE_OPCODES(CODEPIE_OPCODE_ENUM) };
+#undef CODEPIE_OPCODE_ENUM
+
+    // A string is 1 + its index in the program's string table, and null
+    // is 0, so a cleared register holds 0, 0.0 or null.
+    union Value {
+        double d;
+        int32_t i;
+        uint32_t s;
+    };
+
+    // Operands are registers, except jump targets (instruction indices, in
+    // c), ADD_MOV_I's second destination (d) and OUT_FMT's string index.
+    struct Instr {
+        Op op;
+        uint32_t a;
+        uint32_t b;
+        uint32_t c;
+        uint32_t d;
+    };
+
+    explicit Bytecode(const IRProgram& ir);
+
+    std::vector<Instr> code;
+    // Source line per instruction, for runtime errors.
+    std::vector<int> lines;
+    // Registers: symbols (numbered as in the IR), temps, scratch registers
+    // for conversions from firstScratch, then the constant pool from
+    // firstConstant. `types` is the C type of each; scratch registers hold
+    // whatever the instruction writing them computes, and are NONE.
+    std::vector<CType> types;
+    uint32_t registerCount = 0;
+    uint32_t firstScratch = 0;
+    uint32_t firstConstant = 0;
+    std::vector<Value> constants;
+    std::vector<std::string> symbolNames;
+    // String values by Value::s, with C escapes decoded and cut at the
+    // first NUL ("(null)" for null), and what printf prints for each when
+    // it is the format itself.
+    std::vector<std::string> texts;
+    std::vector<std::string> formats;
+};
+
+// A C conversion from double to int. Out of range values, undefined in C,
+// come out as x86's cvttsd2si gives them.
+inline int32_t truncateToInt(double d) {
+    if (d > INT_MIN - 1.0 && d < INT_MAX + 1.0) return static_cast<int32_t>(d);
+    return INT_MIN;
+}
+
+#endif
@@ -4,26 +4,53 @@
 #include "IntermediateCodeGen.h"
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <ostream>
 
+// Emits the IR as a C program. Loops and if/else that the IR's jumps spell
+// out become while, for, do and if blocks, with jumps to a loop's exit or
+// next iteration as break and continue, so a C compiler sees the loops it
+// can unroll and vectorize. Temps are declared in the innermost block that
+// uses them, where first assigned. Jumps that fit none of these shapes stay
+// gotos, and then every temp is declared up front.
 class CodeGenerator {
 public:
     CodeGenerator();
-    void generate(const std::vector<IRInstruction>& ir);
+    void generate(const IRProgram& ir);
     const std::string& getCCode() const;
 
+    // Streaming output: the C program is written to `out` one IR fragment at
+    // a time. Variables are declared just before the first fragment that
+    // assigns them, and a fragment's temps are scoped to a block of its own.
+    void beginStream(std::ostream& out);
+    void emitFragment(const IRProgram& fragment);
+    void endStream();
+
 private:
     std::string cCode;
-    bool isIdentifier(const std::string& s) const;
+    const IRProgram* program;
+    std::ostream* stream;
+
+    // Declared C type per symbol id, and per temp id of the current program
+    // or fragment (counted from IRProgram::firstName): the IR's own, or
+    // inferred here for IR that never went through the optimizer.
+    std::vector<CType> symbolTypes;
+    std::vector<CType> tempTypes;
+    // Symbols whose declaration has been written to the stream.
+    std::vector<char> declaredSymbols;
 
-    std::unordered_map<std::string, std::string> declaredVars;
+    void takeTypes(const IRProgram& ir);
+    CType typeOf(const Operand& op) const;
 
-    void declareVar(const std::string& var, const std::string& value);
+    // Rebuilds the control flow of `program` from its jumps; see
+    // CodeGenerator.cpp.
+    class Structurer;
 
-    bool isInteger(const std::string& s) const;
-    bool isDouble(const std::string& s) const;
-  
-    void emitSingleStatement(const IRInstruction& instr, std::ostringstream& oss);
+    std::string assignmentText(const IRInstruction& instr) const;
+    // One statement at `depth` levels of indentation; `declare` prefixes an
+    // assignment with the declaration of the variable it writes.
+    void emitSingleStatement(const IRInstruction& instr, std::ostream& oss, int depth = 1, bool declare = false);
 };
 
+const char* cTypeName(CType type);
+
 #endif 
@@ -0,0 +1,47 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct CompileArtifacts;
+
+// Persistent, content-addressed store of compile results. An entry is keyed
+// by SHA-256 over the compiler's build key, the emitted artifact set and the
+// source, so entries written by another build of the compiler are never
+// read back. Line endings are normalized first: CRLF outside string
+// literals lexes exactly like LF, so both spellings share one entry.
+//
+// Entries are written to a temporary file and renamed into place, so
+// readers (other threads, or other compiler processes) only ever see
+// complete ones. A hit refreshes the entry's modification time, and once
+// the directory grows past maxBytes the least recently used entries are
+// deleted. Stats are never cached; they describe the lookup itself. One
+// cache may be shared by the drivers of several threads.
+class CompileCache {
+public:
+    CompileCache(const std::string& directory, uint64_t maxBytes);
+
+    // Fills `artifacts` and returns true if a result for this source and
+    // artifact set is stored.
+    bool lookup(std::string_view source, unsigned emit, CompileArtifacts& artifacts);
+    void store(std::string_view source, unsigned emit, const CompileArtifacts& artifacts);
+
+private:
+    std::string directory;
+    uint64_t maxBytes;
+    std::atomic<uint64_t> bytesSinceTrim;
+    std::atomic<unsigned> tempCounter;
+
+    std::string keyFor(std::string_view source, unsigned emit) const;
+    void trim();
+};
+
+// Build identity for cache keys: the entry format version, the compiler
+// the build used, and the size and modification time of the running
+// executable, so rebuilding invalidates everything stored before.
+const std::string& compilerBuildKey();
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef CONTROL_FLOW_GRAPH_H
+#define CONTROL_FLOW_GRAPH_H
+
+#include "IntermediateCodeGen.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+static const uint32_t kNoBlock = UINT32_MAX;
+static const uint32_t kNoLoop = UINT32_MAX;
+
+// A maximal run of IR instructions [begin, end) entered only at its first
+// one and left only after its last. Blocks start at every LABEL and after
+// every JMP, JZ and JNZ.
+struct BasicBlock {
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// A view of consecutive block numbers in one of the graph's flat arrays.
+struct BlockList {
+    const uint32_t* first;
+    const uint32_t* last;
+
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+    uint32_t operator[](size_t i) const { return first[i]; }
+};
+
+// A natural loop: the blocks that can reach a back edge (latch -> header,
+// where the header dominates the latch) without passing the header. Back
+// edges into one header form a single loop.
+struct Loop {
+    uint32_t header = kNoBlock;
+    // The only block outside the loop that enters it, when that block has
+    // no other successor; kNoBlock otherwise.
+    uint32_t preheader = kNoBlock;
+    uint32_t parent = kNoLoop;
+    // 1 for an outermost loop.
+    uint32_t depth = 0;
+    std::vector<uint32_t> latches;
+    // Sorted, header included.
+    std::vector<uint32_t> blocks;
+};
+
+// Basic blocks, edges, dominator tree and loop nest of one IRProgram, for
+// the optimizer's global passes. Built in one pass over the code plus near
+// linear work on the graph, into flat arrays (a handful of allocations
+// however large the program); the program must not change while a graph
+// of it is in use. Block 0 is the entry. Blocks that cannot be reached
+// from it have no dominator, are in no loop and are left out of the orders.
+class ControlFlowGraph {
+public:
+    explicit ControlFlowGraph(const IRProgram& ir);
+
+    size_t blockCount() const { return blockList.size(); }
+    const std::vector<BasicBlock>& blocks() const { return blockList; }
+    const BasicBlock& block(uint32_t b) const { return blockList[b]; }
+    // Each neighbour is listed once, even when a JZ jumps to the block it
+    // would fall through to anyway.
+    BlockList preds(uint32_t b) const { return slice(predList, predStart, b); }
+    BlockList succs(uint32_t b) const { return slice(succList, succStart, b); }
+    // The block a LABEL operand starts, or kNoBlock if it is not defined.
+    uint32_t blockOfLabel(const Operand& label) const;
+
+    // Reachable blocks, each before all of its successors except along back
+    // edges: the order forward dataflow converges fastest in.
+    const std::vector<uint32_t>& reversePostOrder() const { return rpo; }
+    bool isReachable(uint32_t b) const { return rpoIndex[b] != kNoBlock; }
+
+    // Immediate dominator; kNoBlock for the entry and unreachable blocks.
+    uint32_t idom(uint32_t b) const { return idoms[b]; }
+    BlockList dominatorChildren(uint32_t b) const { return slice(domChildren, domChildStart, b); }
+    // Whether every path from the entry to b passes a (a dominates itself).
+    // Constant time.
+    bool dominates(uint32_t a, uint32_t b) const;
+
+    // Outer loops before the loops nested in them.
+    const std::vector<Loop>& loops() const { return loopList; }
+    // Innermost loop containing b, or kNoLoop.
+    uint32_t loopOf(uint32_t b) const { return blockLoop[b]; }
+    uint32_t loopDepth(uint32_t b) const;
+
+private:
+    std::vector<BasicBlock> blockList;
+    // Neighbours of block b are list[start[b], start[b + 1]).
+    std::vector<uint32_t> succList;
+    std::vector<uint32_t> succStart;
+    std::vector<uint32_t> predList;
+    std::vector<uint32_t> predStart;
+    // Block per label id, counted from IRProgram::firstName.
+    std::vector<uint32_t> labelBlocks;
+    uint32_t firstName;
+    std::vector<uint32_t> rpo;
+    std::vector<uint32_t> rpoIndex;
+    std::vector<uint32_t> idoms;
+    std::vector<uint32_t> domChildren;
+    std::vector<uint32_t> domChildStart;
+    // Dominator tree preorder entry and exit numbers.
+    std::vector<uint32_t> domEnter;
+    std::vector<uint32_t> domExit;
+    std::vector<Loop> loopList;
+    std::vector<uint32_t> blockLoop;
+
+    static BlockList slice(const std::vector<uint32_t>& list, const std::vector<uint32_t>& start, uint32_t b) {
+        return {list.data() + start[b], list.data() + start[b + 1]};
+    }
+    void buildBlocks(const IRProgram& ir);
+    void buildOrder();
+    void buildDominators();
+    void buildLoops();
+};
+
+enum class DataflowDirection { FORWARD, BACKWARD };
+
+// Per block solution, in program order for both directions: the value
+// holding before the block's first instruction and after its last.
+template <typename Value>
+struct DataflowResult {
+    std::vector<Value> before;
+    std::vector<Value> after;
+};
+
+// Worklist solver for a monotone dataflow problem over the reachable
+// blocks. `Graph` is a ControlFlowGraph, or any graph with the same
+// blockCount, preds, succs, reversePostOrder and isReachable members whose
+// block 0 is the entry. `Problem` provides:
+//
+//   using Value = ...;                      // lattice element, with ==
+//   Value initial() const;                  // every block's starting value
+//   Value boundary() const;                 // before the entry (forward) or
+//                                           // after exit blocks (backward)
+//   void meet(Value& into, const Value& from) const;
+//   void transfer(uint32_t block, const Value& in, Value& out) const;
+//
+// `transfer` maps the value flowing into the block (before it for FORWARD,
+// after it for BACKWARD) to the one flowing out. Blocks are visited in
+// reverse postorder (postorder for BACKWARD) and revisited only when a
+// neighbour's value changed, so acyclic code settles in one sweep and
+// loops in a few.
+template <typename Graph, typename Problem>
+DataflowResult<typename Problem::Value> solveDataflow(const Graph& cfg, const Problem& problem,
+                                                      DataflowDirection direction) {
+    using Value = typename Problem::Value;
+    bool forward = direction == DataflowDirection::FORWARD;
+    DataflowResult<Value> result;
+    result.before.assign(cfg.blockCount(), problem.initial());
+    result.after.assign(cfg.blockCount(), problem.initial());
+    std::vector<Value>& in = forward ? result.before : result.after;
+    std::vector<Value>& out = forward ? result.after : result.before;
+
+    const std::vector<uint32_t>& rpo = cfg.reversePostOrder();
+    std::deque<uint32_t> worklist;
+    std::vector<char> queued(cfg.blockCount(), 0);
+    if (forward) worklist.assign(rpo.begin(), rpo.end());
+    else worklist.assign(rpo.rbegin(), rpo.rend());
+    for (uint32_t b : rpo) queued[b] = 1;
+
+    Value next;
+    while (!worklist.empty()) {
+        uint32_t b = worklist.front();
+        worklist.pop_front();
+        queued[b] = 0;
+
+        auto sources = forward ? cfg.preds(b) : cfg.succs(b);
+        bool atBoundary = forward ? b == 0 : cfg.succs(b).empty();
+        Value merged = atBoundary ? problem.boundary() : problem.initial();
+        for (uint32_t s : sources) {
+            if (cfg.isReachable(s)) problem.meet(merged, out[s]);
+        }
+        in[b] = std::move(merged);
+
+        next = problem.initial();
+        problem.transfer(b, in[b], next);
+        if (next == out[b]) continue;
+        out[b] = std::move(next);
+        for (uint32_t d : forward ? cfg.succs(b) : cfg.preds(b)) {
+            if (!queued[d] && cfg.isReachable(d)) {
+                queued[d] = 1;
+                worklist.push_back(d);
+            }
+        }
+    }
+    return result;
+}
+
+#endif
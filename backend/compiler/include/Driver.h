@@ -0,0 +1,117 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "IntermediateCodeGen.h"
+#include "Arena.h"
+#include "SourceBuffer.h"
+#include "Telemetry.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Artifact selection for --emit=tokens,errors,ir,opt-ir,c,stats. Stages and
+// text renderers for artifacts outside the mask never run. Stats (a JSON
+// summary plus a Chrome trace) are opt-in and not part of "all".
+enum EmitFlags : unsigned {
+    EMIT_TOKENS = 1u << 0,
+    EMIT_ERRORS = 1u << 1,
+    EMIT_IR = 1u << 2,
+    EMIT_OPT_IR = 1u << 3,
+    EMIT_C = 1u << 4,
+    EMIT_STATS = 1u << 5,
+    // Keeps the optimized IR for CompilerDriver::getProgram(), to run it.
+    // Not a text artifact: not in "all", and compiles with it skip the cache.
+    EMIT_PROGRAM = 1u << 6,
+    EMIT_ALL = EMIT_TOKENS | EMIT_ERRORS | EMIT_IR | EMIT_OPT_IR | EMIT_C
+};
+
+// Parses a comma-separated --emit list. Returns false on an unknown name.
+bool parseEmitList(const std::string& list, unsigned& mask);
+
+// Everything one compile produces, rendered as the text the editor shows.
+// Only the artifacts in `emitted` are filled in; ir, optimizedIR and output
+// also stay empty when errors stop the compile before lowering.
+struct CompileArtifacts {
+    std::string tokens;
+    std::vector<std::string> errors;
+    std::string ir;
+    std::string optimizedIR;
+    std::string cCode;
+    std::string output;
+    std::string stats;
+    std::string trace;
+    bool generated = false;
+    unsigned emitted = 0;
+
+    void clear();
+};
+
+// Runs the full pipeline over a source buffer. One driver can be reused for
+// any number of compiles; its AST arena and artifact buffers keep their
+// capacity between calls, and the AST of one compile is released in O(1)
+// when the next one starts.
+class IncrementalFrontend;
+class CompileCache;
+
+class CompilerDriver {
+public:
+    CompilerDriver();
+    ~CompilerDriver();
+    const CompileArtifacts& compile(std::string_view source, unsigned emit = EMIT_ALL);
+    // Treat successive compile() sources as versions of one buffer: lexing
+    // and parsing are redone only around the edited lines, and analysis and
+    // lowering only from the first edited statement on (see Incremental.h).
+    // The artifacts are the same as without it. Off by default.
+    void setIncremental(bool enabled);
+    // Looks every compile() up in `cache` before running any stage, and
+    // stores what was compiled on a miss. nullptr turns caching off.
+    void setCache(CompileCache* cache);
+    // Streaming compile into the classic file layout under outputDir. Tokens
+    // are pulled on demand and each top-level statement is checked, lowered
+    // and written out as soon as it is parsed, so memory stays flat with
+    // input size. Only errors are kept in the returned artifacts. Returns
+    // false if an output file cannot be created.
+    bool compileStreaming(SourceBuffer& source, const std::string& outputDir,
+                          unsigned emit = EMIT_ALL);
+    const CompileArtifacts& getArtifacts() const;
+    // The optimized IR of the last compile() with EMIT_PROGRAM that
+    // generated code; empty otherwise.
+    const IRProgram& getProgram() const;
+
+private:
+    CompileArtifacts artifacts;
+    IRProgram program;
+    Arena astArena;
+    CompileTelemetry telemetry;
+    bool recording = false;
+    std::unique_ptr<IncrementalFrontend> frontend;
+    CompileCache* cache = nullptr;
+
+    void runPipeline(std::string_view source, unsigned emit);
+    void runIncremental(std::string_view source, unsigned emit);
+    void runBackEnd(IRProgram irCode, unsigned emit);
+    void beginPhase(const char* name);
+    void endPhase();
+    void count(const std::string& name, uint64_t value);
+    void finishStats();
+};
+
+void appendIR(std::string& out, const IRProgram& ir);
+// One line of tokens.txt.
+void appendTokenLine(std::string& out, const Token& token);
+std::string lexicalErrorMessage(const Token& token);
+
+// Writes the classic one-file-per-artifact layout (tokens.txt, errors.txt,
+// ir.txt, optimized_ir.txt, c_code.txt, output.txt, plus stats.json and
+// trace.json with stats), skipping artifacts that were not emitted.
+void writeArtifactFiles(const std::string& outputDir, const CompileArtifacts& artifacts);
+
+// Appends the emitted artifacts as one framed stream:
+//   CODEPIE <sectionCount>\n
+//   <name> <byteLength>\n<bytes>     (once per section)
+// Section names: tokens, errors, ir, optimized_ir, c_code, stats, trace, output.
+void appendArtifactSections(std::string& out, const CompileArtifacts& artifacts);
+void appendSection(std::string& out, std::string_view name, std::string_view body);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include "IntermediateCodeGen.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compiles a whole program's IR ahead of time to a standalone, statically
+// laid out x86-64 Linux executable, with no C compiler, assembler, linker
+// or libc involved. The program is translated as X64Jit translates it, and
+// the INPUT and OUTPUT it calls go to a small runtime written into the same
+// file, which buffers output and reads input through raw read, write and
+// exit_group syscalls. Output is the same as the generated C program's: ints
+// and prompts print as printf does and doubles with %lf's exact rounding.
+// Input is read like scanf's %lf for decimal numbers, inf and nan (not hex
+// floats); up to 15 digits scaled by up to 10^22 convert exactly, longer
+// or larger ones through x87 extended precision. An int division by zero
+// (or INT_MIN / -1) prints the same error as --run to stderr and exits
+// with status 1 instead of trapping.
+//
+// The file is one read-only executable segment holding the code, constants
+// and strings, and a zero-filled writable one for the I/O buffers and the
+// frame of variables the register allocator spills. Any host can write it.
+class ElfWriter {
+public:
+    explicit ElfWriter(const IRProgram& ir);
+
+    // Writes the executable to `path`, marked executable where the host
+    // has permission bits. Returns false if the file could not be written,
+    // described by error().
+    bool write(const std::string& path);
+    const std::string& error() const { return errorMessage; }
+
+    const std::vector<uint8_t>& image() const { return fileImage; }
+
+private:
+    std::vector<uint8_t> fileImage;
+    std::string errorMessage;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "Arena.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "IntermediateCodeGen.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Front end that keeps its work between compiles of successive versions of
+// one buffer, for the compile server. The program is held as one record per
+// top-level statement: its tokens, AST, parse errors, and where analysis and
+// lowering stood after it.
+//
+// A new version is diffed line by line against the last one. Statements
+// that end (lookahead token included) before the first changed line are
+// kept as they are. Lexing and parsing restart at the first statement
+// after them and run until the scanner, between two statements, stands in
+// the unchanged tail of the file exactly where a statement started last
+// time; from there the old records are reused, with their lines and
+// offsets shifted.
+// Semantic analysis and lowering are rolled back to the first reparsed
+// statement and redone from there on.
+//
+// Tokens and AST nodes point into the text of the version they were
+// scanned from, so every version stays alive while any record still uses
+// it. Once too many are alive, the next update reparses everything.
+class IncrementalFrontend {
+public:
+    IncrementalFrontend();
+    ~IncrementalFrontend();
+
+    IncrementalFrontend(const IncrementalFrontend&) = delete;
+    IncrementalFrontend& operator=(const IncrementalFrontend&) = delete;
+
+    // Brings tokens and ASTs up to date with `source`.
+    void reparse(std::string_view source);
+    // Runs semantic analysis over the statements not yet checked.
+    void analyze();
+    // Lowers the statements not yet lowered and returns the program's IR,
+    // identical to what IntermediateCodeGen::generate() would produce.
+    const IRProgram& lower();
+
+    // Same text and order as a full compile: lexical, parse, then semantic.
+    void appendErrors(std::vector<std::string>& out) const;
+    void appendTokens(std::string& out) const;
+
+    size_t statementCount() const;
+    size_t tokenCount() const;
+    size_t symbolCount() const { return sema.getSymbolCount(); }
+
+    // What the last update had to redo.
+    struct Work {
+        size_t reparsed = 0;
+        size_t reused = 0;
+        size_t rescannedTokens = 0;
+        size_t reanalyzed = 0;
+        size_t relowered = 0;
+    };
+    const Work& lastWork() const { return work; }
+
+private:
+    // One version of the source, with the tokens and AST nodes scanned and
+    // parsed from it.
+    struct Generation {
+        std::string text;
+        Arena arena;
+        std::vector<Token> tokens;
+    };
+
+    // One Parser::parseNext() call: the statement it returned (nullptr for
+    // the final call, which also holds END_OF_FILE), the tokens it consumed,
+    // including any it skipped, and the errors it reported.
+    struct StatementRecord {
+        std::shared_ptr<Generation> generation;
+        Statement* stmt = nullptr;
+        size_t tokenBegin = 0;
+        size_t tokenEnd = 0;
+        size_t invalidTokens = 0;
+        std::vector<std::pair<int, std::string>> parseErrors;
+        // Lexer state after the token before the record, and end of the
+        // token after the record's last one.
+        LexPosition start;
+        size_t lookaheadEnd = 0;
+        SemanticAnalyzer::Mark semaEnd;
+        IRProgram::Mark irEnd;
+    };
+
+    std::vector<StatementRecord> records;
+    std::shared_ptr<Generation> latest;
+    SemanticAnalyzer sema;
+    IntermediateCodeGen icg;
+    size_t analyzed;
+    size_t lowered;
+    Work work;
+
+    void rollbackTo(size_t first);
+    size_t generationRuns() const;
+};
+
+#endif
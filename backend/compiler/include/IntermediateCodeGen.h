@@ -2,36 +2,176 @@
 #define INTERMEDIATE_CODE_GEN_H
 
 #include "Parser.h"
+#include "ASTVisitor.h"
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <cstdint>
+#include <unordered_map>
 
+enum class IROpcode : uint8_t {
+    ASSIGN,
+    ADD, SUB, MUL, DIV,
+    LT, LE, GT, GE, EQ, NE,
+    JZ, JNZ, JMP, LABEL,
+    INPUT, OUTPUT
+};
+
+// How a variable is declared in the emitted C program, which also decides
+// how values stored into it convert and how it prints.
+enum class CType : uint8_t { NONE, INT, DOUBLE, STRING };
+
+// What an operand id refers to. Temps and labels share one counter so the
+// printed names (_t0, L1, L2, _t3, ...) stay unique across both.
+enum class OperandKind : uint8_t { NONE, SYMBOL, TEMP, LABEL, NUMBER, STRING };
+
+struct Operand {
+    OperandKind kind = OperandKind::NONE;
+    uint32_t id = 0;
+
+    Operand() = default;
+    Operand(OperandKind k, uint32_t i) : kind(k), id(i) {}
+
+    bool isVariable() const { return kind == OperandKind::SYMBOL || kind == OperandKind::TEMP; }
+    bool isLiteral() const { return kind == OperandKind::NUMBER || kind == OperandKind::STRING; }
+
+    bool operator==(const Operand& other) const { return kind == other.kind && id == other.id; }
+    bool operator!=(const Operand& other) const { return !(*this == other); }
+};
+
+// Operand layout per opcode:
+//   ASSIGN src, dst | ADD..NE lhs, rhs, dst | JZ/JNZ cond, label
+//   JMP label | LABEL label | INPUT var | OUTPUT value
 struct IRInstruction {
-    std::string opcode;
-    std::vector<std::string> operands;
-    int line; 
+    IROpcode opcode;
+    Operand operands[3];
+    int line;
+
+    IRInstruction(IROpcode op, Operand a, Operand b, Operand c, int ln)
+        : opcode(op), operands{a, b, c}, line(ln) {}
+    IRInstruction(IROpcode op, Operand a, Operand b, int ln)
+        : opcode(op), operands{a, b, Operand()}, line(ln) {}
+    IRInstruction(IROpcode op, Operand a, int ln)
+        : opcode(op), operands{a, Operand(), Operand()}, line(ln) {}
+
+    size_t operandCount() const;
+    // Index of the operand the instruction writes, or -1.
+    int definedOperand() const;
+};
 
-    IRInstruction(const std::string& op, const std::vector<std::string>& ops, int ln)
-        : opcode(op), operands(ops), line(ln) {}
+bool isArithmeticOpcode(IROpcode op);
+bool isRelationalOpcode(IROpcode op);
+const char* opcodeName(IROpcode op);
+
+// The IR of one compilation: a flat instruction buffer plus the tables its
+// operand ids index into. It is handed from stage to stage by move.
+struct IRProgram {
+    std::vector<IRInstruction> code;
+    std::vector<std::string> symbols;
+    std::vector<std::string> numbers;
+    std::vector<double> numberValues;
+    std::vector<std::string> strings;
+    // C type per symbol id, and per temp id counted from firstName, set by
+    // inferTypes(). The optimizer infers them before its first pass and
+    // keeps them, so no rewrite changes how a value converts or prints.
+    std::vector<CType> symbolTypes;
+    std::vector<CType> tempTypes;
+    bool typesInferred = false;
+    uint32_t nameCounter = 0;
+    // First temp/label id of the current fragment; 0 for a whole program.
+    uint32_t firstName = 0;
+
+    Operand internSymbol(std::string_view name);
+    Operand internNumber(std::string_view spelling);
+    Operand internString(std::string_view text);
+    Operand newTemp();
+    // A temp made after inferTypes(), declared with `type`.
+    Operand newTemp(CType type);
+    Operand newLabel();
+
+    // Variables (symbols, then temps) map onto one dense slot range.
+    size_t variableSlotCount() const { return symbols.size() + nameCounter; }
+    size_t variableSlot(const Operand& op) const {
+        return op.kind == OperandKind::SYMBOL ? op.id : symbols.size() + op.id;
+    }
+
+    // Types variables from the code in order: the first ASSIGN to a
+    // variable fixes its type from the value, INPUT makes it a double, and
+    // every arithmetic result takes the wider type of its operands (a
+    // relational one is an int), replacing any earlier type. Symbol types
+    // already set by an earlier fragment carry over.
+    void inferTypes();
+    // NONE for literals and untyped variables.
+    CType typeOf(const Operand& op) const;
+
+    std::string operandToString(const Operand& op) const;
+    void appendOperand(std::string& out, const Operand& op) const;
+    // Appends "Line <n>: <OPCODE> a, b, c" without a trailing newline.
+    void appendInstruction(std::string& out, const IRInstruction& instr) const;
+
+    void clear();
+    // Starts the next fragment of a streamed compile: drops the code and
+    // literal tables but keeps the symbols and the name counter, so ids
+    // stay stable and names stay unique across fragments.
+    void resetFragment();
+
+    // Sizes of the buffers and tables at one point, so the statements
+    // appended after it can be taken back out.
+    struct Mark {
+        size_t code = 0;
+        size_t symbols = 0;
+        size_t numbers = 0;
+        size_t strings = 0;
+        uint32_t names = 0;
+    };
+    Mark mark() const;
+    void rollback(const Mark& mark);
+
+private:
+    std::unordered_map<std::string, uint32_t> symbolIds;
+    std::unordered_map<std::string, uint32_t> numberIds;
+    std::unordered_map<std::string, uint32_t> stringIds;
 };
 
-class IntermediateCodeGen {
+// IRProgram::inferTypes() into tables of the caller's. `symbolTypes` may
+// hold the types of earlier fragments; `tempTypes` is rebuilt.
+void inferTypes(const IRProgram& ir, std::vector<CType>& symbolTypes, std::vector<CType>& tempTypes);
+
+class IntermediateCodeGen : private ASTVisitor<IntermediateCodeGen, Operand> {
+    friend class ASTVisitor<IntermediateCodeGen, Operand>;
+
 public:
     IntermediateCodeGen();
     void generate(const Program* program);
-    const std::vector<IRInstruction>& getIR() const;
+    // Lowers one more top-level statement as a fresh fragment of the IR.
+    void generateNext(const Statement* stmt);
+    // Lowers one more top-level statement onto the end of the IR so far.
+    void append(const Statement* stmt);
+    const IRProgram& getIR() const;
+    IRProgram& getIR();
+    IRProgram takeIR();
 
 private:
-    std::vector<IRInstruction> ir;
+    IRProgram ir;
 
-    std::string relOpToOpcode(const std::string& op);
+    IROpcode relOpToOpcode(std::string_view op);
 
 
     void genStatement(const Statement* stmt);
-    void genExpression(const Expression* expr, std::string& result);
+    void genExpression(const Expression* expr, Operand& result);
+
+    void visitVarDecl(const VarDecl* varDecl);
+    void visitInput(const InputStmt* inputStmt);
+    void visitOutput(const OutputStmt* outputStmt);
+    void visitBinOp(const BinOpStmt* binOp);
+    void visitIf(const IfStmt* ifStmt);
+    void visitRepeat(const RepeatStmt* repeatStmt);
 
-    int tempVarCounter;
-    std::string newTemp();
+    Operand visitIdentifier(const Identifier* id);
+    Operand visitNumber(const NumberLiteral* num);
+    Operand visitString(const StringLiteral* str);
+    Operand visitRelOp(const RelOpExpr* rel);
 };
 
-#endif 
+#endif
@@ -0,0 +1,32 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "Bytecode.h"
+#include <cstdio>
+#include <string>
+
+// Runs a whole program's IR in process, without the C round trip. The IR
+// is compiled to Bytecode first, so every value is computed, converted and
+// printed the way the C CodeGenerator emits for it does, and INPUT and OUTPUT
+// use the same scanf and printf formats. Where that C is undefined, the
+// interpreter does what x86 does: an out of range conversion to int gives
+// INT_MIN, and an int division by zero (or INT_MIN / -1) stops the program
+// with an error, as the trap would. Dispatch is threaded through a table
+// of label addresses where the compiler has computed goto.
+class IRInterpreter {
+public:
+    explicit IRInterpreter(const IRProgram& ir);
+
+    // Runs to the end of the program, reading INPUT from `in` and writing
+    // OUTPUT and prompts to `out`. `out` is flushed before every read, so
+    // prompts show up while the program waits. Returns false on a runtime
+    // error, described by error().
+    bool run(std::FILE* in, std::FILE* out);
+    const std::string& error() const { return errorMessage; }
+
+private:
+    Bytecode program;
+    std::string errorMessage;
+};
+
+#endif
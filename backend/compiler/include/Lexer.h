@@ -2,6 +2,7 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
@@ -18,29 +19,104 @@ enum class TokenType {
     INVALID
 };
 
+// Keyword classification over a raw lexeme: dispatch on length, then on the
+// first character, then confirm with a single compare. Allocation-free and
+// usable in constant expressions.
+constexpr TokenType lookupKeyword(std::string_view word) {
+    switch (word.size()) {
+        case 2:
+            switch (word[0]) {
+                case 'b': return word == "be" ? TokenType::BE : TokenType::IDENTIFIER;
+                case 'i':
+                    if (word[1] == 'f') return TokenType::IF;
+                    if (word[1] == 'n') return TokenType::IN;
+                    return TokenType::IDENTIFIER;
+                case 't': return word == "to" ? TokenType::TO : TokenType::IDENTIFIER;
+            }
+            break;
+        case 3:
+            switch (word[0]) {
+                case 'l': return word == "let" ? TokenType::LET : TokenType::IDENTIFIER;
+                case 'a':
+                    if (word == "add") return TokenType::ADD;
+                    if (word == "and") return TokenType::AND;
+                    return TokenType::IDENTIFIER;
+            }
+            break;
+        case 4:
+            switch (word[0]) {
+                case 'e': return word == "else" ? TokenType::ELSE : TokenType::IDENTIFIER;
+                case 't': return word == "then" ? TokenType::THEN : TokenType::IDENTIFIER;
+                case 'f': return word == "from" ? TokenType::FROM : TokenType::IDENTIFIER;
+                case 'j': return word == "jump" ? TokenType::JUMP : TokenType::IDENTIFIER;
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'i': return word == "input" ? TokenType::INPUT : TokenType::IDENTIFIER;
+                case 's': return word == "store" ? TokenType::STORE : TokenType::IDENTIFIER;
+                case 'u': return word == "until" ? TokenType::UNTIL : TokenType::IDENTIFIER;
+            }
+            break;
+        case 6:
+            switch (word[0]) {
+                case 'o': return word == "output" ? TokenType::OUTPUT : TokenType::IDENTIFIER;
+                case 'd': return word == "divide" ? TokenType::DIVIDE : TokenType::IDENTIFIER;
+                case 'r': return word == "repeat" ? TokenType::REPEAT : TokenType::IDENTIFIER;
+            }
+            break;
+        case 8:
+            switch (word[0]) {
+                case 's': return word == "subtract" ? TokenType::SUBTRACT : TokenType::IDENTIFIER;
+                case 'm': return word == "multiply" ? TokenType::MULTIPLY : TokenType::IDENTIFIER;
+            }
+            break;
+        case 9:
+            return word == "otherwise" ? TokenType::OTHERWISE : TokenType::IDENTIFIER;
+    }
+    return TokenType::IDENTIFIER;
+}
+
+// Lexemes are views into the source the Lexer was constructed over; that
+// buffer must outlive every token. Stages that keep a name copy it.
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     int line;
     int column;
 
-    Token(TokenType t, const std::string& l, int ln, int col)
+    Token(TokenType t, std::string_view l, int ln, int col)
         : type(t), lexeme(l), line(ln), column(col) {}
 };
 
+// Scanner state between two tokens. A Lexer started from a saved position
+// scans on exactly as the one it was saved from would have.
+struct LexPosition {
+    size_t offset = 0;
+    int line = 1;
+    int column = 1;
+};
+
 class Lexer {
 public:
-    Lexer(const std::string& source);
+    Lexer(std::string_view source);
+    Lexer(std::string_view source, LexPosition start);
     std::vector<Token> tokenize();
+    // Scans one token. Keeps returning END_OF_FILE once the input is used up.
+    Token next();
+    // Bytes of the source consumed so far.
+    size_t offset() const;
+    LexPosition position() const;
 
 private:
-    std::string source;
+    std::string_view source;
     size_t pos;
     int line;
     int column;
 
     char peek() const;
     char get();
+    void advance(size_t count);
     void skipWhitespace();
     void skipComment();
     Token identifierOrKeyword();
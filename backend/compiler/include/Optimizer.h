@@ -2,21 +2,44 @@
 #define OPTIMIZER_H
 
 #include "IntermediateCodeGen.h"
+#include <functional>
 #include <vector>
 #include <string>
 
+// What one optimizer pass did to the instruction count, for --stats.
+struct OptimizerPassEvent {
+    const char* pass;
+    bool finished;
+    size_t instructions;
+};
+
 class Optimizer {
 public:
+    using PassObserver = std::function<void(const OptimizerPassEvent&)>;
+
     Optimizer();
-    void optimize(const std::vector<IRInstruction>& inputIR);
-    const std::vector<IRInstruction>& getOptimizedIR() const;
+    // Called before and after every pass with the current instruction count.
+    void setPassObserver(PassObserver observer);
+    void optimize(IRProgram inputIR);
+    // Optimizes one fragment of a streamed compile where it stands.
+    void optimizeFragment(IRProgram& fragment);
+    const IRProgram& getOptimizedIR() const;
+    IRProgram takeOptimizedIR();
 
 private:
-    std::vector<IRInstruction> optimizedIR;
+    IRProgram optimizedIR;
+    PassObserver observer;
+    // False while optimizing a fragment, whose symbols may hold anything on
+    // entry; a whole program starts with every variable at 0.
+    bool wholeProgram;
 
-    void constantFolding();
-    void removeRedundantAssignments();
-    bool isNumber(const std::string& s) const;
+    void runPasses(IRProgram& ir);
+    void propagateConstants(IRProgram& ir);
+    void optimizeLoops(IRProgram& ir);
+    void numberValues(IRProgram& ir);
+    void threadJumps(IRProgram& ir);
+    void removeRedundantAssignments(IRProgram& ir);
+    void eliminateDeadCode(IRProgram& ir);
 };
 
 #endif 
@@ -2,91 +2,159 @@
 #define PARSER_H
 
 #include "Lexer.h"
+#include "Arena.h"
+#include <functional>
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <type_traits>
+
+// AST nodes are allocated from the Arena handed to the Parser and are never
+// destroyed one by one. Names and literal spellings are views into the
+// source buffer, which outlives the tree. Passes dispatch on `kind` (see
+// ASTVisitor.h) instead of probing with dynamic_cast.
+enum class NodeKind : uint8_t {
+    VAR_DECL, INPUT, OUTPUT, BIN_OP, IF, REPEAT,
+    IDENTIFIER, NUMBER, STRING, REL_OP,
+    PROGRAM
+};
 
 struct ASTNode {
-    virtual ~ASTNode() = default;
-    int line;
-    int column;
+    NodeKind kind;
+    int line = 0;
+    int column = 0;
+
+    explicit ASTNode(NodeKind k) : kind(k) {}
+};
+
+struct Statement : public ASTNode {
+    explicit Statement(NodeKind k) : ASTNode(k) {}
+};
+struct Expression : public ASTNode {
+    explicit Expression(NodeKind k) : ASTNode(k) {}
 };
 
-struct Statement : public ASTNode {};
-struct Expression : public ASTNode {};
+using StatementList = ArenaList<Statement*>;
 
 struct VarDecl : public Statement {
-    std::string varName;
-    std::unique_ptr<Expression> value;
+    VarDecl() : Statement(NodeKind::VAR_DECL) {}
+    std::string_view varName;
+    Expression* value = nullptr;
 };
 
 using Assignment = VarDecl;
 
 struct InputStmt : public Statement {
-    std::string varName;
+    InputStmt() : Statement(NodeKind::INPUT) {}
+    std::string_view varName;
 };
 
 struct OutputStmt : public Statement {
-    std::unique_ptr<Expression> value;
+    OutputStmt() : Statement(NodeKind::OUTPUT) {}
+    Expression* value = nullptr;
 };
 
 enum class BinOpType { ADD, SUBTRACT, MULTIPLY, DIVIDE };
 struct BinOpStmt : public Statement {
-    BinOpType op;
-    std::string left;
-    std::string right;
-    std::string result;
+    BinOpStmt() : Statement(NodeKind::BIN_OP) {}
+    BinOpType op = BinOpType::ADD;
+    std::string_view left;
+    std::string_view right;
+    std::string_view result;
 };
 
 struct IfStmt : public Statement {
-    std::unique_ptr<Expression> condition;
-    std::vector<std::unique_ptr<Statement>> thenBranch;
-    std::vector<std::unique_ptr<Statement>> elseIfBranches;
-    std::vector<std::unique_ptr<Statement>> elseBranch;
+    IfStmt() : Statement(NodeKind::IF) {}
+    Expression* condition = nullptr;
+    StatementList thenBranch;
+    StatementList elseIfBranches;
+    StatementList elseBranch;
 };
 
 struct RepeatStmt : public Statement {
-    std::string varName;
-    std::unique_ptr<Expression> start;
-    std::unique_ptr<Expression> end;
-    std::unique_ptr<Expression> jump;
-    std::vector<std::unique_ptr<Statement>> body;
-
-    std::unique_ptr<Expression> untilCondition;
+    RepeatStmt() : Statement(NodeKind::REPEAT) {}
+    std::string_view varName;
+    Expression* start = nullptr;
+    Expression* end = nullptr;
+    Expression* jump = nullptr;
+    StatementList body;
+
+    Expression* untilCondition = nullptr;
 };
 
 struct Identifier : public Expression {
-    std::string name;
+    Identifier() : Expression(NodeKind::IDENTIFIER) {}
+    std::string_view name;
 };
 
 struct NumberLiteral : public Expression {
-    std::string value;
+    NumberLiteral() : Expression(NodeKind::NUMBER) {}
+    std::string_view value;
 };
 
 struct StringLiteral : public Expression {
-    std::string value;
+    StringLiteral() : Expression(NodeKind::STRING) {}
+    std::string_view value;
 };
 
 struct RelOpExpr : public Expression {
-    std::unique_ptr<Expression> left;
-    std::string op; 
-    std::unique_ptr<Expression> right;
+    RelOpExpr() : Expression(NodeKind::REL_OP) {}
+    Expression* left = nullptr;
+    std::string_view op; 
+    Expression* right = nullptr;
 };
 
 struct Program : public ASTNode {
-    std::vector<std::unique_ptr<Statement>> statements;
+    Program() : ASTNode(NodeKind::PROGRAM) {}
+    StatementList statements;
 };
 
+static_assert(std::is_trivially_destructible<IfStmt>::value &&
+              std::is_trivially_destructible<RepeatStmt>::value &&
+              std::is_trivially_destructible<Program>::value,
+              "arena-allocated AST nodes must not need destructors");
+
 class Parser {
 public:
-    Parser(const std::vector<Token>& tokens);
-    std::unique_ptr<Program> parse();
-    std::vector<std::string> getErrors() const;
+    using TokenObserver = std::function<void(const Token&)>;
+
+    Parser(const std::vector<Token>& tokens, Arena& arena);
+    // Streaming mode: tokens are pulled from the lexer only as the parser
+    // needs them, and each one is passed to onToken when it is scanned.
+    Parser(Lexer& lexer, Arena& arena, TokenObserver onToken = nullptr);
+
+    Program* parse();
+    // Parses the next top-level statement, skipping over ones that fail to
+    // parse. Returns nullptr at end of input.
+    Statement* parseNext();
+    const std::vector<std::string>& getErrors() const;
+    // Line each error was reported at; every error reads "Line <n>: ...".
+    const std::vector<int>& getErrorLines() const;
+    // AST nodes created so far, including ones from statements that failed.
+    size_t getNodeCount() const { return nodeCount; }
 
 private:
-    const std::vector<Token>& tokens;
+    const std::vector<Token>* tokens;
+    Lexer* lexer;
+    TokenObserver onToken;
+    Token current;
+    Token previous;
+    Arena& arena;
     size_t pos;
+    size_t nodeCount;
     std::vector<std::string> errors;
+    std::vector<int> errorLines;
+
+    void pull();
+    void error(const std::string& message);
+
+    template <typename T>
+    T* makeNode() {
+        ++nodeCount;
+        return arena.make<T>();
+    }
 
     const Token& peek() const;
     const Token& get();
@@ -94,17 +162,17 @@ private:
     bool matchKeyword(TokenType type);
     void expect(TokenType type, const std::string& errorMsg);
 
-    std::unique_ptr<Statement> parseStatement();
-    std::unique_ptr<Statement> parseVarDecl();
-    std::unique_ptr<Statement> parseInput();
-    std::unique_ptr<Statement> parseOutput();
-    std::unique_ptr<Statement> parseBinOp();
-    std::unique_ptr<Statement> parseIf();
-    std::unique_ptr<Statement> parseRepeat();
-
-    std::unique_ptr<Expression> parseExpression();
-    std::unique_ptr<Expression> parseRelOpExpr();
-    std::unique_ptr<Expression> parsePrimary();
+    Statement* parseStatement();
+    Statement* parseVarDecl();
+    Statement* parseInput();
+    Statement* parseOutput();
+    Statement* parseBinOp();
+    Statement* parseIf();
+    Statement* parseRepeat();
+
+    Expression* parseExpression();
+    Expression* parseRelOpExpr();
+    Expression* parsePrimary();
 };
 
 #endif 
@@ -0,0 +1,96 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "ControlFlowGraph.h"
+#include <cstdint>
+#include <vector>
+
+static const uint32_t kNoValue = UINT32_MAX;
+
+// Static single assignment view of one IRProgram, built over its control
+// flow graph without rewriting the code: every definition of a variable
+// gets a value number, every use is linked to the one value that reaches
+// it, and joins get phi nodes (Cytron et al., semi-pruned: only variables
+// read in some block before being written there get phis).
+//
+// Values remember the variable they belong to, and the passes built on it
+// only replace uses with constants and delete code. Two versions of one
+// variable are then never live at once, so leaving SSA needs no copies:
+// the phis are simply dropped.
+//
+// Variables are numbered densely: symbol ids first, then temps counted from
+// IRProgram::firstName. Value v < variableCount() is the value variable v
+// holds on entry to the program (or fragment).
+class SSAForm {
+public:
+    SSAForm(const IRProgram& ir, const ControlFlowGraph& cfg);
+
+    enum class DefKind : uint8_t { ENTRY, INSTRUCTION, PHI };
+    struct Value {
+        DefKind kind;
+        uint32_t variable;
+        // Instruction index or phi number; unused for ENTRY.
+        uint32_t def;
+    };
+
+    // A phi at the top of `block`. Its arguments follow cfg.preds(block);
+    // the entry block has one more, the value on entry, for the implicit
+    // edge into the program.
+    struct Phi {
+        uint32_t block;
+        uint32_t variable;
+        uint32_t value;
+        uint32_t firstArg;
+        uint32_t argCount;
+    };
+
+    size_t variableCount() const { return symbolCount + tempCount; }
+    // kNoValue for operands that are not variables of this program.
+    uint32_t variableOf(const Operand& op) const;
+    Operand variableOperand(uint32_t variable) const;
+    // Whether the variable got phis wherever its definitions meet. Only
+    // then is the value it holds known at every point, not just where it
+    // is read.
+    bool isGlobal(uint32_t variable) const { return globalVariables[variable] != 0; }
+
+    size_t valueCount() const { return values.size(); }
+    const Value& value(uint32_t v) const { return values[v]; }
+
+    // Value read by operand `operand` of instruction `instr`, or kNoValue if
+    // that operand is not a variable read, or the instruction is unreachable.
+    uint32_t useValue(size_t instr, size_t operand) const { return uses[instr * 3 + operand]; }
+    // Value the instruction defines, or kNoValue.
+    uint32_t defValue(size_t instr) const { return defs[instr]; }
+
+    const std::vector<Phi>& phis() const { return phiList; }
+    // Phis of one block: phis()[phiStart(b), phiStart(b + 1)).
+    uint32_t phiStart(uint32_t block) const { return blockPhis[block]; }
+    uint32_t phiArg(const Phi& phi, size_t k) const { return phiArgs[phi.firstArg + k]; }
+
+    // Instructions and phis reading a value. A user u names phi
+    // u & ~kPhiUser when kPhiUser is set, else instruction u.
+    static const uint32_t kPhiUser = 0x80000000u;
+    BlockList users(uint32_t v) const {
+        return {userList.data() + userStart[v], userList.data() + userStart[v + 1]};
+    }
+
+private:
+    uint32_t symbolCount;
+    uint32_t tempCount;
+    uint32_t firstName;
+    std::vector<char> globalVariables;
+    std::vector<Value> values;
+    std::vector<uint32_t> uses;
+    std::vector<uint32_t> defs;
+    std::vector<Phi> phiList;
+    std::vector<uint32_t> blockPhis;
+    std::vector<uint32_t> phiArgs;
+    std::vector<uint32_t> userList;
+    std::vector<uint32_t> userStart;
+
+    void placePhis(const IRProgram& ir, const ControlFlowGraph& cfg);
+    void rename(const IRProgram& ir, const ControlFlowGraph& cfg);
+    void buildUsers();
+};
+
+#endif
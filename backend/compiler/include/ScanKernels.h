@@ -0,0 +1,35 @@
+#ifndef SCAN_KERNELS_H
+#define SCAN_KERNELS_H
+
+#include <cstddef>
+
+// Byte-run scanners used by the Lexer. Each returns how many bytes starting
+// at p belong to the class, never reading at or past end. The widest
+// implementation the CPU supports (AVX2, SSE2, scalar) is picked once at
+// startup; all of them classify with fixed ASCII tables, independent of the
+// C locale.
+
+// ' ', '\t', '\n', '\v', '\f', '\r'
+size_t scanWhitespace(const char* p, const char* end);
+// [A-Za-z0-9_]
+size_t scanIdentifier(const char* p, const char* end);
+// [0-9]
+size_t scanDigits(const char* p, const char* end);
+// Everything up to the closing '"' or a NUL byte.
+size_t scanStringBody(const char* p, const char* end);
+
+// Single-byte tests on the same tables, for dispatching on a token's first
+// byte. Bytes >= 0x80 are in no class.
+// [A-Za-z_]
+bool isIdentStart(char c);
+// [0-9]
+bool isDigit(char c);
+
+// Number of '\n' bytes in [p, end). When non-zero, *lastNewline is set to
+// the last one.
+size_t countNewlines(const char* p, const char* end, const char** lastNewline);
+
+// "avx2", "sse2" or "scalar".
+const char* activeScanKernel();
+
+#endif
@@ -2,7 +2,9 @@
 #define SEMANTIC_ANALYZER_H
 
 #include "Parser.h"
+#include "ASTVisitor.h"
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <memory>
@@ -15,22 +17,52 @@ struct VariableInfo {
     int lineDeclared;
 };
 
-class SemanticAnalyzer {
+class SemanticAnalyzer : private ASTVisitor<SemanticAnalyzer, VarType> {
+    friend class ASTVisitor<SemanticAnalyzer, VarType>;
+
 public:
     SemanticAnalyzer();
     void analyze(const Program* program);
+    // Checks one more top-level statement against everything analyzed so
+    // far. Used by the streaming driver, which never holds a whole Program.
+    void analyzeNext(const Statement* stmt);
     const std::vector<std::string>& getErrors() const;
+    size_t getSymbolCount() const { return symbolTable.size(); }
+
+    // How far analysis has got, so the incremental driver can take back the
+    // declarations and errors of statements that were edited.
+    struct Mark {
+        size_t declarations = 0;
+        size_t errors = 0;
+    };
+    Mark mark() const;
+    void rollback(const Mark& mark);
 
 private:
-    std::unordered_map<std::string, VariableInfo> symbolTable;
+    // Keys are views into the source buffer, like the AST names they come from.
+    std::unordered_map<std::string_view, VariableInfo> symbolTable;
+    // Names in the order they were declared; entries are never overwritten.
+    std::vector<std::string_view> declarations;
     std::vector<std::string> errors;
 
     void analyzeStatement(const Statement* stmt);
     void analyzeExpression(const Expression* expr, VarType& outType);
 
-    void declareVariable(const std::string& name, VarType type, int line);
-    bool isVariableDeclared(const std::string& name) const;
-    VarType getVariableType(const std::string& name) const;
+    void visitVarDecl(const VarDecl* varDecl);
+    void visitInput(const InputStmt* inputStmt);
+    void visitOutput(const OutputStmt* outputStmt);
+    void visitBinOp(const BinOpStmt* binOp);
+    void visitIf(const IfStmt* ifStmt);
+    void visitRepeat(const RepeatStmt* repeatStmt);
+
+    VarType visitIdentifier(const Identifier* id);
+    VarType visitNumber(const NumberLiteral* num);
+    VarType visitString(const StringLiteral* str);
+    VarType visitRelOp(const RelOpExpr* rel);
+
+    void declareVariable(std::string_view name, VarType type, int line);
+    bool isVariableDeclared(std::string_view name) const;
+    VarType getVariableType(std::string_view name) const;
 };
 std::string varTypeToString(VarType type);
 
@@ -0,0 +1,30 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+
+class CompileCache;
+
+// Long-running compile service, so the editor backend does not start a
+// process and round-trip six files per compile. Framing on the byte stream:
+//
+//   request:  COMPILE <byteLength>[ <emit-list>]\n<source bytes>
+//             QUIT\n
+//             (emit-list as for --emit; all artifacts when omitted)
+//   response: the section stream from appendArtifactSections(), or
+//             CODEPIE 1\nerror <byteLength>\n<message> for a bad request.
+//
+// A COMPILE whose length parses always has its body consumed, even when
+// the rest of the header is bad. Bodies over 64 MiB are refused and the
+// connection is closed after the error.
+//
+// An empty endpoint serves stdin/stdout; "unix:<path>" listens on a Unix
+// domain socket and serves connections one after another. One
+// CompilerDriver is reused for every request, in incremental mode: each
+// source is compiled as an edit of the one before, so a small change to a
+// large program is cheap to recompile. With a `cache`, sources compiled
+// before, by this server or any other compiler process sharing the
+// directory, are answered from it.
+int runCompileServer(const std::string& endpoint, CompileCache* cache);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental SHA-256 (FIPS 180-4), for content-addressed cache keys.
+class Sha256 {
+public:
+    Sha256();
+    void update(const void* data, size_t length);
+    // Finishes the hash; the object must not be updated afterwards.
+    std::string hexDigest();
+
+private:
+    uint32_t state[8];
+    unsigned char block[64];
+    size_t blockLength;
+    uint64_t totalLength;
+
+    void compress(const unsigned char* chunk);
+};
+
+#endif
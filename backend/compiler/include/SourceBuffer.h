@@ -0,0 +1,42 @@
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Read-only view of an input file. The file is memory-mapped when the
+// platform allows it and read into an owned string otherwise, so token
+// lexemes can point straight into it for the whole compilation.
+class SourceBuffer {
+public:
+    SourceBuffer();
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+
+    bool open(const std::string& path);
+    void assign(std::string text);
+    void close();
+
+    std::string_view view() const { return std::string_view(data, size); }
+    bool isMapped() const { return mapping != nullptr; }
+    // Hints that bytes before `offset` will rarely be touched again, so a
+    // mapped file's pages can leave the working set. Views stay valid.
+    void release(size_t offset);
+
+private:
+    const char* data;
+    size_t size;
+    void* mapping;
+    void* mappingHandle;
+    std::string owned;
+
+    bool map(const std::string& path);
+    bool read(const std::string& path);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap counters of the calling thread, kept by the replacement global
+// operator new and delete in Telemetry.cpp. Counting starts with the first
+// enableHeapTracking() (CompileTelemetry::start() calls it) and covers every
+// C++ allocation from then on; the AST arena takes its blocks from malloc and
+// is reported separately. A block freed by another thread than the one that
+// allocated it still counts as live for the allocating thread, so a compile
+// that hands buffers across threads overstates its live and peak bytes.
+struct HeapCounters {
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    uint64_t liveBytes = 0;
+    uint64_t peakLiveBytes = 0;
+};
+
+void enableHeapTracking();
+HeapCounters readHeapCounters();
+// Restarts the calling thread's peak tracking from its current live size.
+void resetHeapPeak();
+// Peak resident set size of the whole process so far, or 0 if unknown. Under
+// --batch --jobs=N it covers every worker, not one compile.
+uint64_t peakResidentBytes();
+
+// Timeline and counters of one compile, recorded for --stats. Phases may
+// nest (the optimizer's passes sit inside the optimize phase); each one
+// records wall time and the heap traffic its thread made while it was open.
+class CompileTelemetry {
+public:
+    CompileTelemetry();
+
+    void start();
+    void beginPhase(const char* name);
+    void endPhase();
+    void setCounter(const std::string& name, uint64_t value);
+
+    // {"total_ms", "peak_rss_bytes", "peak_heap_bytes", "phases", "counters"}
+    void appendJson(std::string& out) const;
+    // Chrome trace-event format, loadable in chrome://tracing or Perfetto.
+    void appendChromeTrace(std::string& out) const;
+
+private:
+    struct Phase {
+        const char* name;
+        int depth;
+        double startUs;
+        double durationUs;
+        HeapCounters heapAtStart;
+        uint64_t allocations;
+        uint64_t allocatedBytes;
+        uint64_t peakHeapBytes;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::vector<Phase> phases;
+    std::vector<size_t> open;
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    double totalUs;
+    uint64_t peakHeapBytes;
+
+    double nowUs() const;
+};
+
+#endif
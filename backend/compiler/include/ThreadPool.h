@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: it takes its own
+// tasks oldest-first and, once that runs dry, steals the newest task of
+// another worker, so uneven job sizes still keep every core busy. Tasks get
+// the index of the worker running them, which lets callers keep per-worker
+// state without locking.
+class ThreadPool {
+public:
+    using Task = std::function<void(unsigned worker)>;
+
+    // 0 threads means one per hardware thread.
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+    void submit(Task task);
+    // Blocks until every task submitted so far has finished.
+    void wait();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::atomic<size_t> queued;
+    size_t unfinished;
+    unsigned nextQueue;
+    bool stopping;
+
+    void run(unsigned index);
+    bool take(unsigned index, Task& task);
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef X64_CODEGEN_H
+#define X64_CODEGEN_H
+
+#include "Bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// x86-64 code generation shared by the native backends: X64Jit runs the
+// code in process and ElfWriter wraps it in an executable.
+
+// Register numbers as x86-64 encodes them; XMM registers use 0-15 too.
+enum X64Register : int { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Condition codes, as the low nibble of jcc and setcc.
+enum X64Condition : int {
+    CC_O = 0, CC_NO = 1, CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_BE = 6, CC_A = 7,
+    CC_S = 8, CC_NS = 9, CC_P = 10, CC_NP = 11, CC_L = 12, CC_GE = 13, CC_LE = 14, CC_G = 15
+};
+
+// Where an operand is: a register, a frame slot ([rbx + 8 * value]), an int
+// immediate, a pool constant or a label addressed RIP-relative, or memory
+// at [value + disp] for a base register `value`.
+struct Loc {
+    enum Kind : uint8_t { REG, SLOT, IMM, POOL, LABEL, MEM } kind;
+    int32_t value;
+    int32_t disp = 0;
+};
+
+inline Loc inReg(int reg) { return {Loc::REG, reg}; }
+inline Loc inSlot(uint32_t slot) { return {Loc::SLOT, static_cast<int32_t>(slot)}; }
+inline Loc inMemory(int base, int32_t disp) { return {Loc::MEM, base, disp}; }
+inline Loc imm(int32_t value) { return {Loc::IMM, value}; }
+
+// Bytes of machine code, with displacements patched once their targets
+// are placed. Labels are positions in the same byte stream, or anywhere
+// relative to it (bindAt), as long as RIP-relative references to them end
+// their instruction.
+class X64Assembler {
+public:
+    std::vector<uint8_t> bytes;
+    // Pool constants (by index in Bytecode::constants), bytecode
+    // instructions and error stubs referred to, and where.
+    std::vector<std::pair<size_t, uint32_t>> poolRefs;
+    std::vector<std::pair<size_t, uint32_t>> jumpRefs;
+    std::vector<std::pair<size_t, uint32_t>> stubRefs;
+
+    size_t here() const { return bytes.size(); }
+    void byte(int b) { bytes.push_back(static_cast<uint8_t>(b)); }
+    void dword(uint32_t v);
+    void qword(uint64_t v);
+    void patch32(size_t at, int32_t v);
+
+    // One instruction with a ModRM operand: a legacy `prefix` (0 for
+    // none), REX.W when `wide`, one to three `opcode` bytes (high first),
+    // `reg` in the reg field (a register or an opcode extension) and `rm`,
+    // which is not an immediate.
+    void modrm(int prefix, bool wide, uint32_t opcode, int reg, const Loc& rm);
+    // ALU op `ext` (0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp) of an rm with
+    // an immediate.
+    void aluImm(int ext, const Loc& rm, int32_t imm, bool wide = false);
+    // mov of a 32-bit immediate, zero extended into the full register.
+    void movImm(int reg, uint32_t value);
+    void push(int reg);
+    void pop(int reg);
+    // A jump to bytecode instruction `target`; cc < 0 is unconditional.
+    void jump(int cc, uint32_t target);
+    void jumpToStub(int cc, uint32_t stub);
+    // A call to a function of this process.
+    void call(const void* function);
+
+    int newLabel();
+    void bind(int label) { labels[label] = here(); }
+    void bindAt(int label, size_t position) { labels[label] = position; }
+    void jumpTo(int cc, int label);
+    void callLabel(int label);
+    // Patches every reference to a label; call once all are bound.
+    void resolveLabels();
+
+private:
+    std::vector<size_t> labels;
+    std::vector<std::pair<size_t, int>> labelRefs;
+    void labelRef(int label);
+};
+
+// Runtime entry points translated code calls for INPUT and OUTPUT. All
+// take the runtime pointer in rdi; INPUT takes the symbol in esi, its slot
+// in rdx and an X64InputKind in ecx; OUTPUT its value in esi (an int or
+// string) or xmm0, or the format's string index in esi. They keep rbx,
+// rbp and r12-r15.
+enum X64Routine : int { ROUTINE_INPUT, ROUTINE_OUTPUT_INT, ROUTINE_OUTPUT_DOUBLE, ROUTINE_OUTPUT_STRING,
+                        ROUTINE_OUTPUT_FORMAT, ROUTINE_COUNT };
+enum X64InputKind : uint32_t { INPUT_INT, INPUT_DOUBLE, INPUT_STRING };
+
+// Runtime errors come back from translated code as the failing source
+// line shifted left by two, or'ed with one of these.
+const uint32_t kX64DivisionByZero = 1;
+const uint32_t kX64DivisionOverflow = 2;
+
+// Translates a program's Bytecode to one function,
+//   uint32_t (Bytecode::Value* frame, void* runtime)
+// returning 0, or a runtime error, at the start of `as`, followed by its
+// constant pool. The bytecode's registers are the virtual registers
+// allocated here, except the constants, which become immediates and pool
+// entries. Scratch registers get a fresh virtual register per write, so
+// each conversion result has its own short interval. Frames have
+// slotCount 8-byte slots, zeroed.
+class X64Translator {
+public:
+    // Calls go to `routines` (absolute addresses), or, when it is null, to
+    // the labels in `routineLabels`, for the caller to bind.
+    X64Translator(const Bytecode& program, const void* const* routines);
+
+    void translate();
+
+    X64Assembler as;
+    int routineLabels[ROUTINE_COUNT];
+    uint32_t slotCount = 0;
+
+private:
+    using Op = Bytecode::Op;
+    using Instr = Bytecode::Instr;
+    struct Stub {
+        int line;
+        uint32_t kind;
+    };
+
+    const Bytecode& program;
+    const void* const* routines;
+    std::vector<Instr> code;
+    std::vector<bool> isDouble;
+    std::vector<uint32_t> start, end;
+    std::vector<int> reg;
+    // Allocated variables live before any write: zeroed on entry.
+    std::vector<uint32_t> zeroOnEntry;
+    // Allocated vregs by interval start, for saves around calls.
+    std::vector<uint32_t> byStart;
+    std::vector<Stub> stubs;
+
+    bool isConstant(uint32_t r) const { return r >= program.firstConstant && r < program.registerCount; }
+
+    void renameScratch();
+    void computeIntervals();
+    void allocate();
+    void emitCode();
+
+    Loc loc(uint32_t r) const;
+    void movGpr(int dst, const Loc& src);
+    void storeGpr(const Loc& dst, int src);
+    void movXmm(int dst, const Loc& src);
+    void storeXmm(const Loc& dst, int src);
+    int xmmOf(const Loc& src, int scratch);
+    void intCompare(const Loc& a, const Loc& b);
+    void doubleCompare(int rel, const Loc& a, const Loc& b);
+    void branchDouble(int rel, bool holds, uint32_t target);
+    void setDouble(int rel);
+    void emitInstruction(uint32_t i);
+    void emitCall(uint32_t i, std::vector<uint32_t>& open, size_t& nextOpen);
+};
+
+#endif
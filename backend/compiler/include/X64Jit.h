@@ -0,0 +1,43 @@
+#ifndef X64_JIT_H
+#define X64_JIT_H
+
+#include "Bytecode.h"
+#include <cstdio>
+#include <string>
+
+// Runs a whole program's IR as x86-64 machine code generated in process,
+// with no C compiler involved: the alternate backend to IRInterpreter for
+// compute-heavy programs. The IR is compiled to Bytecode, so values,
+// conversions and printed output are the same as the interpreter's and the
+// C's, and each typed register instruction becomes a few machine
+// instructions. Variables, temps and conversion results get machine
+// registers from a linear scan over their live intervals; the ones left
+// over live in a frame of 8-byte slots. Compare-and-branch instructions
+// become cmp or ucomisd plus a conditional jump, and INPUT and OUTPUT call
+// into a small runtime that reads and prints like the generated C.
+//
+// Only x86-64 Linux builds generate code; elsewhere run() reports that the
+// backend is unavailable.
+class X64Jit {
+public:
+    explicit X64Jit(const IRProgram& ir);
+    ~X64Jit();
+    X64Jit(const X64Jit&) = delete;
+    X64Jit& operator=(const X64Jit&) = delete;
+
+    // As IRInterpreter::run(): an int division by zero, which would trap
+    // in the C, stops the program with an error instead.
+    bool run(std::FILE* in, std::FILE* out);
+    const std::string& error() const { return errorMessage; }
+
+private:
+    Bytecode program;
+    // Read-only executable mapping holding the code; null if it could not
+    // be made.
+    void* codeMemory = nullptr;
+    size_t codeSize = 0;
+    uint32_t slotCount = 0;
+    std::string errorMessage;
+};
+
+#endif
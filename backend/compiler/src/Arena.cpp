@@ -0,0 +1,49 @@
+#include "Arena.h"
+#include <cstdlib>
+
+Arena::Arena(size_t size)
+    : current(0), cursor(nullptr), limit(nullptr), blockSize(size) {}
+
+Arena::~Arena() {
+    for (const auto& block : blocks) std::free(block.data);
+}
+
+void Arena::reset() {
+    current = 0;
+    if (blocks.empty()) {
+        cursor = limit = nullptr;
+        return;
+    }
+    cursor = blocks[0].data;
+    limit = blocks[0].data + blocks[0].size;
+}
+
+size_t Arena::bytesReserved() const {
+    size_t total = 0;
+    for (const auto& block : blocks) total += block.size;
+    return total;
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    size_t needed = size + align;
+    size_t next = blocks.empty() ? 0 : current + 1;
+
+    // Reuse blocks kept from before the last reset() when they are big enough.
+    while (next < blocks.size() && blocks[next].size < needed) ++next;
+
+    if (next >= blocks.size()) {
+        size_t grow = blocks.empty() ? blockSize : blocks.back().size * 2;
+        if (grow > 16 * blockSize) grow = 16 * blockSize;
+        Block block;
+        block.size = needed > grow ? needed : grow;
+        block.data = static_cast<char*>(std::malloc(block.size));
+        if (!block.data) throw std::bad_alloc();
+        blocks.push_back(block);
+        next = blocks.size() - 1;
+    }
+
+    current = next;
+    cursor = blocks[current].data;
+    limit = cursor + blocks[current].size;
+    return allocate(size, align);
+}
@@ -0,0 +1,186 @@
+#include "Batch.h"
+#include "Driver.h"
+#include "SourceBuffer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct BatchJob {
+    fs::path source;
+    std::string name;
+    std::string stream;
+    bool done = false;
+    bool unreadable = false;
+    bool hadErrors = false;
+};
+
+static std::string jobName(const fs::path& source, const fs::path& root) {
+    fs::path relative = source.lexically_normal().lexically_relative(root.lexically_normal());
+    if (relative.empty() || *relative.begin() == "..") relative = source.filename();
+    relative.replace_extension();
+    return relative.generic_string();
+}
+
+// Paths outside the root fall back to their file name and extensions are
+// dropped, so two sources can map to one name; the output directories would
+// then be written by two workers at once. Later duplicates get a -2, -3, ...
+// suffix. Names are compared ASCII case-insensitively, as on Windows.
+static void makeNamesUnique(std::vector<BatchJob>& jobs) {
+    auto key = [](std::string name) {
+        for (char& c : name) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c - 'A' + 'a');
+        }
+        return name;
+    };
+    std::unordered_set<std::string> taken;
+    for (const auto& job : jobs) taken.insert(key(job.name));
+    std::unordered_set<std::string> used;
+    for (auto& job : jobs) {
+        if (used.insert(key(job.name)).second) continue;
+        std::string base = job.name;
+        for (int suffix = 2;; ++suffix) {
+            std::string candidate = base + "-" + std::to_string(suffix);
+            if (taken.count(key(candidate))) continue;
+            taken.insert(key(candidate));
+            used.insert(key(candidate));
+            job.name = candidate;
+            break;
+        }
+        std::cerr << "Batch job name '" << base << "' is taken; " << job.source.string() << " is named '"
+                  << job.name << "'\n";
+    }
+}
+
+static bool collectJobs(const std::string& input, std::vector<BatchJob>& jobs) {
+    std::error_code ec;
+    fs::path inputPath(input);
+
+    if (fs::is_directory(inputPath, ec)) {
+        std::vector<fs::path> sources;
+        for (fs::recursive_directory_iterator it(inputPath, ec), end; !ec && it != end; it.increment(ec)) {
+            if (it->is_regular_file(ec) && it->path().extension() == ".code") sources.push_back(it->path());
+        }
+        if (ec) return false;
+        std::sort(sources.begin(), sources.end());
+        for (const auto& source : sources) {
+            BatchJob job;
+            job.source = source;
+            job.name = jobName(source, inputPath);
+            jobs.push_back(std::move(job));
+        }
+        return true;
+    }
+
+    std::ifstream manifest(inputPath);
+    if (!manifest.is_open()) return false;
+    fs::path root = inputPath.parent_path();
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        fs::path source(line);
+        if (source.is_relative()) source = root / source;
+        BatchJob job;
+        job.source = source;
+        job.name = jobName(source, root);
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+int runBatchCompile(const std::string& input, const std::string& outputDir, unsigned emit, unsigned jobCount,
+                    CompileCache* cache) {
+    std::vector<BatchJob> jobs;
+    if (!collectJobs(input, jobs)) {
+        std::cerr << "Failed to read batch input " << input << "\n";
+        return 1;
+    }
+    makeNamesUnique(jobs);
+
+    bool toStdout = outputDir == "-";
+    if (toStdout) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::string header = "CODEPIE-BATCH " + std::to_string(jobs.size()) + "\n";
+        std::fwrite(header.data(), 1, header.size(), stdout);
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    ThreadPool pool(jobCount);
+    std::vector<std::unique_ptr<CompilerDriver>> drivers;
+    for (unsigned i = 0; i < pool.size(); ++i) {
+        drivers.push_back(std::make_unique<CompilerDriver>());
+        drivers.back()->setCache(cache);
+    }
+
+    // Finished jobs are written out as soon as every job before them is done,
+    // so the aggregated stream keeps input order without holding it all.
+    std::mutex outputMutex;
+    size_t nextToWrite = 0;
+
+    for (size_t index = 0; index < jobs.size(); ++index) {
+        pool.submit([&, index](unsigned worker) {
+            BatchJob& job = jobs[index];
+            SourceBuffer code;
+            if (!code.open(job.source.string())) {
+                job.unreadable = true;
+                if (toStdout) {
+                    appendSection(job.stream, "file", job.name);
+                    job.stream += "CODEPIE 1\n";
+                    appendSection(job.stream, "error", "Failed to open " + job.source.string());
+                }
+            } else {
+                const CompileArtifacts& artifacts = drivers[worker]->compile(code.view(), emit);
+                job.hadErrors = !artifacts.errors.empty();
+                if (toStdout) {
+                    appendSection(job.stream, "file", job.name);
+                    appendArtifactSections(job.stream, artifacts);
+                } else {
+                    writeArtifactFiles((fs::path(outputDir) / job.name).string(), artifacts);
+                }
+            }
+
+            if (!toStdout) return;
+            std::lock_guard<std::mutex> lock(outputMutex);
+            job.done = true;
+            while (nextToWrite < jobs.size() && jobs[nextToWrite].done) {
+                std::string& stream = jobs[nextToWrite].stream;
+                std::fwrite(stream.data(), 1, stream.size(), stdout);
+                std::string().swap(stream);
+                ++nextToWrite;
+            }
+        });
+    }
+    pool.wait();
+    if (toStdout) std::fflush(stdout);
+
+    size_t unreadable = 0, withErrors = 0;
+    for (const auto& job : jobs) {
+        if (job.unreadable) {
+            ++unreadable;
+            std::cerr << "Failed to open " << job.source.string() << "\n";
+        }
+        if (job.hadErrors) ++withErrors;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    std::cerr << "Compiled " << jobs.size() - unreadable << " of " << jobs.size() << " files ("
+              << withErrors << " with errors) in " << static_cast<long>(ms) << " ms on "
+              << pool.size() << " threads.\n";
+    return unreadable ? 1 : 0;
+}
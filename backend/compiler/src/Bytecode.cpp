@@ -0,0 +1,316 @@
+#include "Bytecode.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+// The characters a C string literal spells, up to the first NUL.
+static std::string decodeEscapes(const std::string& literal) {
+    std::string out;
+    for (size_t i = 0; i < literal.size(); ++i) {
+        char c = literal[i];
+        if (c != '\\' || i + 1 == literal.size()) {
+            out += c;
+            continue;
+        }
+        c = literal[++i];
+        switch (c) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'a': out += '\a'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'v': out += '\v'; break;
+            case 'x': {
+                unsigned value = 0;
+                while (i + 1 < literal.size() && std::isxdigit(static_cast<unsigned char>(literal[i + 1]))) {
+                    char d = literal[++i];
+                    value = value * 16 + (d <= '9' ? d - '0' : (d | 0x20) - 'a' + 10);
+                }
+                out += static_cast<char>(value);
+                break;
+            }
+            default:
+                if (c >= '0' && c <= '7') {
+                    unsigned value = c - '0';
+                    for (int k = 0; k < 2 && i + 1 < literal.size() && literal[i + 1] >= '0' && literal[i + 1] <= '7'; ++k) {
+                        value = value * 8 + (literal[++i] - '0');
+                    }
+                    out += static_cast<char>(value);
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out.substr(0, out.find('\0'));
+}
+
+// What printf prints for a format with no arguments: `%%` is a percent
+// sign, and the conversions that would read an argument are left as
+// written.
+static std::string printfText(const std::string& format) {
+    std::string out;
+    for (size_t i = 0; i < format.size(); ++i) {
+        out += format[i];
+        if (format[i] == '%' && i + 1 < format.size() && format[i + 1] == '%') ++i;
+    }
+    return out;
+}
+
+static bool isIntegerSpelling(const std::string& spelling) {
+    return spelling.find_first_not_of("0123456789") == std::string::npos;
+}
+
+static const IROpcode kFirstRelational = IROpcode::LT;
+// The relation that holds exactly when one does not, for ints, by offset
+// from LT in LT, LE, GT, GE, EQ, NE order.
+static const int kComplement[] = {3, 2, 1, 0, 5, 4};
+
+Bytecode::Bytecode(const IRProgram& ir) : symbolNames(ir.symbols) {
+    std::vector<CType> symbolTypes, tempTypes;
+    if (ir.typesInferred) {
+        symbolTypes = ir.symbolTypes;
+        tempTypes = ir.tempTypes;
+    } else {
+        inferTypes(ir, symbolTypes, tempTypes);
+    }
+
+    // Untyped variables are never declared in the C; they only exist in
+    // code C would reject.
+    for (CType type : symbolTypes) types.push_back(type == CType::NONE ? CType::DOUBLE : type);
+    for (CType type : tempTypes) types.push_back(type == CType::NONE ? CType::DOUBLE : type);
+    const uint32_t scratch = firstScratch = static_cast<uint32_t>(types.size());
+    types.resize(types.size() + 3, CType::NONE);
+    firstConstant = static_cast<uint32_t>(types.size());
+
+    texts.push_back("(null)");
+    formats.push_back("(null)");
+    for (const std::string& literal : ir.strings) {
+        texts.push_back(decodeEscapes(literal));
+        formats.push_back(printfText(texts.back()));
+    }
+
+    auto constant = [&](CType type, Value value) {
+        types.push_back(type);
+        constants.push_back(value);
+        return static_cast<uint32_t>(types.size() - 1);
+    };
+    std::vector<uint32_t> numberRegisters(ir.numbers.size(), UINT32_MAX);
+    std::vector<uint32_t> stringRegisters(ir.strings.size(), UINT32_MAX);
+    auto reg = [&](const Operand& op) -> uint32_t {
+        if (op.kind == OperandKind::SYMBOL) return op.id;
+        if (op.kind == OperandKind::TEMP) return static_cast<uint32_t>(symbolTypes.size() + op.id - ir.firstName);
+        uint32_t& r = op.kind == OperandKind::NUMBER ? numberRegisters[op.id] : stringRegisters[op.id];
+        if (r != UINT32_MAX) return r;
+        Value value;
+        if (op.kind == OperandKind::STRING) {
+            value.s = op.id + 1;
+            return r = constant(CType::STRING, value);
+        }
+        // Integer spellings are ints, octal with a leading zero; those past
+        // int, longs in C, are approximated by a double.
+        const std::string& spelling = ir.numbers[op.id];
+        long long integer = isIntegerSpelling(spelling)
+                                ? std::strtoll(spelling.c_str(), nullptr, spelling[0] == '0' ? 8 : 10)
+                                : LLONG_MAX;
+        if (integer <= INT_MAX) {
+            value.i = static_cast<int32_t>(integer);
+            return r = constant(CType::INT, value);
+        }
+        value.d = ir.numberValues[op.id];
+        return r = constant(CType::DOUBLE, value);
+    };
+
+    int line = 0;
+    auto emit = [&](Op op, uint32_t a, uint32_t b, uint32_t c, uint32_t d = 0) {
+        code.push_back({op, a, b, c, d});
+        lines.push_back(line);
+    };
+    // Stores register `from` into `to` as C converts between their types.
+    // Strings and numbers do not convert; those store null or 0.
+    auto convert = [&](uint32_t from, uint32_t to, CType toType) {
+        CType fromType = types[from];
+        if (fromType == toType) emit(MOV, from, 0, to);
+        else if (fromType == CType::INT && toType == CType::DOUBLE) emit(I2D, from, 0, to);
+        else if (fromType == CType::DOUBLE && toType == CType::INT) emit(D2I, from, 0, to);
+        else emit(CLEAR, 0, 0, to);
+    };
+    // A number register holding `op` as `type`: its own, or `spare`
+    // converted. A string read as a number is a constant 0.
+    uint32_t zeroRegisters[2] = {UINT32_MAX, UINT32_MAX};
+    auto operandAs = [&](const Operand& op, CType type, uint32_t spare) {
+        uint32_t r = reg(op);
+        if (types[r] == type) return r;
+        if (types[r] == CType::STRING) {
+            uint32_t& zero = zeroRegisters[type == CType::DOUBLE];
+            if (zero == UINT32_MAX) zero = constant(type, Value{0.0});
+            return zero;
+        }
+        convert(r, spare, type);
+        return spare;
+    };
+    // Writes a result computed as `type` into `dst`: `emitInto` is handed
+    // the register to compute into.
+    auto storeResult = [&](uint32_t dst, CType type, auto emitInto) {
+        if (types[dst] == type) {
+            emitInto(dst);
+            return;
+        }
+        emitInto(scratch + 2);
+        types[scratch + 2] = type;
+        convert(scratch + 2, dst, types[dst]);
+    };
+
+    std::vector<uint32_t> tempReads(tempTypes.size(), 0);
+    for (const IRInstruction& instr : ir.code) {
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            const Operand& op = instr.operands[k];
+            if (op.kind == OperandKind::TEMP && static_cast<int>(k) != instr.definedOperand()) ++tempReads[op.id - ir.firstName];
+        }
+    }
+    auto readOnce = [&](const Operand& op) {
+        return op.kind == OperandKind::TEMP && tempReads[op.id - ir.firstName] == 1;
+    };
+
+    // Jumps hold their label id until every label has an index.
+    std::vector<uint32_t> labelIndex(ir.nameCounter - ir.firstName, UINT32_MAX);
+    std::vector<uint32_t> jumps;
+    auto emitJump = [&](Op op, uint32_t a, uint32_t b, const Operand& label) {
+        jumps.push_back(static_cast<uint32_t>(code.size()));
+        emit(op, a, b, label.id - ir.firstName);
+    };
+
+    const size_t n = ir.code.size();
+    for (size_t k = 0; k < n; ++k) {
+        const IRInstruction& instr = ir.code[k];
+        const IRInstruction* next = k + 1 < n ? &ir.code[k + 1] : nullptr;
+        const Operand* ops = instr.operands;
+        line = instr.line;
+        switch (instr.opcode) {
+            case IROpcode::LABEL:
+                labelIndex[ops[0].id - ir.firstName] = static_cast<uint32_t>(code.size());
+                break;
+            case IROpcode::ASSIGN: {
+                uint32_t src = reg(ops[0]), dst = reg(ops[1]);
+                if (ops[0].kind == OperandKind::NUMBER && types[src] == CType::DOUBLE && types[dst] == CType::INT &&
+                    isIntegerSpelling(ir.numbers[ops[0].id])) {
+                    // gcc stores a long literal into an int modulo 2^32.
+                    Value value;
+                    value.i = static_cast<int32_t>(std::strtoull(ir.numbers[ops[0].id].c_str(), nullptr, 10));
+                    src = constant(CType::INT, value);
+                }
+                convert(src, dst, types[dst]);
+                break;
+            }
+            case IROpcode::ADD:
+            case IROpcode::SUB:
+            case IROpcode::MUL:
+            case IROpcode::DIV: {
+                bool isDouble = types[reg(ops[0])] == CType::DOUBLE || types[reg(ops[1])] == CType::DOUBLE;
+                CType type = isDouble ? CType::DOUBLE : CType::INT;
+                uint32_t a = operandAs(ops[0], type, scratch), b = operandAs(ops[1], type, scratch + 1);
+                int offset = static_cast<int>(instr.opcode) - static_cast<int>(IROpcode::ADD);
+                Op op = static_cast<Op>((isDouble ? ADD_D : ADD_I) + offset);
+                uint32_t dst = reg(ops[2]);
+                // `OP a, b, t; ASSIGN t, x`: into x directly when only the
+                // copy reads t, else one ADD_MOV_I for an int sum.
+                if (next && next->opcode == IROpcode::ASSIGN && next->operands[0] == ops[2] && types[dst] == type &&
+                    types[reg(next->operands[1])] == type) {
+                    uint32_t x = reg(next->operands[1]);
+                    if (readOnce(ops[2])) {
+                        emit(op, a, b, x);
+                        ++k;
+                        break;
+                    }
+                    if (op == ADD_I) {
+                        emit(ADD_MOV_I, a, b, dst, x);
+                        ++k;
+                        break;
+                    }
+                }
+                storeResult(dst, type, [&](uint32_t into) { emit(op, a, b, into); });
+                break;
+            }
+            case IROpcode::LT:
+            case IROpcode::LE:
+            case IROpcode::GT:
+            case IROpcode::GE:
+            case IROpcode::EQ:
+            case IROpcode::NE: {
+                // Strings compare as pointers: their numbers, in int registers.
+                uint32_t a = reg(ops[0]), b = reg(ops[1]);
+                bool isDouble = false;
+                if (types[a] != CType::STRING && types[b] != CType::STRING) {
+                    isDouble = types[a] == CType::DOUBLE || types[b] == CType::DOUBLE;
+                    CType type = isDouble ? CType::DOUBLE : CType::INT;
+                    a = operandAs(ops[0], type, scratch);
+                    b = operandAs(ops[1], type, scratch + 1);
+                }
+                int rel = static_cast<int>(instr.opcode) - static_cast<int>(kFirstRelational);
+                if (next && (next->opcode == IROpcode::JZ || next->opcode == IROpcode::JNZ) &&
+                    next->operands[0] == ops[2] && readOnce(ops[2])) {
+                    bool onTrue = next->opcode == IROpcode::JNZ;
+                    Op op = isDouble ? static_cast<Op>((onTrue ? BLT_D : BNLT_D) + rel)
+                                     : static_cast<Op>(BLT_I + (onTrue ? rel : kComplement[rel]));
+                    emitJump(op, a, b, next->operands[1]);
+                    ++k;
+                    break;
+                }
+                Op op = static_cast<Op>((isDouble ? LT_D : LT_I) + rel);
+                storeResult(reg(ops[2]), CType::INT, [&](uint32_t into) { emit(op, a, b, into); });
+                break;
+            }
+            case IROpcode::JZ:
+            case IROpcode::JNZ: {
+                // A null string is 0 in an int register too.
+                uint32_t cond = reg(ops[0]);
+                bool onTrue = instr.opcode == IROpcode::JNZ;
+                Op op = types[cond] == CType::DOUBLE ? (onTrue ? JNZ_D : JZ_D) : (onTrue ? JNZ_I : JZ_I);
+                emitJump(op, cond, 0, ops[1]);
+                break;
+            }
+            case IROpcode::JMP:
+                emitJump(JMP, 0, 0, ops[0]);
+                break;
+            case IROpcode::INPUT: {
+                uint32_t var = reg(ops[0]);
+                emit(types[var] == CType::INT ? IN_I : types[var] == CType::DOUBLE ? IN_D : IN_S, var, 0, 0);
+                break;
+            }
+            case IROpcode::OUTPUT:
+                if (ops[0].kind == OperandKind::STRING) {
+                    emit(OUT_FMT, ops[0].id + 1, 0, 0);
+                } else if (ops[0].kind == OperandKind::NUMBER) {
+                    // C prints a number literal with %lf.
+                    emit(OUT_D, operandAs(ops[0], CType::DOUBLE, scratch), 0, 0);
+                } else {
+                    uint32_t value = reg(ops[0]);
+                    emit(types[value] == CType::INT ? OUT_I : types[value] == CType::DOUBLE ? OUT_D : OUT_S, value, 0, 0);
+                }
+                break;
+        }
+    }
+    emit(HALT, 0, 0, 0);
+    registerCount = static_cast<uint32_t>(types.size());
+    std::fill(types.begin() + scratch, types.begin() + firstConstant, CType::NONE);
+
+    const uint32_t halt = static_cast<uint32_t>(code.size() - 1);
+    for (uint32_t j : jumps) {
+        uint32_t target = labelIndex[code[j].c];
+        code[j].c = target == UINT32_MAX ? halt : target;
+    }
+    // A JMP to a compare-and-branch that leaves for the instruction after
+    // the JMP runs the opposite test itself, into the instruction after
+    // the one it jumped to.
+    for (uint32_t j : jumps) {
+        Instr& jump = code[j];
+        if (jump.op != JMP) continue;
+        const Instr& test = code[jump.c];
+        if (test.op < BLT_I || test.op > BNNE_D || test.c != j + 1) continue;
+        Op inverse;
+        if (test.op <= BNE_I) inverse = static_cast<Op>(BLT_I + kComplement[test.op - BLT_I]);
+        else if (test.op <= BNE_D) inverse = static_cast<Op>(test.op - BLT_D + BNLT_D);
+        else inverse = static_cast<Op>(test.op - BNLT_D + BLT_D);
+        jump = {inverse, test.a, test.b, jump.c + 1, 0};
+    }
+}
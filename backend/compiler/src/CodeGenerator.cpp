@@ -2,157 +2,719 @@
 #include <sstream>
 #include <cctype>
 #include <cstdlib>
-#include <map>
 
-CodeGenerator::CodeGenerator() {}
+CodeGenerator::CodeGenerator() : program(nullptr), stream(nullptr) {}
 
-std::string promote(const std::string& t1, const std::string& t2) {
-    if (t1 == "const char*" || t2 == "const char*") return "const char*";
-    if (t1 == "double" || t2 == "double") return "double";
-    return "int";
+const char* cTypeName(CType type) {
+    switch (type) {
+        case CType::INT: return "int";
+        case CType::DOUBLE: return "double";
+        case CType::STRING: return "const char*";
+        case CType::NONE: break;
+    }
+    return "";
 }
 
-bool CodeGenerator::isIdentifier(const std::string& s) const {
-    if (s.empty()) return false;
-    if (!(isalpha(s[0]) || s[0] == '_')) return false;
-    for (char c : s) {
-        if (!(isalnum(c) || c == '_')) return false;
+static const char* relOpSymbol(IROpcode op) {
+    switch (op) {
+        case IROpcode::LE: return "<=";
+        case IROpcode::LT: return "<";
+        case IROpcode::GT: return ">";
+        case IROpcode::GE: return ">=";
+        case IROpcode::EQ: return "==";
+        default: return "!=";
     }
-    return true;
 }
 
-void CodeGenerator::generate(const std::vector<IRInstruction>& ir) {
-    cCode.clear();
-    declaredVars.clear();
+static const char* arithOpSymbol(IROpcode op) {
+    switch (op) {
+        case IROpcode::ADD: return "+";
+        case IROpcode::SUB: return "-";
+        case IROpcode::MUL: return "*";
+        default: return "/";
+    }
+}
 
-    std::ostringstream oss;
-    oss << "#include <stdio.h>\n\nint main() {\n";
+CType CodeGenerator::typeOf(const Operand& op) const {
+    if (!op.isVariable()) return CType::NONE;
+    if (op.kind == OperandKind::SYMBOL) return symbolTypes[op.id];
+    return tempTypes[op.id - program->firstName];
+}
 
-    for (const auto& instr : ir) {
-        if (instr.opcode == "ASSIGN" && instr.operands.size() == 2) {
-            declareVar(instr.operands[1], instr.operands[0]);
-        } else if ((instr.opcode == "ADD" || instr.opcode == "SUB" ||
-                    instr.opcode == "MUL" || instr.opcode == "DIV") &&
-                   instr.operands.size() == 3) {
-            std::string t1 = declaredVars[instr.operands[0]];
-            std::string t2 = declaredVars[instr.operands[1]];
-            std::string resultType = promote(t1, t2);
-            declaredVars[instr.operands[2]] = resultType;
-        } else if ((instr.opcode == "LE" || instr.opcode == "LT" ||
-                    instr.opcode == "GT" || instr.opcode == "GE" ||
-                    instr.opcode == "EQ" || instr.opcode == "NE") &&
-                   instr.operands.size() == 3) {
-            declaredVars[instr.operands[2]] = "int"; 
-        } else if (instr.opcode == "INPUT" && instr.operands.size() == 1) {
-            declareVar(instr.operands[0], "");
+void CodeGenerator::takeTypes(const IRProgram& ir) {
+    if (!ir.typesInferred) {
+        inferTypes(ir, symbolTypes, tempTypes);
+        return;
+    }
+    symbolTypes = ir.symbolTypes;
+    tempTypes = ir.tempTypes;
+}
+
+// Variables the code reads or writes, by IRProgram::variableSlot(). The
+// optimizer deletes every use of some, and those are not declared.
+static std::vector<char> usedVariables(const IRProgram& ir) {
+    std::vector<char> used(ir.variableSlotCount(), 0);
+    for (const auto& instr : ir.code) {
+        for (size_t i = 0; i < instr.operandCount(); ++i) {
+            if (instr.operands[i].isVariable()) used[ir.variableSlot(instr.operands[i])] = 1;
         }
     }
+    return used;
+}
 
-    for (const auto& entry : declaredVars) {
-        const std::string& var = entry.first;
-        const std::string& type = entry.second;
-        if (isIdentifier(var))
-            oss << "    " << type << " " << var << " = 0;\n";
-    }
-
-    for (const auto& instr : ir) {
-        if (instr.opcode == "ASSIGN" && instr.operands.size() == 2) {
-            oss << "    " << instr.operands[1] << " = " << instr.operands[0] << ";\n";
-        } else if (instr.opcode == "ADD" && instr.operands.size() == 3) {
-            oss << "    " << instr.operands[2] << " = " << instr.operands[0] << " + " << instr.operands[1] << ";\n";
-        } else if (instr.opcode == "SUB" && instr.operands.size() == 3) {
-            oss << "    " << instr.operands[2] << " = " << instr.operands[0] << " - " << instr.operands[1] << ";\n";
-        } else if (instr.opcode == "MUL" && instr.operands.size() == 3) {
-            oss << "    " << instr.operands[2] << " = " << instr.operands[0] << " * " << instr.operands[1] << ";\n";
-        } else if (instr.opcode == "DIV" && instr.operands.size() == 3) {
-            oss << "    " << instr.operands[2] << " = " << instr.operands[0] << " / " << instr.operands[1] << ";\n";
-        } else if ((instr.opcode == "LE" || instr.opcode == "LT" ||
-                    instr.opcode == "GT" || instr.opcode == "GE" ||
-                    instr.opcode == "EQ" || instr.opcode == "NE") &&
-                   instr.operands.size() == 3) {
-            std::string op;
-            if (instr.opcode == "LE") op = "<=";
-            else if (instr.opcode == "LT") op = "<";
-            else if (instr.opcode == "GT") op = ">";
-            else if (instr.opcode == "GE") op = ">=";
-            else if (instr.opcode == "EQ") op = "==";
-            else if (instr.opcode == "NE") op = "!=";
-            oss << "    " << instr.operands[2] << " = (" << instr.operands[0] << " " << op << " " << instr.operands[1] << ");\n";
-        } else if (instr.opcode == "INPUT" && instr.operands.size() == 1) {
-            oss << "    printf(\"Enter value for " << instr.operands[0] << ": \");\n";
-            oss << "    scanf(\"%lf\", &" << instr.operands[0] << ");\n";
-        } else if (instr.opcode == "OUTPUT" && instr.operands.size() == 1) {
-            const std::string& var = instr.operands[0];
-
-            if (!var.empty() && var[0] == '"') {
-                oss << "    printf(" << var << ");\n";
-            } else if (declaredVars.count(var)) {
-                const std::string& type = declaredVars[var];
-                if (type == "int")
-                    oss << "    printf(\"%d\\n\", " << var << ");\n";
-                else if (type == "double")
-                    oss << "    printf(\"%lf\\n\", " << var << ");\n";
-                else if (type == "const char*")
-                    oss << "    printf(\"%s\\n\", " << var << ");\n";
-            } else {
-                oss << "    printf(\"%lf\\n\", " << var << ");\n";
+static const size_t kNoPosition = static_cast<size_t>(-1);
+static const uint32_t kNoBlock = static_cast<uint32_t>(-1);
+
+static bool usesTemps(const IRInstruction& instr) {
+    for (size_t i = 0; i < instr.operandCount(); ++i) {
+        if (instr.operands[i].kind == OperandKind::TEMP) return true;
+    }
+    return false;
+}
+
+// Finds the loops and if/else of the IR the front end and optimizer produce:
+//
+//   loop:  LABEL L; [test jumping past the loop]; body; JMP L (or JZ/JNZ c, L)
+//   if:    JZ c, Lelse; then; [JMP Lend; LABEL Lelse; else; LABEL Lend]
+//
+// Jump threading drops the JMP Lend of a then part that ends in a loop and
+// points the loop's exit test at Lend itself. That is an if/else too, with
+// a then part left only through the loop's exit.
+//
+// A construct must fit in the instruction range of the one around it, so
+// jumps that do not nest that way are left as gotos to emitted labels. A
+// comparison whose only reader is the next jump becomes the condition. The
+// code is walked twice the same way: first to count the gotos, the loops
+// that continue and the blocks each temp is used in, then to write the C.
+class CodeGenerator::Structurer {
+public:
+    Structurer(CodeGenerator& generator, bool scopeTemps);
+
+    // Whether the C names a temp (by id from firstName), and whether it is
+    // declared by the statement that first assigns it.
+    bool names(uint32_t temp) const { return temp < tempBlock.size() && tempBlock[temp] != kNoBlock; }
+    bool declaredInPlace(uint32_t temp) const { return declareAt[temp] != kNoPosition; }
+
+    void emit(std::ostream& stream);
+
+private:
+    // A conditional jump, and the comparison folded into it, if any.
+    struct Condition {
+        size_t test;
+        size_t compare;
+    };
+    struct Loop {
+        size_t header;
+        size_t backEdge;
+        // Where a break goes, as a destination().
+        size_t exit;
+        uint32_t index;
+        // The test at the top that leaves the loop, or the back edge's own;
+        // test is kNoPosition where there is none.
+        Condition head;
+        Condition tail;
+        size_t bodyBegin;
+        size_t bodyEnd;
+        // The body's last statement, stepping a variable the head tests,
+        // when it can be a for loop's increment.
+        size_t increment;
+    };
+
+    CodeGenerator& gen;
+    const std::vector<IRInstruction>& code;
+    uint32_t firstName;
+    // Null on the first walk.
+    std::ostream* out = nullptr;
+
+    // Per label id: where its LABEL is, the last jump to it and the jumps
+    // to it left as gotos.
+    std::vector<size_t> labelAt;
+    std::vector<size_t> lastJumpTo;
+    std::vector<uint32_t> gotos;
+    bool anyGoto = false;
+    // Reads of each temp.
+    std::vector<uint32_t> reads;
+
+    std::vector<Loop> loops;
+    uint32_t loopCount = 0;
+    std::vector<char> continues;
+    // Assignment moved into the next loop's for.
+    size_t forInit = kNoPosition;
+    // Where falling off the end of the range being walked goes, as a
+    // destination(). That is the code at the range's end, except in a then
+    // part left through a loop's exit straight to the join.
+    size_t follow = 0;
+
+    // Blocks form a tree under the function body, 0. Per temp: the
+    // innermost block holding all its uses, the block of its first use,
+    // and that use's instruction if it writes the temp without reading it.
+    std::vector<uint32_t> blockParent;
+    std::vector<uint32_t> blockDepth;
+    uint32_t block = 0;
+    std::vector<uint32_t> tempBlock;
+    std::vector<uint32_t> firstBlock;
+    std::vector<size_t> declareAt;
+
+    size_t labelPosition(const Operand& label) const { return labelAt[label.id - firstName]; }
+    size_t skipLabels(size_t i) const;
+    size_t destination(size_t i) const;
+    size_t continuation(size_t i, size_t end) const;
+    bool foldsInto(size_t compare, size_t end) const;
+    Loop loopAt(size_t header, size_t backEdge, size_t end) const;
+    size_t joinAfterLoop(const Condition& cond, size_t target, size_t end) const;
+    bool startsForLoop(size_t i, size_t end) const;
+
+    void walk(size_t begin, size_t end, int depth);
+    void walkBlock(size_t begin, size_t end, int depth, size_t next);
+    size_t walkLoop(size_t header, size_t backEdge, size_t end, int depth);
+    size_t walkBranch(const Condition& cond, size_t end, int depth);
+    void walkJump(size_t jump, const Condition* cond, int depth);
+    void walkStatement(size_t i, size_t end, int depth);
+
+    void use(const Operand& op, bool write, size_t i);
+    void useCondition(const Condition& cond);
+    uint32_t commonBlock(uint32_t a, uint32_t b) const;
+
+    // C that holds when the jump of `cond` is taken, or is not.
+    std::string conditionText(const Condition& cond, bool taken) const;
+    void indent(int depth) { *out << std::string(4 * depth, ' '); }
+};
+
+CodeGenerator::Structurer::Structurer(CodeGenerator& generator, bool scopeTemps)
+    : gen(generator), code(generator.program->code), firstName(generator.program->firstName) {
+    size_t names = generator.program->nameCounter - firstName;
+    labelAt.assign(names, kNoPosition);
+    lastJumpTo.assign(names, kNoPosition);
+    gotos.assign(names, 0);
+    reads.assign(names, 0);
+    tempBlock.assign(names, kNoBlock);
+    firstBlock.assign(names, kNoBlock);
+    declareAt.assign(names, kNoPosition);
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        const IRInstruction& instr = code[i];
+        int defined = instr.definedOperand();
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            const Operand& op = instr.operands[k];
+            if (op.kind == OperandKind::LABEL) {
+                if (instr.opcode == IROpcode::LABEL) labelAt[op.id - firstName] = i;
+                else lastJumpTo[op.id - firstName] = i;
+            } else if (op.kind == OperandKind::TEMP && static_cast<int>(k) != defined) {
+                ++reads[op.id - firstName];
             }
-        } else if (instr.opcode == "LABEL" && instr.operands.size() == 1) {
-            oss << instr.operands[0] << ":\n";
-        } else if (instr.opcode == "JMP" && instr.operands.size() == 1) {
-            oss << "    goto " << instr.operands[0] << ";\n";
-        } else if (instr.opcode == "JZ" && instr.operands.size() == 2) {
-            oss << "    if (!" << instr.operands[0] << ") goto " << instr.operands[1] << ";\n";
-        } else if (instr.opcode == "JNZ" && instr.operands.size() == 2) {
-            oss << "    if (" << instr.operands[0] << ") goto " << instr.operands[1] << ";\n";
         }
     }
 
-    oss << "    return 0;\n}\n";
-    cCode = oss.str();
+    blockParent.push_back(0);
+    blockDepth.push_back(0);
+    follow = code.size();
+    walk(0, code.size(), 1);
+
+    // Declarations in blocks are only safe without gotos to jump past them.
+    for (size_t t = 0; t < names; ++t) {
+        if (!scopeTemps || anyGoto || tempBlock[t] != firstBlock[t]) declareAt[t] = kNoPosition;
+    }
+}
+
+void CodeGenerator::Structurer::emit(std::ostream& stream) {
+    out = &stream;
+    loopCount = 0;
+    follow = code.size();
+    walk(0, code.size(), 1);
+    out = nullptr;
+}
+
+size_t CodeGenerator::Structurer::skipLabels(size_t i) const {
+    while (i < code.size() && code[i].opcode == IROpcode::LABEL) ++i;
+    return i;
+}
+
+// Where control really goes from position i: past any labels, and on
+// through a JMP found there.
+size_t CodeGenerator::Structurer::destination(size_t i) const {
+    i = skipLabels(i);
+    if (i == code.size() || code[i].opcode != IROpcode::JMP) return i;
+    size_t to = labelPosition(code[i].operands[0]);
+    return to == kNoPosition ? i : skipLabels(to);
+}
+
+// Where control goes from position i of a range ending at `end`.
+size_t CodeGenerator::Structurer::continuation(size_t i, size_t end) const {
+    return skipLabels(i) >= end ? follow : destination(i);
+}
+
+bool CodeGenerator::Structurer::foldsInto(size_t compare, size_t end) const {
+    if (compare + 1 >= end) return false;
+    const IRInstruction& test = code[compare + 1];
+    const Operand& result = code[compare].operands[2];
+    return (test.opcode == IROpcode::JZ || test.opcode == IROpcode::JNZ) && result.kind == OperandKind::TEMP &&
+           test.operands[0] == result && reads[result.id - firstName] == 1;
+}
+
+CodeGenerator::Structurer::Loop CodeGenerator::Structurer::loopAt(size_t header, size_t backEdge,
+                                                                  size_t end) const {
+    Loop loop;
+    loop.header = header;
+    loop.backEdge = backEdge;
+    loop.exit = continuation(backEdge + 1, end);
+    loop.index = loopCount;
+    loop.head = {kNoPosition, kNoPosition};
+    loop.tail = {kNoPosition, kNoPosition};
+    loop.bodyBegin = header + 1;
+    loop.bodyEnd = backEdge;
+    loop.increment = kNoPosition;
+
+    if (code[backEdge].opcode != IROpcode::JMP) {
+        loop.tail.test = backEdge;
+        if (backEdge > header + 1 && isRelationalOpcode(code[backEdge - 1].opcode) &&
+            foldsInto(backEdge - 1, backEdge + 1)) {
+            loop.tail.compare = backEdge - 1;
+            loop.bodyEnd = backEdge - 1;
+        }
+        return loop;
+    }
+
+    Condition head = {header + 1, kNoPosition};
+    if (head.test < backEdge && isRelationalOpcode(code[head.test].opcode) && foldsInto(head.test, backEdge))
+        head = {head.test + 1, head.test};
+    if (head.test >= backEdge) return loop;
+    const IRInstruction& test = code[head.test];
+    if (test.opcode != IROpcode::JZ && test.opcode != IROpcode::JNZ) return loop;
+    size_t target = labelPosition(test.operands[1]);
+    if (target == kNoPosition || destination(target) != loop.exit) return loop;
+    loop.head = head;
+    loop.bodyBegin = head.test + 1;
+
+    // A continue would skip a for loop's increment. Which loops continue is
+    // known from the first walk on.
+    if (!out || continues[loop.index] || loop.bodyEnd <= loop.bodyBegin + 1) return loop;
+    const IRInstruction& step = code[loop.bodyEnd - 1];
+    if (step.opcode != IROpcode::ASSIGN && !isArithmeticOpcode(step.opcode)) return loop;
+    const Operand& var = step.operands[step.definedOperand()];
+    if (var.kind != OperandKind::SYMBOL || usesTemps(step)) return loop;
+    bool tested = head.compare != kNoPosition
+                      ? code[head.compare].operands[0] == var || code[head.compare].operands[1] == var
+                      : test.operands[0] == var;
+    if (tested) loop.increment = loop.bodyEnd - 1;
+    return loop;
+}
+
+// The then part of `cond`, up to `target`, ending in a loop whose exit test
+// jumps past the else part starting at `target`: returns the join the test
+// jumps to, or kNoPosition. The loop must be left only by jumps, and
+// nothing in the then part may jump to the labels opening the else part:
+// in C that would become falling out of the if.
+size_t CodeGenerator::Structurer::joinAfterLoop(const Condition& cond, size_t target, size_t end) const {
+    const IRInstruction& backEdge = code[target - 1];
+    if (backEdge.opcode != IROpcode::JMP) return kNoPosition;
+    size_t header = labelPosition(backEdge.operands[0]);
+    if (header == kNoPosition || header <= cond.test || header >= target - 1 ||
+        lastJumpTo[backEdge.operands[0].id - firstName] != target - 1)
+        return kNoPosition;
+
+    size_t test = header + 1;
+    if (test < target - 1 && isRelationalOpcode(code[test].opcode) && foldsInto(test, target - 1)) ++test;
+    if (test >= target - 1 || (code[test].opcode != IROpcode::JZ && code[test].opcode != IROpcode::JNZ))
+        return kNoPosition;
+    size_t join = labelPosition(code[test].operands[1]);
+    if (join != kNoPosition && join > end && destination(join) == follow) join = end;
+    if (join == kNoPosition || join < target || join > end) return kNoPosition;
+
+    size_t elseBegin = skipLabels(target);
+    for (size_t i = cond.test + 1; i < target - 1; ++i) {
+        const IRInstruction& instr = code[i];
+        if (instr.opcode != IROpcode::JMP && instr.opcode != IROpcode::JZ && instr.opcode != IROpcode::JNZ) continue;
+        size_t to = labelPosition(instr.operands[instr.opcode == IROpcode::JMP ? 0 : 1]);
+        if (to != kNoPosition && to >= target && to < elseBegin) return kNoPosition;
+    }
+    return join;
+}
+
+// Whether the assignment at i initializes the variable of the for loop
+// right after it.
+bool CodeGenerator::Structurer::startsForLoop(size_t i, size_t end) const {
+    const IRInstruction& instr = code[i];
+    if (instr.opcode != IROpcode::ASSIGN || usesTemps(instr) || i + 1 >= end ||
+        code[i + 1].opcode != IROpcode::LABEL)
+        return false;
+    uint32_t label = code[i + 1].operands[0].id - firstName;
+    size_t backEdge = lastJumpTo[label];
+    if (gotos[label] || backEdge == kNoPosition || backEdge <= i + 1 || backEdge >= end) return false;
+    Loop loop = loopAt(i + 1, backEdge, end);
+    if (loop.increment == kNoPosition) return false;
+    const IRInstruction& step = code[loop.increment];
+    return step.operands[step.definedOperand()] == instr.operands[1];
+}
+
+void CodeGenerator::Structurer::walk(size_t begin, size_t end, int depth) {
+    size_t i = begin;
+    while (i < end) {
+        const IRInstruction& instr = code[i];
+        if (instr.opcode == IROpcode::LABEL) {
+            uint32_t label = instr.operands[0].id - firstName;
+            size_t backEdge = lastJumpTo[label];
+            if (backEdge != kNoPosition && backEdge > i && backEdge < end) {
+                i = walkLoop(i, backEdge, end, depth);
+                continue;
+            }
+            if (out && gotos[label]) gen.emitSingleStatement(instr, *out, depth);
+            ++i;
+        } else if (instr.opcode == IROpcode::JZ || instr.opcode == IROpcode::JNZ) {
+            i = walkBranch({i, kNoPosition}, end, depth);
+        } else if (instr.opcode == IROpcode::JMP) {
+            walkJump(i, nullptr, depth);
+            ++i;
+        } else if (isRelationalOpcode(instr.opcode) && foldsInto(i, end)) {
+            i = walkBranch({i + 1, i}, end, depth);
+        } else {
+            walkStatement(i, end, depth);
+            ++i;
+        }
+    }
+}
+
+// `next` is where falling off the block's end goes, as a destination().
+void CodeGenerator::Structurer::walkBlock(size_t begin, size_t end, int depth, size_t next) {
+    uint32_t outer = block;
+    size_t outerFollow = follow;
+    if (!out) {
+        block = static_cast<uint32_t>(blockParent.size());
+        blockParent.push_back(outer);
+        blockDepth.push_back(blockDepth[outer] + 1);
+    }
+    follow = next;
+    walk(begin, end, depth);
+    follow = outerFollow;
+    block = outer;
+}
+
+size_t CodeGenerator::Structurer::walkLoop(size_t header, size_t backEdge, size_t end, int depth) {
+    Loop loop = loopAt(header, backEdge, end);
+    ++loopCount;
+    if (!out) {
+        continues.push_back(0);
+        if (loop.head.test != kNoPosition) useCondition(loop.head);
+    } else {
+        if (gotos[code[header].operands[0].id - firstName]) gen.emitSingleStatement(code[header], *out, depth);
+        indent(depth);
+        if (loop.increment != kNoPosition) {
+            *out << "for (" << (forInit != kNoPosition ? gen.assignmentText(code[forInit]) : "") << "; "
+                 << conditionText(loop.head, false) << "; " << gen.assignmentText(code[loop.increment]) << ") {\n";
+        } else if (loop.head.test != kNoPosition) {
+            *out << "while (" << conditionText(loop.head, false) << ") {\n";
+        } else if (loop.tail.test != kNoPosition && !continues[loop.index]) {
+            *out << "do {\n";
+        } else {
+            *out << "for (;;) {\n";
+        }
+    }
+    forInit = kNoPosition;
+
+    loops.push_back(loop);
+    size_t bodyEnd = loop.increment != kNoPosition ? loop.increment : loop.bodyEnd;
+    walkBlock(loop.bodyBegin, bodyEnd, depth + 1, destination(bodyEnd));
+    loops.pop_back();
+
+    // The tail test is outside a do's braces, so its temps must be too.
+    if (!out) {
+        if (loop.tail.test != kNoPosition) useCondition(loop.tail);
+    } else if (loop.tail.test == kNoPosition) {
+        indent(depth);
+        *out << "}\n";
+    } else if (!continues[loop.index]) {
+        indent(depth);
+        *out << "} while (" << conditionText(loop.tail, true) << ");\n";
+    } else {
+        indent(depth + 1);
+        *out << "if (" << conditionText(loop.tail, false) << ") break;\n";
+        indent(depth);
+        *out << "}\n";
+    }
+    return backEdge + 1;
+}
+
+size_t CodeGenerator::Structurer::walkBranch(const Condition& cond, size_t end, int depth) {
+    const IRInstruction& test = code[cond.test];
+    // A jump past the range's end to where falling off its end goes ends
+    // the then part there.
+    size_t target = labelPosition(test.operands[1]);
+    if (target != kNoPosition && target > end && destination(target) == follow) target = end;
+    if (target == kNoPosition || target <= cond.test || target > end) {
+        walkJump(cond.test, &cond, depth);
+        return cond.test + 1;
+    }
+
+    // The then part jumping over a later label at its end has an else.
+    size_t thenEnd = target;
+    size_t elseEnd = target;
+    if (target < end && target > cond.test + 1 && code[target - 1].opcode == IROpcode::JMP) {
+        size_t join = labelPosition(code[target - 1].operands[0]);
+        if (join != kNoPosition && join > end && destination(join) == follow) join = end;
+        if (join != kNoPosition && join >= target && join <= end) {
+            thenEnd = target - 1;
+            elseEnd = join;
+        } else if ((join = joinAfterLoop(cond, target, end)) != kNoPosition) {
+            elseEnd = join;
+        }
+    }
+    bool hasThen = thenEnd > cond.test + 1;
+    bool hasElse = elseEnd > target;
+
+    if (!out) {
+        useCondition(cond);
+    } else {
+        indent(depth);
+        *out << "if (" << conditionText(cond, !hasThen && hasElse) << ") {\n";
+    }
+    // Both parts end where the if does.
+    size_t next = continuation(elseEnd, end);
+    if (hasThen || !hasElse) walkBlock(cond.test + 1, thenEnd, depth + 1, next);
+    if (hasThen && hasElse && out) {
+        indent(depth);
+        *out << "} else {\n";
+    }
+    if (hasElse) walkBlock(target, elseEnd, depth + 1, next);
+    if (out) {
+        indent(depth);
+        *out << "}\n";
+    }
+    return elseEnd;
 }
 
-void CodeGenerator::declareVar(const std::string& var, const std::string& value) {
-    if (var.empty() || declaredVars.count(var)) return;
+void CodeGenerator::Structurer::walkJump(size_t jump, const Condition* cond, int depth) {
+    const IRInstruction& instr = code[jump];
+    const Operand& label = instr.operands[instr.opcode == IROpcode::JMP ? 0 : 1];
+    size_t target = labelPosition(label);
+    const char* keyword = nullptr;
+    if (!loops.empty() && target != kNoPosition) {
+        const Loop& loop = loops.back();
+        if (destination(target) == loop.exit) {
+            keyword = "break";
+        } else if (skipLabels(target) == skipLabels(loop.header)) {
+            keyword = "continue";
+            continues[loop.index] = 1;
+        }
+    }
 
-    if (value.empty()) {
-        declaredVars[var] = "double"; 
+    if (!out) {
+        if (cond) useCondition(*cond);
+        if (!keyword) {
+            anyGoto = true;
+            ++gotos[label.id - firstName];
+        }
         return;
     }
+    indent(depth);
+    if (cond) *out << "if (" << conditionText(*cond, true) << ") ";
+    if (keyword) *out << keyword << ";\n";
+    else *out << "goto " << gen.program->operandToString(label) << ";\n";
+}
 
-    if (value[0] == '"') {
-        declaredVars[var] = "const char*";
-    } else if (isInteger(value)) {
-        declaredVars[var] = "int";
-    } else if (isDouble(value)) {
-        declaredVars[var] = "double";
-    } else if (declaredVars.count(value)) {
-        declaredVars[var] = declaredVars[value];
+void CodeGenerator::Structurer::walkStatement(size_t i, size_t end, int depth) {
+    const IRInstruction& instr = code[i];
+    int defined = instr.definedOperand();
+    if (!out) {
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            if (static_cast<int>(k) != defined) use(instr.operands[k], false, i);
+        }
+        // INPUT keeps the old value when nothing is read.
+        if (defined >= 0) use(instr.operands[defined], instr.opcode != IROpcode::INPUT, i);
+        return;
+    }
+    if (startsForLoop(i, end)) {
+        forInit = i;
+        return;
+    }
+    bool declare = defined >= 0 && instr.operands[defined].kind == OperandKind::TEMP &&
+                   declareAt[instr.operands[defined].id - firstName] == i;
+    gen.emitSingleStatement(instr, *out, depth, declare);
+}
+
+void CodeGenerator::Structurer::use(const Operand& op, bool write, size_t i) {
+    if (op.kind != OperandKind::TEMP) return;
+    uint32_t t = op.id - firstName;
+    if (tempBlock[t] == kNoBlock) {
+        tempBlock[t] = firstBlock[t] = block;
+        if (write) declareAt[t] = i;
     } else {
-        declaredVars[var] = "double";
+        tempBlock[t] = commonBlock(tempBlock[t], block);
+    }
+}
+
+void CodeGenerator::Structurer::useCondition(const Condition& cond) {
+    if (cond.compare == kNoPosition) {
+        use(code[cond.test].operands[0], false, cond.test);
+        return;
+    }
+    use(code[cond.compare].operands[0], false, cond.compare);
+    use(code[cond.compare].operands[1], false, cond.compare);
+}
+
+uint32_t CodeGenerator::Structurer::commonBlock(uint32_t a, uint32_t b) const {
+    while (blockDepth[a] > blockDepth[b]) a = blockParent[a];
+    while (blockDepth[b] > blockDepth[a]) b = blockParent[b];
+    while (a != b) {
+        a = blockParent[a];
+        b = blockParent[b];
+    }
+    return a;
+}
+
+std::string CodeGenerator::Structurer::conditionText(const Condition& cond, bool taken) const {
+    const IRProgram& ir = *gen.program;
+    // JNZ is taken when its operand holds, JZ when it does not.
+    bool holds = (code[cond.test].opcode == IROpcode::JNZ) == taken;
+    if (cond.compare == kNoPosition) {
+        std::string value = ir.operandToString(code[cond.test].operands[0]);
+        return holds ? value : "!" + value;
     }
+    const IRInstruction& compare = code[cond.compare];
+    std::string text = ir.operandToString(compare.operands[0]) + " " + relOpSymbol(compare.opcode) + " " +
+                       ir.operandToString(compare.operands[1]);
+    return holds ? text : "!(" + text + ")";
+}
+
+void CodeGenerator::generate(const IRProgram& ir) {
+    cCode.clear();
+    program = &ir;
+    symbolTypes.clear();
+    takeTypes(ir);
+    Structurer structurer(*this, true);
+
+    std::ostringstream oss;
+    oss << "#include <stdio.h>\n\nint main() {\n";
+
+    std::vector<char> used = usedVariables(ir);
+    for (size_t i = 0; i < ir.symbols.size(); ++i) {
+        if (symbolTypes[i] != CType::NONE && used[i])
+            oss << "    " << cTypeName(symbolTypes[i]) << " " << ir.symbols[i] << " = 0;\n";
+    }
+    for (uint32_t t = 0; t < ir.nameCounter; ++t) {
+        if (tempTypes[t] != CType::NONE && structurer.names(t) && !structurer.declaredInPlace(t))
+            oss << "    " << cTypeName(tempTypes[t]) << " _t" << t << " = 0;\n";
+    }
+
+    structurer.emit(oss);
+
+    oss << "    return 0;\n}\n";
+    cCode = oss.str();
+    program = nullptr;
+}
+
+void CodeGenerator::beginStream(std::ostream& out) {
+    stream = &out;
+    symbolTypes.clear();
+    declaredSymbols.clear();
+    out << "#include <stdio.h>\n\nint main() {\n";
 }
 
-bool CodeGenerator::isInteger(const std::string& s) const {
-    if (s.empty()) return false;
-    for (char c : s) {
-        if (!isdigit(c)) return false;
+void CodeGenerator::emitFragment(const IRProgram& fragment) {
+    std::ostream& out = *stream;
+    program = &fragment;
+    takeTypes(fragment);
+    Structurer structurer(*this, false);
+
+    // Symbols are declared where the stream first uses them.
+    declaredSymbols.resize(fragment.symbols.size(), 0);
+    for (const auto& instr : fragment.code) {
+        for (size_t i = 0; i < instr.operandCount(); ++i) {
+            const Operand& op = instr.operands[i];
+            if (op.kind != OperandKind::SYMBOL || declaredSymbols[op.id] || symbolTypes[op.id] == CType::NONE) continue;
+            declaredSymbols[op.id] = 1;
+            out << "    " << cTypeName(symbolTypes[op.id]) << " " << fragment.symbols[op.id] << " = 0;\n";
+        }
     }
-    return true;
+
+    bool scoped = false;
+    for (uint32_t t = 0; t < tempTypes.size(); ++t) {
+        if (tempTypes[t] == CType::NONE || !structurer.names(t)) continue;
+        if (!scoped) out << "    {\n";
+        scoped = true;
+        out << "    " << cTypeName(tempTypes[t]) << " _t" << fragment.firstName + t << " = 0;\n";
+    }
+
+    structurer.emit(out);
+    if (scoped) out << "    }\n";
+    program = nullptr;
 }
 
-bool CodeGenerator::isDouble(const std::string& s) const {
-    if (s.empty()) return false;
-    bool dot = false;
-    for (char c : s) {
-        if (c == '.') {
-            if (dot) return false;
-            dot = true;
-        } else if (!isdigit(c)) {
-            return false;
+void CodeGenerator::endStream() {
+    *stream << "    return 0;\n}\n";
+    stream = nullptr;
+}
+
+std::string CodeGenerator::assignmentText(const IRInstruction& instr) const {
+    const IRProgram& ir = *program;
+    const Operand* ops = instr.operands;
+    if (instr.opcode == IROpcode::ASSIGN) return ir.operandToString(ops[1]) + " = " + ir.operandToString(ops[0]);
+    if (isRelationalOpcode(instr.opcode))
+        return ir.operandToString(ops[2]) + " = (" + ir.operandToString(ops[0]) + " " + relOpSymbol(instr.opcode) +
+               " " + ir.operandToString(ops[1]) + ")";
+    return ir.operandToString(ops[2]) + " = " + ir.operandToString(ops[0]) + " " + arithOpSymbol(instr.opcode) + " " +
+           ir.operandToString(ops[1]);
+}
+
+void CodeGenerator::emitSingleStatement(const IRInstruction& instr, std::ostream& oss, int depth, bool declare) {
+    const IRProgram& ir = *program;
+    const Operand* ops = instr.operands;
+    std::string indent(4 * depth, ' ');
+
+    switch (instr.opcode) {
+        case IROpcode::ASSIGN:
+        case IROpcode::ADD:
+        case IROpcode::SUB:
+        case IROpcode::MUL:
+        case IROpcode::DIV:
+        case IROpcode::LT:
+        case IROpcode::LE:
+        case IROpcode::GT:
+        case IROpcode::GE:
+        case IROpcode::EQ:
+        case IROpcode::NE: {
+            CType type = typeOf(ops[instr.definedOperand()]);
+            oss << indent;
+            if (declare && type != CType::NONE) oss << cTypeName(type) << " ";
+            oss << assignmentText(instr) << ";\n";
+            break;
+        }
+        case IROpcode::INPUT: {
+            std::string var = ir.operandToString(ops[0]);
+            oss << indent << "printf(\"Enter value for " << var << ": \");\n";
+            oss << indent << "scanf(\"%lf\", &" << var << ");\n";
+            break;
+        }
+        case IROpcode::OUTPUT: {
+            std::string var = ir.operandToString(ops[0]);
+            if (ops[0].kind == OperandKind::STRING) {
+                oss << indent << "printf(" << var << ");\n";
+            } else if (typeOf(ops[0]) != CType::NONE) {
+                CType type = typeOf(ops[0]);
+                if (type == CType::INT)
+                    oss << indent << "printf(\"%d\\n\", " << var << ");\n";
+                else if (type == CType::DOUBLE)
+                    oss << indent << "printf(\"%lf\\n\", " << var << ");\n";
+                else
+                    oss << indent << "printf(\"%s\\n\", " << var << ");\n";
+            } else {
+                oss << indent << "printf(\"%lf\\n\", " << var << ");\n";
+            }
+            break;
         }
+        // A label may end a block or precede a declaration only as a
+        // labeled empty statement.
+        case IROpcode::LABEL:
+            oss << ir.operandToString(ops[0]) << ": ;\n";
+            break;
+        case IROpcode::JMP:
+            oss << indent << "goto " << ir.operandToString(ops[0]) << ";\n";
+            break;
+        case IROpcode::JZ:
+            oss << indent << "if (!" << ir.operandToString(ops[0]) << ") goto " << ir.operandToString(ops[1]) << ";\n";
+            break;
+        case IROpcode::JNZ:
+            oss << indent << "if (" << ir.operandToString(ops[0]) << ") goto " << ir.operandToString(ops[1]) << ";\n";
+            break;
     }
-    return dot;
 }
 
 const std::string& CodeGenerator::getCCode() const {
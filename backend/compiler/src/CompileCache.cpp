@@ -0,0 +1,261 @@
+#include "CompileCache.h"
+#include "Driver.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Bump when the entry layout or the meaning of a cached artifact changes.
+static const char kCacheFormat[] = "codepie-cache-1";
+// Temporary files older than this were left behind by a writer that died.
+static const auto kStaleTempAge = std::chrono::hours(1);
+
+static fs::path executablePath() {
+#ifdef _WIN32
+    wchar_t buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameW(nullptr, buffer, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) return fs::path();
+    return fs::path(std::wstring(buffer, length));
+#elif defined(__linux__)
+    std::error_code ec;
+    fs::path path = fs::read_symlink("/proc/self/exe", ec);
+    return ec ? fs::path() : path;
+#else
+    return fs::path();
+#endif
+}
+
+const std::string& compilerBuildKey() {
+    static const std::string key = [] {
+        std::string k = kCacheFormat;
+#if defined(__VERSION__)
+        k += "|" __VERSION__;
+#elif defined(_MSC_FULL_VER)
+        k += "|msc" + std::to_string(_MSC_FULL_VER);
+#endif
+        k += "|" __DATE__ " " __TIME__;
+        fs::path exe = executablePath();
+        std::error_code ec;
+        uintmax_t size = exe.empty() ? 0 : fs::file_size(exe, ec);
+        if (!exe.empty() && !ec) {
+            auto modified = fs::last_write_time(exe, ec);
+            if (!ec) {
+                k += "|" + std::to_string(size) + "|" +
+                     std::to_string(modified.time_since_epoch().count());
+            }
+        }
+        return k;
+    }();
+    return key;
+}
+
+static unsigned long processId() {
+#ifdef _WIN32
+    return static_cast<unsigned long>(_getpid());
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+}
+
+CompileCache::CompileCache(const std::string& dir, uint64_t limit)
+    : directory(dir), maxBytes(limit), bytesSinceTrim(0), tempCounter(0) {
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+}
+
+std::string CompileCache::keyFor(std::string_view source, unsigned emit) const {
+    Sha256 hash;
+    const std::string& build = compilerBuildKey();
+    hash.update(build.data(), build.size() + 1);
+    std::string mask = std::to_string(emit);
+    hash.update(mask.data(), mask.size() + 1);
+
+    // Drop the CR of every CRLF that is not inside a string literal. The
+    // lexer treats a lone CR as whitespace, so the tokens, their lines and
+    // columns, and everything after are unchanged.
+    bool inString = false;
+    size_t spanStart = 0;
+    for (size_t i = 0; i < source.size(); ++i) {
+        char c = source[i];
+        if (c == '"') {
+            inString = !inString;
+        } else if (c == '\r' && !inString && i + 1 < source.size() && source[i + 1] == '\n') {
+            hash.update(source.data() + spanStart, i - spanStart);
+            spanStart = i + 1;
+        }
+    }
+    hash.update(source.data() + spanStart, source.size() - spanStart);
+    return hash.hexDigest();
+}
+
+static bool readSection(std::string_view& in, std::string_view& name, std::string_view& body) {
+    size_t newline = in.find('\n');
+    if (newline == std::string_view::npos) return false;
+    std::string_view header = in.substr(0, newline);
+    size_t space = header.find(' ');
+    if (space == std::string_view::npos) return false;
+    name = header.substr(0, space);
+    char* end = nullptr;
+    std::string lengthText(header.substr(space + 1));
+    unsigned long long length = std::strtoull(lengthText.c_str(), &end, 10);
+    if (end == lengthText.c_str() || *end != '\0' || length > in.size() - newline - 1) return false;
+    body = in.substr(newline + 1, static_cast<size_t>(length));
+    in.remove_prefix(newline + 1 + static_cast<size_t>(length));
+    return true;
+}
+
+// Entry layout, framed like the --serve response:
+//   CODEPIE <sectionCount>\n
+//   key <64>\n<hex key>, then tokens, error (one per error), ir,
+//   optimized_ir, c_code and output as emitted.
+static bool parseEntry(std::string_view in, const std::string& key, CompileArtifacts& artifacts) {
+    if (in.compare(0, 8, "CODEPIE ") != 0) return false;
+    size_t newline = in.find('\n');
+    if (newline == std::string_view::npos) return false;
+    unsigned long count = std::strtoul(std::string(in.substr(8, newline - 8)).c_str(), nullptr, 10);
+    in.remove_prefix(newline + 1);
+
+    std::string_view name, body;
+    if (count == 0 || !readSection(in, name, body) || name != "key" || body != key) return false;
+    for (unsigned long i = 1; i < count; ++i) {
+        if (!readSection(in, name, body)) return false;
+        if (name == "tokens") artifacts.tokens.assign(body);
+        else if (name == "error") artifacts.errors.emplace_back(body);
+        else if (name == "ir") artifacts.ir.assign(body);
+        else if (name == "optimized_ir") artifacts.optimizedIR.assign(body);
+        else if (name == "c_code") artifacts.cCode.assign(body);
+        else if (name == "output") artifacts.output.assign(body);
+        else return false;
+    }
+    artifacts.generated = !artifacts.output.empty();
+    return in.empty();
+}
+
+bool CompileCache::lookup(std::string_view source, unsigned emit, CompileArtifacts& artifacts) {
+    std::string key = keyFor(source, emit);
+    fs::path path = fs::path(directory) / (key + ".entry");
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) return false;
+    std::string entry((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    CompileArtifacts found;
+    std::error_code ec;
+    if (!parseEntry(entry, key, found)) {
+        fs::remove(path, ec);
+        return false;
+    }
+    artifacts.tokens = std::move(found.tokens);
+    artifacts.errors = std::move(found.errors);
+    artifacts.ir = std::move(found.ir);
+    artifacts.optimizedIR = std::move(found.optimizedIR);
+    artifacts.cCode = std::move(found.cCode);
+    artifacts.output = std::move(found.output);
+    artifacts.generated = found.generated;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void CompileCache::store(std::string_view source, unsigned emit, const CompileArtifacts& artifacts) {
+    std::string key = keyFor(source, emit);
+    unsigned count = 2 + static_cast<unsigned>(artifacts.errors.size());
+    if (emit & EMIT_TOKENS) ++count;
+    if (emit & EMIT_IR) ++count;
+    if (emit & EMIT_OPT_IR) ++count;
+    if (emit & EMIT_C) ++count;
+
+    std::string entry = "CODEPIE " + std::to_string(count) + "\n";
+    appendSection(entry, "key", key);
+    if (emit & EMIT_TOKENS) appendSection(entry, "tokens", artifacts.tokens);
+    for (const auto& error : artifacts.errors) appendSection(entry, "error", error);
+    if (emit & EMIT_IR) appendSection(entry, "ir", artifacts.ir);
+    if (emit & EMIT_OPT_IR) appendSection(entry, "optimized_ir", artifacts.optimizedIR);
+    if (emit & EMIT_C) appendSection(entry, "c_code", artifacts.cCode);
+    appendSection(entry, "output", artifacts.output);
+
+    // Written aside and renamed into place, so a reader sees either no
+    // entry or a complete one.
+    fs::path dir(directory);
+    fs::path temp = dir / (key + ".tmp-" + std::to_string(processId()) + "-" +
+                           std::to_string(tempCounter.fetch_add(1)));
+    {
+        std::ofstream out(temp, std::ios::binary);
+        if (!out.is_open()) return;
+        out.write(entry.data(), static_cast<std::streamsize>(entry.size()));
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            fs::remove(temp, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp, dir / (key + ".entry"), ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        return;
+    }
+
+    // Trimming lists the whole directory, so it runs on about one store in
+    // sixteen (picked by key, which also covers one-shot processes) or once
+    // a sixteenth of the budget has been written since the last trim.
+    uint64_t written = bytesSinceTrim.fetch_add(entry.size()) + entry.size();
+    if (key[0] == '0' || written >= maxBytes / 16) {
+        bytesSinceTrim.store(0);
+        trim();
+    }
+}
+
+void CompileCache::trim() {
+    struct Entry {
+        fs::file_time_type modified;
+        uintmax_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    auto staleBefore = fs::file_time_type::clock::now() - kStaleTempAge;
+
+    std::error_code ec;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (!it->is_regular_file(entryEc)) continue;
+        std::string name = it->path().filename().string();
+        auto modified = it->last_write_time(entryEc);
+        if (entryEc) continue;
+        if (name.find(".tmp-") != std::string::npos) {
+            if (modified < staleBefore) fs::remove(it->path(), entryEc);
+            continue;
+        }
+        if (it->path().extension() != ".entry") continue;
+        uintmax_t size = it->file_size(entryEc);
+        if (entryEc) continue;
+        entries.push_back({modified, size, it->path()});
+        total += size;
+    }
+    if (total <= maxBytes) return;
+
+    // Least recently used first, down to 90% of the budget so the next few
+    // stores do not trim again straight away.
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.modified < b.modified; });
+    uint64_t target = maxBytes - maxBytes / 10;
+    for (const auto& entry : entries) {
+        if (total <= target) break;
+        std::error_code removeEc;
+        if (fs::remove(entry.path, removeEc)) total -= entry.size;
+    }
+}
@@ -0,0 +1,233 @@
+#include "ControlFlowGraph.h"
+#include <algorithm>
+#include <utility>
+
+static bool endsBlock(IROpcode op) {
+    return op == IROpcode::JMP || op == IROpcode::JZ || op == IROpcode::JNZ;
+}
+
+ControlFlowGraph::ControlFlowGraph(const IRProgram& ir) : firstName(ir.firstName) {
+    buildBlocks(ir);
+    buildOrder();
+    buildDominators();
+    buildLoops();
+}
+
+uint32_t ControlFlowGraph::blockOfLabel(const Operand& label) const {
+    if (label.kind != OperandKind::LABEL || label.id < firstName) return kNoBlock;
+    uint32_t index = label.id - firstName;
+    return index < labelBlocks.size() ? labelBlocks[index] : kNoBlock;
+}
+
+bool ControlFlowGraph::dominates(uint32_t a, uint32_t b) const {
+    if (!isReachable(a) || !isReachable(b)) return false;
+    return domEnter[a] <= domEnter[b] && domExit[b] <= domExit[a];
+}
+
+uint32_t ControlFlowGraph::loopDepth(uint32_t b) const {
+    return blockLoop[b] == kNoLoop ? 0 : loopList[blockLoop[b]].depth;
+}
+
+void ControlFlowGraph::buildBlocks(const IRProgram& ir) {
+    const auto& code = ir.code;
+    labelBlocks.assign(ir.nameCounter - ir.firstName, kNoBlock);
+    for (size_t i = 0; i < code.size(); ++i) {
+        bool leader = i == 0 || code[i].opcode == IROpcode::LABEL || endsBlock(code[i - 1].opcode);
+        if (leader) {
+            if (!blockList.empty()) blockList.back().end = i;
+            blockList.emplace_back();
+            blockList.back().begin = i;
+        }
+        if (code[i].opcode == IROpcode::LABEL) {
+            labelBlocks[code[i].operands[0].id - ir.firstName] = static_cast<uint32_t>(blockList.size() - 1);
+        }
+    }
+    if (!blockList.empty()) blockList.back().end = code.size();
+
+    // At most two successors each: the jump target and the next block.
+    uint32_t count = static_cast<uint32_t>(blockList.size());
+    succStart.assign(count + 1, 0);
+    succList.reserve(count * 2);
+    std::vector<uint32_t> predCount(count + 1, 0);
+    for (uint32_t b = 0; b < count; ++b) {
+        const IRInstruction& last = code[blockList[b].end - 1];
+        uint32_t next = b + 1 < count ? b + 1 : kNoBlock;
+        uint32_t target = kNoBlock;
+        if (last.opcode == IROpcode::JMP) {
+            next = kNoBlock;
+            target = blockOfLabel(last.operands[0]);
+        } else if (last.opcode == IROpcode::JZ || last.opcode == IROpcode::JNZ) {
+            target = blockOfLabel(last.operands[1]);
+        }
+        if (next != kNoBlock) succList.push_back(next);
+        if (target != kNoBlock && target != next) succList.push_back(target);
+        succStart[b + 1] = static_cast<uint32_t>(succList.size());
+    }
+
+    for (uint32_t s : succList) ++predCount[s + 1];
+    predStart.assign(count + 1, 0);
+    for (uint32_t b = 0; b < count; ++b) predStart[b + 1] = predStart[b] + predCount[b + 1];
+    predList.resize(succList.size());
+    std::vector<uint32_t> fill(predStart.begin(), predStart.end() - 1);
+    for (uint32_t b = 0; b < count; ++b) {
+        for (uint32_t s : succs(b)) predList[fill[s]++] = b;
+    }
+}
+
+void ControlFlowGraph::buildOrder() {
+    rpoIndex.assign(blockList.size(), kNoBlock);
+    if (blockList.empty()) return;
+
+    // Iterative depth-first search: straight-line programs make chains as
+    // long as the program.
+    std::vector<char> visited(blockList.size(), 0);
+    std::vector<std::pair<uint32_t, size_t>> stack;
+    stack.emplace_back(0, 0);
+    visited[0] = 1;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        BlockList next = succs(top.first);
+        if (top.second < next.size()) {
+            uint32_t b = next[top.second++];
+            if (!visited[b]) {
+                visited[b] = 1;
+                stack.emplace_back(b, 0);
+            }
+            continue;
+        }
+        rpo.push_back(top.first);
+        stack.pop_back();
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for (uint32_t i = 0; i < rpo.size(); ++i) rpoIndex[rpo[i]] = i;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm: intersect the
+// dominator chains of each block's processed predecessors, in reverse
+// postorder, until nothing changes.
+void ControlFlowGraph::buildDominators() {
+    size_t count = blockList.size();
+    idoms.assign(count, kNoBlock);
+    domChildStart.assign(count + 1, 0);
+    domEnter.assign(count, 0);
+    domExit.assign(count, 0);
+    if (rpo.empty()) return;
+
+    auto intersect = [this](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (rpoIndex[a] > rpoIndex[b]) a = idoms[a];
+            while (rpoIndex[b] > rpoIndex[a]) b = idoms[b];
+        }
+        return a;
+    };
+    idoms[0] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < rpo.size(); ++i) {
+            uint32_t b = rpo[i];
+            uint32_t dom = kNoBlock;
+            for (uint32_t p : preds(b)) {
+                if (idoms[p] == kNoBlock) continue;
+                dom = dom == kNoBlock ? p : intersect(p, dom);
+            }
+            if (idoms[b] != dom) {
+                idoms[b] = dom;
+                changed = true;
+            }
+        }
+    }
+    idoms[0] = kNoBlock;
+
+    // Children in reverse postorder, grouped by parent.
+    for (uint32_t b : rpo) {
+        if (idoms[b] != kNoBlock) ++domChildStart[idoms[b] + 1];
+    }
+    for (size_t b = 0; b < count; ++b) domChildStart[b + 1] += domChildStart[b];
+    domChildren.resize(domChildStart[count]);
+    std::vector<uint32_t> fill(domChildStart.begin(), domChildStart.end() - 1);
+    for (uint32_t b : rpo) {
+        if (idoms[b] != kNoBlock) domChildren[fill[idoms[b]]++] = b;
+    }
+    uint32_t clock = 0;
+    std::vector<std::pair<uint32_t, size_t>> stack;
+    stack.emplace_back(0, 0);
+    domEnter[0] = clock++;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        BlockList children = dominatorChildren(top.first);
+        if (top.second < children.size()) {
+            uint32_t child = children[top.second++];
+            domEnter[child] = clock++;
+            stack.emplace_back(child, 0);
+            continue;
+        }
+        domExit[top.first] = clock++;
+        stack.pop_back();
+    }
+}
+
+void ControlFlowGraph::buildLoops() {
+    blockLoop.assign(blockList.size(), kNoLoop);
+    // Membership marks, stamped with the loop's number so they need no
+    // clearing between loops.
+    std::vector<uint32_t> mark(blockList.size(), 0);
+    uint32_t stamp = 0;
+    for (uint32_t header : rpo) {
+        Loop loop;
+        loop.header = header;
+        for (uint32_t p : preds(header)) {
+            if (dominates(header, p)) loop.latches.push_back(p);
+        }
+        if (loop.latches.empty()) continue;
+
+        // Walk back from the latches; the header stops the walk, since it
+        // dominates everything in the loop.
+        ++stamp;
+        mark[header] = stamp;
+        loop.blocks.push_back(header);
+        std::vector<uint32_t> stack(loop.latches.begin(), loop.latches.end());
+        while (!stack.empty()) {
+            uint32_t b = stack.back();
+            stack.pop_back();
+            if (mark[b] == stamp) continue;
+            mark[b] = stamp;
+            loop.blocks.push_back(b);
+            for (uint32_t p : preds(b)) {
+                if (mark[p] != stamp && isReachable(p)) stack.push_back(p);
+            }
+        }
+        std::sort(loop.blocks.begin(), loop.blocks.end());
+
+        uint32_t entering = kNoBlock;
+        size_t enteringCount = 0;
+        for (uint32_t p : preds(header)) {
+            if (mark[p] == stamp || !isReachable(p)) continue;
+            entering = p;
+            ++enteringCount;
+        }
+        if (enteringCount == 1 && succs(entering).size() == 1) loop.preheader = entering;
+        loopList.push_back(std::move(loop));
+    }
+
+    // Natural loops with different headers are nested or disjoint. Taking
+    // them largest first, the innermost loop seen so far at a header is its
+    // parent.
+    std::vector<uint32_t> order(loopList.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        size_t sizeA = loopList[a].blocks.size(), sizeB = loopList[b].blocks.size();
+        return sizeA != sizeB ? sizeA > sizeB : a < b;
+    });
+    std::vector<Loop> sorted;
+    sorted.reserve(loopList.size());
+    for (uint32_t index : order) {
+        Loop& loop = loopList[index];
+        uint32_t self = static_cast<uint32_t>(sorted.size());
+        loop.parent = blockLoop[loop.header];
+        loop.depth = loop.parent == kNoLoop ? 1 : sorted[loop.parent].depth + 1;
+        for (uint32_t b : loop.blocks) blockLoop[b] = self;
+        sorted.push_back(std::move(loop));
+    }
+    loopList = std::move(sorted);
+}
@@ -0,0 +1,487 @@
+#include "Driver.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include "Optimizer.h"
+#include "CodeGenerator.h"
+#include "Incremental.h"
+#include "CompileCache.h"
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+void CompileArtifacts::clear() {
+    tokens.clear();
+    errors.clear();
+    ir.clear();
+    optimizedIR.clear();
+    cCode.clear();
+    output.clear();
+    stats.clear();
+    trace.clear();
+    generated = false;
+}
+
+bool parseEmitList(const std::string& list, unsigned& mask) {
+    mask = 0;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) comma = list.size();
+        std::string name = list.substr(start, comma - start);
+        if (name == "tokens") mask |= EMIT_TOKENS;
+        else if (name == "errors") mask |= EMIT_ERRORS;
+        else if (name == "ir") mask |= EMIT_IR;
+        else if (name == "opt-ir") mask |= EMIT_OPT_IR;
+        else if (name == "c") mask |= EMIT_C;
+        else if (name == "stats") mask |= EMIT_STATS;
+        else if (name == "all") mask |= EMIT_ALL;
+        else if (!name.empty()) return false;
+        start = comma + 1;
+    }
+    return mask != 0;
+}
+
+static void appendInt(std::string& out, int value) {
+    char buf[16];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+void appendTokenLine(std::string& out, const Token& token) {
+    out += "Type: ";
+    appendInt(out, static_cast<int>(token.type));
+    out += ", Lexeme: ";
+    out.append(token.lexeme.data(), token.lexeme.size());
+    out += ", Line: ";
+    appendInt(out, token.line);
+    out += ", Col: ";
+    appendInt(out, token.column);
+    out += '\n';
+}
+
+std::string lexicalErrorMessage(const Token& token) {
+    return "Lexical error at line " + std::to_string(token.line) +
+           ", column " + std::to_string(token.column) + ": Invalid token '" + std::string(token.lexeme) + "'";
+}
+
+void appendIR(std::string& out, const IRProgram& ir) {
+    for (const auto& instr : ir.code) {
+        ir.appendInstruction(out, instr);
+        out += '\n';
+    }
+}
+
+CompilerDriver::CompilerDriver() {}
+
+CompilerDriver::~CompilerDriver() {}
+
+void CompilerDriver::setIncremental(bool enabled) {
+    if (!enabled) frontend.reset();
+    else if (!frontend) frontend = std::make_unique<IncrementalFrontend>();
+}
+
+void CompilerDriver::setCache(CompileCache* compileCache) {
+    cache = compileCache;
+}
+
+void CompilerDriver::beginPhase(const char* name) {
+    if (recording) telemetry.beginPhase(name);
+}
+
+void CompilerDriver::endPhase() {
+    if (recording) telemetry.endPhase();
+}
+
+void CompilerDriver::count(const std::string& name, uint64_t value) {
+    if (recording) telemetry.setCounter(name, value);
+}
+
+void CompilerDriver::finishStats() {
+    if (!recording) return;
+    telemetry.endPhase();
+    telemetry.appendJson(artifacts.stats);
+    telemetry.appendChromeTrace(artifacts.trace);
+    recording = false;
+}
+
+const CompileArtifacts& CompilerDriver::compile(std::string_view source, unsigned emit) {
+    artifacts.clear();
+    artifacts.emitted = emit;
+    program.clear();
+    recording = (emit & EMIT_STATS) != 0;
+    if (recording) {
+        telemetry.start();
+        telemetry.beginPhase("compile");
+        telemetry.setCounter("source_bytes", source.size());
+    }
+    bool cached = false;
+    bool cacheable = cache && !(emit & EMIT_PROGRAM);
+    if (cacheable) {
+        beginPhase("cache_lookup");
+        cached = cache->lookup(source, emit & ~EMIT_STATS, artifacts);
+        endPhase();
+        count("cache_hit", cached ? 1 : 0);
+    }
+    if (!cached) {
+        if (frontend) runIncremental(source, emit);
+        else runPipeline(source, emit);
+        if (cacheable) {
+            beginPhase("cache_store");
+            cache->store(source, emit & ~EMIT_STATS, artifacts);
+            endPhase();
+        }
+    }
+    count("errors", artifacts.errors.size());
+    finishStats();
+    return artifacts;
+}
+
+void CompilerDriver::runPipeline(std::string_view source, unsigned emit) {
+    astArena.reset();
+    std::vector<std::string>& errors = artifacts.errors;
+
+    beginPhase("lex");
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    endPhase();
+    count("tokens", tokens.size());
+    if (emit & EMIT_TOKENS) {
+        artifacts.tokens.reserve(tokens.size() * 40);
+        for (const auto& token : tokens) appendTokenLine(artifacts.tokens, token);
+    }
+    for (const auto& token : tokens) {
+        if (token.type == TokenType::INVALID) {
+            errors.push_back(lexicalErrorMessage(token));
+        }
+    }
+
+    beginPhase("parse");
+    Parser parser(tokens, astArena);
+    Program* ast = parser.parse();
+    endPhase();
+    count("ast_nodes", parser.getNodeCount());
+    count("ast_arena_bytes", astArena.bytesReserved());
+    const auto& parseErrors = parser.getErrors();
+    errors.insert(errors.end(), parseErrors.begin(), parseErrors.end());
+
+    beginPhase("semantic");
+    SemanticAnalyzer sema;
+    sema.analyze(ast);
+    endPhase();
+    count("symbols", sema.getSymbolCount());
+    const auto& semaErrors = sema.getErrors();
+    errors.insert(errors.end(), semaErrors.begin(), semaErrors.end());
+
+    if (!errors.empty()) {
+        if (emit & EMIT_C) artifacts.cCode = "// No C code generated due to errors.\n";
+        return;
+    }
+
+    artifacts.output = "Program compiled successfully.";
+    artifacts.generated = true;
+    if (!(emit & (EMIT_IR | EMIT_OPT_IR | EMIT_C | EMIT_PROGRAM))) return;
+
+    beginPhase("ir");
+    IntermediateCodeGen icg;
+    icg.generate(ast);
+    IRProgram irCode = icg.takeIR();
+    endPhase();
+    runBackEnd(std::move(irCode), emit);
+}
+
+void CompilerDriver::runIncremental(std::string_view source, unsigned emit) {
+    std::vector<std::string>& errors = artifacts.errors;
+
+    beginPhase("reparse");
+    frontend->reparse(source);
+    endPhase();
+    count("tokens", frontend->tokenCount());
+    count("statements", frontend->statementCount());
+    if (emit & EMIT_TOKENS) frontend->appendTokens(artifacts.tokens);
+
+    beginPhase("semantic");
+    frontend->analyze();
+    endPhase();
+    count("symbols", frontend->symbolCount());
+    frontend->appendErrors(errors);
+
+    if (!errors.empty()) {
+        if (emit & EMIT_C) artifacts.cCode = "// No C code generated due to errors.\n";
+    } else {
+        artifacts.output = "Program compiled successfully.";
+        artifacts.generated = true;
+        if (emit & (EMIT_IR | EMIT_OPT_IR | EMIT_C | EMIT_PROGRAM)) {
+            beginPhase("ir");
+            IRProgram irCode = frontend->lower();
+            endPhase();
+            runBackEnd(std::move(irCode), emit);
+        }
+    }
+
+    const IncrementalFrontend::Work& work = frontend->lastWork();
+    count("statements_reparsed", work.reparsed);
+    count("statements_reused", work.reused);
+    count("tokens_rescanned", work.rescannedTokens);
+    count("statements_reanalyzed", work.reanalyzed);
+    count("statements_relowered", work.relowered);
+}
+
+void CompilerDriver::runBackEnd(IRProgram irCode, unsigned emit) {
+    count("ir_instructions", irCode.code.size());
+    if (emit & EMIT_IR) appendIR(artifacts.ir, irCode);
+    if (!(emit & (EMIT_OPT_IR | EMIT_C | EMIT_PROGRAM))) return;
+
+    beginPhase("optimize");
+    Optimizer optimizer;
+    if (recording) {
+        optimizer.setPassObserver([this](const OptimizerPassEvent& event) {
+            if (!event.finished) {
+                telemetry.setCounter(std::string(event.pass) + ".instructions_before", event.instructions);
+                telemetry.beginPhase(event.pass);
+            } else {
+                telemetry.endPhase();
+                telemetry.setCounter(std::string(event.pass) + ".instructions_after", event.instructions);
+            }
+        });
+    }
+    optimizer.optimize(std::move(irCode));
+    endPhase();
+    const IRProgram& optimizedIR = optimizer.getOptimizedIR();
+    count("optimized_ir_instructions", optimizedIR.code.size());
+    if (emit & EMIT_OPT_IR) appendIR(artifacts.optimizedIR, optimizedIR);
+
+    if (emit & EMIT_C) {
+        beginPhase("codegen");
+        CodeGenerator codegen;
+        codegen.generate(optimizedIR);
+        artifacts.cCode = codegen.getCCode();
+        endPhase();
+        count("c_bytes", artifacts.cCode.size());
+    }
+    if (emit & EMIT_PROGRAM) program = optimizer.takeOptimizedIR();
+}
+
+const CompileArtifacts& CompilerDriver::getArtifacts() const {
+    return artifacts;
+}
+
+const IRProgram& CompilerDriver::getProgram() const {
+    return program;
+}
+
+static void writeToFile(const fs::path& path, const std::string& content) {
+    std::ofstream out(path);
+    if (out.is_open()) {
+        out << content;
+    }
+}
+
+static std::string joinLines(const std::vector<std::string>& lines) {
+    std::string out;
+    for (const auto& line : lines) {
+        out += line;
+        out += '\n';
+    }
+    return out;
+}
+
+static std::string errorsText(const CompileArtifacts& artifacts) {
+    if (artifacts.errors.empty()) return "No errors.\n";
+    return joinLines(artifacts.errors);
+}
+
+void writeArtifactFiles(const std::string& outputDir, const CompileArtifacts& artifacts) {
+    fs::path dir(outputDir);
+    fs::create_directories(dir);
+    unsigned emitted = artifacts.emitted;
+    if (emitted & EMIT_TOKENS) writeToFile(dir / "tokens.txt", artifacts.tokens);
+    if (emitted & EMIT_ERRORS) writeToFile(dir / "errors.txt", errorsText(artifacts));
+    if (emitted & EMIT_C) writeToFile(dir / "c_code.txt", artifacts.cCode);
+    if (emitted & EMIT_STATS) {
+        writeToFile(dir / "stats.json", artifacts.stats);
+        writeToFile(dir / "trace.json", artifacts.trace);
+    }
+    if (!artifacts.generated) return;
+    if (emitted & EMIT_IR) writeToFile(dir / "ir.txt", artifacts.ir);
+    if (emitted & EMIT_OPT_IR) writeToFile(dir / "optimized_ir.txt", artifacts.optimizedIR);
+    writeToFile(dir / "output.txt", artifacts.output);
+}
+
+// Bytes of output buffered per streamed file, and of input consumed,
+// between flushes to disk and releases of the source mapping.
+static const size_t kStreamFlushBytes = 64 * 1024;
+static const size_t kSourceReleaseBytes = 16 * 1024 * 1024;
+
+struct StreamedFile {
+    std::ofstream out;
+    std::string pending;
+
+    bool open(const fs::path& path) {
+        out.open(path);
+        return out.is_open();
+    }
+    void flush() {
+        out.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+        pending.clear();
+    }
+    void flushIfFull() {
+        if (pending.size() >= kStreamFlushBytes) flush();
+    }
+};
+
+bool CompilerDriver::compileStreaming(SourceBuffer& source, const std::string& outputDir, unsigned emit) {
+    artifacts.clear();
+    artifacts.emitted = emit;
+    program.clear();
+    astArena.reset();
+
+    fs::path dir(outputDir);
+    fs::create_directories(dir);
+    StreamedFile tokensFile, irFile, optFile;
+    std::ofstream cFile;
+    if ((emit & EMIT_TOKENS) && !tokensFile.open(dir / "tokens.txt")) return false;
+    if ((emit & EMIT_IR) && !irFile.open(dir / "ir.txt")) return false;
+    if ((emit & EMIT_OPT_IR) && !optFile.open(dir / "optimized_ir.txt")) return false;
+    if (emit & EMIT_C) {
+        cFile.open(dir / "c_code.txt");
+        if (!cFile.is_open()) return false;
+    }
+
+    // With stats, the statement loop is one phase; the stages interleave
+    // per statement, so only their totals are counted.
+    recording = (emit & EMIT_STATS) != 0;
+    if (recording) {
+        telemetry.start();
+        telemetry.beginPhase("compile_stream");
+        telemetry.setCounter("source_bytes", source.view().size());
+    }
+    uint64_t tokenCount = 0, statementCount = 0, irCount = 0, optimizedCount = 0;
+
+    std::vector<std::string> lexicalErrors;
+    Lexer lexer(source.view());
+    Parser parser(lexer, astArena, [&](const Token& token) {
+        ++tokenCount;
+        if (emit & EMIT_TOKENS) {
+            appendTokenLine(tokensFile.pending, token);
+            tokensFile.flushIfFull();
+        }
+        if (token.type == TokenType::INVALID) {
+            lexicalErrors.push_back(lexicalErrorMessage(token));
+        }
+    });
+    SemanticAnalyzer sema;
+    IntermediateCodeGen icg;
+    Optimizer optimizer;
+    CodeGenerator codegen;
+    if (emit & EMIT_C) codegen.beginStream(cFile);
+
+    // Lowering stops at the first error; the partial output is dropped below.
+    bool lowering = (emit & (EMIT_IR | EMIT_OPT_IR | EMIT_C)) != 0;
+    size_t released = 0;
+    while (Statement* stmt = parser.parseNext()) {
+        ++statementCount;
+        sema.analyzeNext(stmt);
+        lowering = lowering && lexicalErrors.empty() && parser.getErrors().empty() && sema.getErrors().empty();
+        if (lowering) {
+            icg.generateNext(stmt);
+            IRProgram& fragment = icg.getIR();
+            irCount += fragment.code.size();
+            if (emit & EMIT_IR) {
+                appendIR(irFile.pending, fragment);
+                irFile.flushIfFull();
+            }
+            if (emit & (EMIT_OPT_IR | EMIT_C)) {
+                optimizer.optimizeFragment(fragment);
+                optimizedCount += fragment.code.size();
+                if (emit & EMIT_OPT_IR) {
+                    appendIR(optFile.pending, fragment);
+                    optFile.flushIfFull();
+                }
+                if (emit & EMIT_C) codegen.emitFragment(fragment);
+            }
+        }
+        astArena.reset();
+        if (lexer.offset() - released >= kSourceReleaseBytes) {
+            released = lexer.offset();
+            source.release(released);
+        }
+    }
+    tokensFile.flush();
+
+    std::vector<std::string>& errors = artifacts.errors;
+    errors = std::move(lexicalErrors);
+    const auto& parseErrors = parser.getErrors();
+    errors.insert(errors.end(), parseErrors.begin(), parseErrors.end());
+    const auto& semaErrors = sema.getErrors();
+    errors.insert(errors.end(), semaErrors.begin(), semaErrors.end());
+    if (emit & EMIT_ERRORS) writeToFile(dir / "errors.txt", errorsText(artifacts));
+
+    if (!errors.empty()) {
+        irFile.out.close();
+        optFile.out.close();
+        std::error_code ec;
+        if (emit & EMIT_IR) fs::remove(dir / "ir.txt", ec);
+        if (emit & EMIT_OPT_IR) fs::remove(dir / "optimized_ir.txt", ec);
+        if (emit & EMIT_C) {
+            cFile.close();
+            writeToFile(dir / "c_code.txt", "// No C code generated due to errors.\n");
+        }
+    } else {
+        irFile.flush();
+        optFile.flush();
+        if (emit & EMIT_C) {
+            codegen.endStream();
+            count("c_bytes", static_cast<uint64_t>(cFile.tellp()));
+        }
+        artifacts.output = "Program compiled successfully.";
+        artifacts.generated = true;
+        writeToFile(dir / "output.txt", artifacts.output);
+    }
+
+    if (recording) {
+        count("tokens", tokenCount);
+        count("statements", statementCount);
+        count("ast_nodes", parser.getNodeCount());
+        count("symbols", sema.getSymbolCount());
+        count("ir_instructions", irCount);
+        count("optimized_ir_instructions", optimizedCount);
+        count("errors", errors.size());
+        finishStats();
+        writeToFile(dir / "stats.json", artifacts.stats);
+        writeToFile(dir / "trace.json", artifacts.trace);
+    }
+    return true;
+}
+
+void appendSection(std::string& out, std::string_view name, std::string_view body) {
+    out.append(name.data(), name.size());
+    out += ' ';
+    out += std::to_string(body.size());
+    out += '\n';
+    out.append(body.data(), body.size());
+}
+
+void appendArtifactSections(std::string& out, const CompileArtifacts& artifacts) {
+    unsigned emitted = artifacts.emitted;
+    unsigned count = 1;
+    for (unsigned bit = EMIT_TOKENS; bit <= EMIT_C; bit <<= 1) {
+        if (emitted & bit) ++count;
+    }
+    if (emitted & EMIT_STATS) count += 2;
+    out += "CODEPIE ";
+    out += std::to_string(count);
+    out += '\n';
+    if (emitted & EMIT_TOKENS) appendSection(out, "tokens", artifacts.tokens);
+    if (emitted & EMIT_ERRORS) appendSection(out, "errors", errorsText(artifacts));
+    if (emitted & EMIT_IR) appendSection(out, "ir", artifacts.ir);
+    if (emitted & EMIT_OPT_IR) appendSection(out, "optimized_ir", artifacts.optimizedIR);
+    if (emitted & EMIT_C) appendSection(out, "c_code", artifacts.cCode);
+    if (emitted & EMIT_STATS) {
+        appendSection(out, "stats", artifacts.stats);
+        appendSection(out, "trace", artifacts.trace);
+    }
+    appendSection(out, "output", artifacts.output);
+}
@@ -0,0 +1,989 @@
+#include "ElfWriter.h"
+#include "Bytecode.h"
+#include "X64CodeGen.h"
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+// The file is mapped at kBaseAddress from offset 0, headers included, and
+// the code starts at kCodeOffset.
+const uint64_t kBaseAddress = 0x400000;
+const size_t kCodeOffset = 256;
+const size_t kPageSize = 4096;
+const size_t kBufferSize = 4096;
+
+// The writable segment: output length and file descriptor, input position,
+// length and end-of-file flag, the two buffers, then the frame.
+const int32_t kOutLength = 0;
+const int32_t kOutFd = 8;
+const int32_t kInPosition = 16;
+const int32_t kInLength = 24;
+const int32_t kInEof = 32;
+const int32_t kOutBuffer = 64;
+const int32_t kInBuffer = kOutBuffer + kBufferSize;
+const int32_t kFrame = kInBuffer + kBufferSize;
+
+// Fields of the writable segment, as labels.
+enum : int { OUT_LENGTH, OUT_FD, IN_POSITION, IN_LENGTH, IN_EOF, OUT_BUFFER, IN_BUFFER, FRAME, FIELD_COUNT };
+
+const int XMM0 = 0;
+const int kPow10Count = 23;
+const int kSysRead = 0;
+const int kSysWrite = 1;
+const int kSysExitGroup = 231;
+
+// The runtime the translated code calls, emitted after it. Routines follow
+// the System V convention: they may change rax, rcx, rdx, rsi, rdi, r8-r11
+// and the XMM registers, and keep the rest. The put_* routines also keep
+// r10, which out_double counts with across them.
+class RuntimeEmitter {
+public:
+    RuntimeEmitter(X64Translator& translator, const Bytecode& program)
+        : as(translator.as), translator(translator), program(program) {}
+
+    // Emits the runtime and the data it reads; returns the entry point.
+    size_t emit();
+    // Places the writable segment at `position`, relative to the code.
+    void bindData(size_t position);
+
+private:
+    X64Assembler& as;
+    X64Translator& translator;
+    const Bytecode& program;
+
+    int bss[FIELD_COUNT];
+    int flush, putByte, putBytes, putU64, writeText, peek, advance, readDouble;
+    int textTable, formatTable, nameTable, pow10;
+    std::vector<std::pair<int, std::string>> literals;
+
+    Loc data(int field) const { return {Loc::LABEL, bss[field]}; }
+    Loc label(int l) const { return {Loc::LABEL, l}; }
+
+    void mov(int dst, int src) { as.modrm(0, true, 0x8B, dst, inReg(src)); }
+    void load(int dst, const Loc& src) { as.modrm(0, true, 0x8B, dst, src); }
+    void store(const Loc& dst, int src) { as.modrm(0, true, 0x89, src, dst); }
+    void lea(int dst, const Loc& src) { as.modrm(0, true, 0x8D, dst, src); }
+    // Two-register ALU op: 0x03 add, 0x0B or, 0x23 and, 0x2B sub, 0x33
+    // xor, 0x3B cmp, 0x85 test.
+    void alu(uint32_t opcode, int dst, int src, bool wide = true) { as.modrm(0, wide, opcode, dst, inReg(src)); }
+    void aluImm(int ext, int reg, int32_t imm, bool wide = true) { as.aluImm(ext, inReg(reg), imm, wide); }
+    void zero(int reg) { as.modrm(0, false, 0x33, reg, inReg(reg)); }
+    // Shift `ext` (4 shl, 5 shr) by `count`, or by cl when it is negative.
+    void shift(int ext, int reg, int count, bool wide = true) {
+        as.modrm(0, wide, count < 0 ? 0xD3 : 0xC1, ext, inReg(reg));
+        if (count >= 0) as.byte(count);
+    }
+    // F7 group: 3 neg, 4 mul, 6 div; FF group: 0 inc, 1 dec.
+    void unary(int ext, int reg, bool wide = true) { as.modrm(0, wide, 0xF7, ext, inReg(reg)); }
+    void step(int ext, int reg, bool wide = true) { as.modrm(0, wide, 0xFF, ext, inReg(reg)); }
+    void movImm64(int reg, uint64_t value) {
+        as.byte(0x48 | (reg >> 3));
+        as.byte(0xB8 + (reg & 7));
+        as.qword(value);
+    }
+    void call(int l) { as.callLabel(l); }
+    void jump(int cc, int l) { as.jumpTo(cc, l); }
+    void ret() { as.byte(0xC3); }
+    void syscall() {
+        as.byte(0x0F);
+        as.byte(0x05);
+    }
+    int literal(const std::string& text) {
+        int l = as.newLabel();
+        literals.push_back({l, text});
+        return l;
+    }
+    // Buffers a literal string; changes what put_bytes does.
+    void putLiteral(const std::string& text) {
+        lea(RSI, label(literal(text)));
+        as.movImm(RDX, static_cast<uint32_t>(text.size()));
+        call(putBytes);
+    }
+    // Jumps to `mismatch` unless the next input character is `c`, in
+    // either case, and consumes it if it is.
+    void expectChar(char c, int mismatch) {
+        call(peek);
+        aluImm(1, RAX, 0x20, false);
+        aluImm(7, RAX, c, false);
+        jump(CC_NE, mismatch);
+        call(advance);
+    }
+
+    void emitStart();
+    void emitOutputBuffer();
+    void emitOutputs();
+    void emitOutputDouble();
+    void emitInput();
+    void emitReadDouble();
+    void emitData();
+    void emitTable(int table, const std::vector<std::string>& strings);
+};
+
+size_t RuntimeEmitter::emit() {
+    for (int& l : bss) l = as.newLabel();
+    flush = as.newLabel();
+    putByte = as.newLabel();
+    putBytes = as.newLabel();
+    putU64 = as.newLabel();
+    writeText = as.newLabel();
+    peek = as.newLabel();
+    advance = as.newLabel();
+    readDouble = as.newLabel();
+    textTable = as.newLabel();
+    formatTable = as.newLabel();
+    nameTable = as.newLabel();
+    pow10 = as.newLabel();
+
+    size_t entry = as.here();
+    emitStart();
+    emitOutputBuffer();
+    emitOutputs();
+    emitOutputDouble();
+    emitInput();
+    emitReadDouble();
+    emitData();
+    return entry;
+}
+
+void RuntimeEmitter::bindData(size_t position) {
+    static const int32_t kFields[] = {kOutLength, kOutFd, kInPosition, kInLength,
+                                      kInEof,     kOutBuffer, kInBuffer, kFrame};
+    for (int k = 0; k < FIELD_COUNT; ++k) as.bindAt(bss[k], position + kFields[k]);
+}
+
+// _start: runs the program on the zeroed frame, flushes its output and
+// exits, after printing an error like --run's if it stopped on one.
+void RuntimeEmitter::emitStart() {
+    as.movImm(RAX, 1);
+    store(data(OUT_FD), RAX);
+    int program = as.newLabel();
+    as.bindAt(program, 0);
+    lea(RDI, data(FRAME));
+    mov(RSI, RDI);
+    call(program);
+    alu(0x8B, RBX, RAX, false);
+    call(flush);
+
+    int exitOk = as.newLabel(), overflow = as.newLabel(), failed = as.newLabel(), exit = as.newLabel();
+    alu(0x85, RBX, RBX, false);
+    jump(CC_E, exitOk);
+    as.movImm(RAX, 2);
+    store(data(OUT_FD), RAX);
+    putLiteral("Line ");
+    alu(0x8B, RAX, RBX, false);
+    shift(5, RAX, 2, false);
+    as.movImm(RCX, 1);
+    call(putU64);
+    alu(0x8B, RAX, RBX, false);
+    aluImm(4, RAX, 3, false);
+    aluImm(7, RAX, static_cast<int32_t>(kX64DivisionByZero), false);
+    jump(CC_NE, overflow);
+    putLiteral(": Integer division by zero.\n");
+    jump(-1, failed);
+    as.bind(overflow);
+    putLiteral(": Integer overflow in division.\n");
+    as.bind(failed);
+    call(flush);
+    as.movImm(RDI, 1);
+    jump(-1, exit);
+    as.bind(exitOk);
+    zero(RDI);
+    as.bind(exit);
+    as.movImm(RAX, kSysExitGroup);
+    syscall();
+}
+
+void RuntimeEmitter::emitOutputBuffer() {
+    // flush: writes out the buffer; write errors drop what is left.
+    {
+        int loop = as.newLabel(), done = as.newLabel();
+        as.bind(flush);
+        load(RDX, data(OUT_LENGTH));
+        lea(RSI, data(OUT_BUFFER));
+        as.bind(loop);
+        alu(0x85, RDX, RDX);
+        jump(CC_E, done);
+        load(RDI, data(OUT_FD));
+        as.movImm(RAX, kSysWrite);
+        syscall();
+        aluImm(7, RAX, -4);
+        jump(CC_E, loop);
+        alu(0x85, RAX, RAX);
+        jump(CC_LE, done);
+        alu(0x03, RSI, RAX);
+        alu(0x2B, RDX, RAX);
+        jump(-1, loop);
+        as.bind(done);
+        zero(RAX);
+        store(data(OUT_LENGTH), RAX);
+        ret();
+    }
+
+    // put_byte: buffers the byte in edi.
+    {
+        int room = as.newLabel();
+        as.bind(putByte);
+        load(RAX, data(OUT_LENGTH));
+        aluImm(7, RAX, static_cast<int32_t>(kBufferSize));
+        jump(CC_B, room);
+        as.push(RDI);
+        call(flush);
+        as.pop(RDI);
+        zero(RAX);
+        as.bind(room);
+        lea(RCX, data(OUT_BUFFER));
+        alu(0x03, RCX, RAX);
+        alu(0x8B, RDX, RDI, false);
+        as.modrm(0, false, 0x88, RDX, inMemory(RCX, 0));
+        step(0, RAX);
+        store(data(OUT_LENGTH), RAX);
+        ret();
+    }
+
+    // put_bytes: buffers rdx bytes from rsi.
+    {
+        int loop = as.newLabel(), room = as.newLabel(), fits = as.newLabel(), done = as.newLabel();
+        as.bind(putBytes);
+        as.bind(loop);
+        alu(0x85, RDX, RDX);
+        jump(CC_E, done);
+        load(RAX, data(OUT_LENGTH));
+        as.movImm(RCX, static_cast<uint32_t>(kBufferSize));
+        alu(0x2B, RCX, RAX);
+        jump(CC_NE, room);
+        as.push(RSI);
+        as.push(RDX);
+        call(flush);
+        as.pop(RDX);
+        as.pop(RSI);
+        jump(-1, loop);
+        as.bind(room);
+        alu(0x3B, RCX, RDX);
+        jump(CC_BE, fits);
+        mov(RCX, RDX);
+        as.bind(fits);
+        alu(0x2B, RDX, RCX);
+        lea(RDI, data(OUT_BUFFER));
+        alu(0x03, RDI, RAX);
+        alu(0x03, RAX, RCX);
+        store(data(OUT_LENGTH), RAX);
+        as.byte(0xF3);
+        as.byte(0xA4);
+        jump(-1, loop);
+        as.bind(done);
+        ret();
+    }
+
+    // put_u64: buffers rax in decimal, zero padded to at least ecx digits.
+    {
+        int loop = as.newLabel();
+        as.bind(putU64);
+        aluImm(5, RSP, 40);
+        lea(RSI, inMemory(RSP, 32));
+        as.movImm(R9, 10);
+        as.bind(loop);
+        zero(RDX);
+        unary(6, R9);
+        aluImm(0, RDX, '0', false);
+        step(1, RSI);
+        as.modrm(0, false, 0x88, RDX, inMemory(RSI, 0));
+        step(1, RCX, false);
+        alu(0x85, RAX, RAX);
+        jump(CC_NE, loop);
+        alu(0x85, RCX, RCX, false);
+        jump(CC_G, loop);
+        lea(RDX, inMemory(RSP, 32));
+        alu(0x2B, RDX, RSI);
+        call(putBytes);
+        aluImm(0, RSP, 40);
+        ret();
+    }
+
+    // write_text: buffers string ecx of the table at rsi, whose entries
+    // are a 32-bit offset from the table and a 32-bit length.
+    as.bind(writeText);
+    alu(0x8B, RCX, RCX, false);
+    shift(4, RCX, 3);
+    alu(0x03, RCX, RSI);
+    as.modrm(0, false, 0x8B, RAX, inMemory(RCX, 0));
+    as.modrm(0, false, 0x8B, RDX, inMemory(RCX, 4));
+    alu(0x03, RSI, RAX);
+    jump(-1, putBytes);
+}
+
+// OUTPUT of ints, strings and formats: printf's "%d\n", "%s\n" and the
+// format's own text.
+void RuntimeEmitter::emitOutputs() {
+    int positive = as.newLabel();
+    as.bind(translator.routineLabels[ROUTINE_OUTPUT_INT]);
+    as.modrm(0, true, 0x63, RAX, inReg(RSI));
+    alu(0x85, RAX, RAX);
+    jump(CC_NS, positive);
+    as.push(RAX);
+    as.movImm(RDI, '-');
+    call(putByte);
+    as.pop(RAX);
+    unary(3, RAX);
+    as.bind(positive);
+    as.movImm(RCX, 1);
+    call(putU64);
+    as.movImm(RDI, '\n');
+    jump(-1, putByte);
+
+    as.bind(translator.routineLabels[ROUTINE_OUTPUT_STRING]);
+    alu(0x8B, RCX, RSI, false);
+    lea(RSI, label(textTable));
+    call(writeText);
+    as.movImm(RDI, '\n');
+    jump(-1, putByte);
+
+    as.bind(translator.routineLabels[ROUTINE_OUTPUT_FORMAT]);
+    alu(0x8B, RCX, RSI, false);
+    lea(RSI, label(formatTable));
+    jump(-1, writeText);
+}
+
+// OUTPUT of a double, as "%lf\n": the exact binary value rounded half to
+// even at six decimals. Integral values (exponent >= 0) are divided down
+// in 19-digit chunks from a 1152-bit integer; the rest are m / 2^k with
+// k <= 1074, where m * 10^6 fits 128 bits, and k > 73 rounds to zero.
+void RuntimeEmitter::emitOutputDouble() {
+    int positive = as.newLabel(), finite = as.newLabel(), normal = as.newLabel(), scaled = as.newLabel();
+    int special = as.newLabel(), fraction = as.newLabel();
+    as.bind(translator.routineLabels[ROUTINE_OUTPUT_DOUBLE]);
+    as.modrm(0x66, true, 0x0F7E, XMM0, inReg(RAX));
+    alu(0x85, RAX, RAX);
+    jump(CC_NS, positive);
+    as.push(RAX);
+    as.movImm(RDI, '-');
+    call(putByte);
+    as.pop(RAX);
+    shift(4, RAX, 1);
+    shift(5, RAX, 1);
+    as.bind(positive);
+    mov(RDX, RAX);
+    shift(5, RDX, 52);
+    movImm64(RCX, (uint64_t(1) << 52) - 1);
+    alu(0x23, RAX, RCX);
+    aluImm(7, RDX, 0x7FF, false);
+    jump(CC_NE, finite);
+    alu(0x85, RAX, RAX);
+    lea(RSI, label(literal("inf\n")));
+    jump(CC_E, special);
+    lea(RSI, label(literal("nan\n")));
+    as.bind(special);
+    as.movImm(RDX, 4);
+    jump(-1, putBytes);
+
+    as.bind(finite);
+    alu(0x85, RDX, RDX, false);
+    jump(CC_NE, normal);
+    as.movImm(RDX, 1);
+    jump(-1, scaled);
+    as.bind(normal);
+    step(0, RCX);
+    alu(0x0B, RAX, RCX);
+    as.bind(scaled);
+    aluImm(5, RDX, 1075, false);
+    jump(CC_S, fraction);
+
+    // Integral: limbs at [rsp], little end first, chunks from [rsp + 144].
+    {
+        int clear = as.newLabel(), top = as.newLabel(), divide = as.newLabel(), trim = as.newLabel();
+        int divideLimb = as.newLabel(), divideLoop = as.newLabel(), print = as.newLabel();
+        int more = as.newLabel(), done = as.newLabel();
+        const int32_t limbs = 18, chunks = limbs * 8, frame = chunks + 17 * 8 + 16;
+        alu(0x8B, RCX, RDX, false);
+        aluImm(5, RSP, frame);
+        zero(RDX);
+        mov(RDI, RSP);
+        as.movImm(R8, limbs);
+        as.bind(clear);
+        store(inMemory(RDI, 0), RDX);
+        aluImm(0, RDI, 8);
+        step(1, R8, false);
+        jump(CC_NE, clear);
+
+        alu(0x8B, RDX, RCX, false);
+        shift(5, RDX, 6, false);
+        shift(4, RDX, 3, false);
+        mov(RDI, RSP);
+        alu(0x03, RDI, RDX);
+        aluImm(4, RCX, 63, false);
+        mov(RSI, RAX);
+        shift(4, RSI, -1);
+        store(inMemory(RDI, 0), RSI);
+        lea(R10, inMemory(RDI, 8));
+        alu(0x85, RCX, RCX, false);
+        jump(CC_E, top);
+        unary(3, RCX, false);
+        mov(RSI, RAX);
+        shift(5, RSI, -1);
+        store(inMemory(RDI, 8), RSI);
+        lea(R10, inMemory(RDI, 16));
+        as.bind(top);
+        movImm64(R9, 10000000000000000000ull);
+        lea(R8, inMemory(RSP, chunks));
+
+        // Divides by 10^19 until nothing is left, r10 past the top limb.
+        as.bind(divide);
+        as.bind(trim);
+        alu(0x3B, R10, RSP);
+        jump(CC_E, print);
+        as.aluImm(7, inMemory(R10, -8), 0, true);
+        jump(CC_NE, divideLimb);
+        aluImm(5, R10, 8);
+        jump(-1, trim);
+        as.bind(divideLimb);
+        zero(RDX);
+        mov(RDI, R10);
+        as.bind(divideLoop);
+        aluImm(5, RDI, 8);
+        load(RAX, inMemory(RDI, 0));
+        unary(6, R9);
+        store(inMemory(RDI, 0), RAX);
+        alu(0x3B, RDI, RSP);
+        jump(CC_NE, divideLoop);
+        store(inMemory(R8, 0), RDX);
+        aluImm(0, R8, 8);
+        jump(-1, divide);
+
+        as.bind(print);
+        mov(R10, R8);
+        aluImm(5, R10, 8);
+        load(RAX, inMemory(R10, 0));
+        as.movImm(RCX, 1);
+        call(putU64);
+        as.bind(more);
+        lea(RAX, inMemory(RSP, chunks));
+        alu(0x3B, R10, RAX);
+        jump(CC_E, done);
+        aluImm(5, R10, 8);
+        load(RAX, inMemory(R10, 0));
+        as.movImm(RCX, 19);
+        call(putU64);
+        jump(-1, more);
+        as.bind(done);
+        aluImm(0, RSP, frame);
+        putLiteral(".000000\n");
+        ret();
+    }
+
+    // Fractional: q = m * 10^6 / 2^k, first shifted one bit less to keep
+    // the halfway bit, with any lower bits or'ed into rsi.
+    {
+        int zeroValue = as.newLabel(), small = as.newLabel(), round = as.newLabel(), up = as.newLabel();
+        int split = as.newLabel();
+        as.bind(fraction);
+        unary(3, RDX, false);
+        alu(0x8B, RCX, RDX, false);
+        aluImm(7, RCX, 73, false);
+        jump(CC_A, zeroValue);
+        as.movImm(R9, 1000000);
+        unary(4, R9);
+        step(1, RCX, false);
+        aluImm(7, RCX, 64, false);
+        jump(CC_B, small);
+        aluImm(5, RCX, 64, false);
+        as.movImm(RSI, 1);
+        shift(4, RSI, -1);
+        step(1, RSI);
+        alu(0x23, RSI, RDX);
+        alu(0x0B, RSI, RAX);
+        mov(RAX, RDX);
+        shift(5, RAX, -1);
+        zero(RDX);
+        jump(-1, round);
+        as.bind(small);
+        as.movImm(RSI, 1);
+        shift(4, RSI, -1);
+        step(1, RSI);
+        alu(0x23, RSI, RAX);
+        as.modrm(0, true, 0x0FAD, RDX, inReg(RAX));
+        shift(5, RDX, -1);
+
+        as.bind(round);
+        alu(0x8B, RDI, RAX, false);
+        as.modrm(0, true, 0x0FAC, RDX, inReg(RAX));
+        as.byte(1);
+        shift(5, RDX, 1);
+        aluImm(4, RDI, 1, false);
+        jump(CC_E, split);
+        alu(0x85, RSI, RSI);
+        jump(CC_NE, up);
+        alu(0x8B, RDI, RAX, false);
+        aluImm(4, RDI, 1, false);
+        jump(CC_E, split);
+        as.bind(up);
+        aluImm(0, RAX, 1);
+        aluImm(2, RDX, 0);
+
+        as.bind(split);
+        unary(6, R9);
+        as.push(RDX);
+        as.movImm(RCX, 1);
+        call(putU64);
+        as.movImm(RDI, '.');
+        call(putByte);
+        as.pop(RAX);
+        as.movImm(RCX, 6);
+        call(putU64);
+        as.movImm(RDI, '\n');
+        jump(-1, putByte);
+
+        as.bind(zeroValue);
+        putLiteral("0.000000\n");
+        ret();
+    }
+}
+
+// INPUT: prompts as the C does, flushes, and stores what scanf's %lf
+// reads, converted to the variable's type; a failed read changes nothing.
+void RuntimeEmitter::emitInput() {
+    int done = as.newLabel(), notInt = as.newLabel(), isString = as.newLabel();
+    as.bind(translator.routineLabels[ROUTINE_INPUT]);
+    as.push(RBX);
+    as.push(R12);
+    as.push(R13);
+    alu(0x8B, R13, RSI, false);
+    mov(RBX, RDX);
+    alu(0x8B, R12, RCX, false);
+    putLiteral("Enter value for ");
+    alu(0x8B, RCX, R13, false);
+    lea(RSI, label(nameTable));
+    call(writeText);
+    putLiteral(": ");
+    call(flush);
+    call(readDouble);
+    alu(0x85, RAX, RAX, false);
+    jump(CC_E, done);
+    aluImm(7, R12, INPUT_INT, false);
+    jump(CC_NE, notInt);
+    as.modrm(0xF2, false, 0x0F2C, RAX, inReg(XMM0));
+    as.modrm(0, false, 0x89, RAX, inMemory(RBX, 0));
+    jump(-1, done);
+    as.bind(notInt);
+    aluImm(7, R12, INPUT_DOUBLE, false);
+    jump(CC_NE, isString);
+    as.modrm(0xF2, false, 0x0F11, XMM0, inMemory(RBX, 0));
+    jump(-1, done);
+    as.bind(isString);
+    zero(RAX);
+    store(inMemory(RBX, 0), RAX);
+    as.bind(done);
+    as.pop(R13);
+    as.pop(R12);
+    as.pop(RBX);
+    ret();
+}
+
+// read_double: scanf's %lf on buffered stdin, eax = 1 and the value in
+// xmm0, or eax = 0. Up to 18 significant digits are kept and scaled by
+// powers of ten, which is exact whenever both fit a double exactly.
+void RuntimeEmitter::emitReadDouble() {
+    // peek: the next input character in eax, or -1 at end of input.
+    {
+        int have = as.newLabel(), refill = as.newLabel(), atEof = as.newLabel(), eof = as.newLabel();
+        as.bind(peek);
+        load(RAX, data(IN_POSITION));
+        load(RCX, data(IN_LENGTH));
+        alu(0x3B, RAX, RCX);
+        jump(CC_B, have);
+        load(RAX, data(IN_EOF));
+        alu(0x85, RAX, RAX);
+        jump(CC_NE, eof);
+        as.bind(refill);
+        zero(RDI);
+        lea(RSI, data(IN_BUFFER));
+        as.movImm(RDX, static_cast<uint32_t>(kBufferSize));
+        as.movImm(RAX, kSysRead);
+        syscall();
+        aluImm(7, RAX, -4);
+        jump(CC_E, refill);
+        alu(0x85, RAX, RAX);
+        jump(CC_LE, atEof);
+        store(data(IN_LENGTH), RAX);
+        zero(RAX);
+        store(data(IN_POSITION), RAX);
+        as.bind(have);
+        lea(RCX, data(IN_BUFFER));
+        alu(0x03, RCX, RAX);
+        as.modrm(0, false, 0x0FB6, RAX, inMemory(RCX, 0));
+        ret();
+        as.bind(atEof);
+        as.movImm(RAX, 1);
+        store(data(IN_EOF), RAX);
+        as.bind(eof);
+        as.movImm(RAX, UINT32_MAX);
+        ret();
+
+        as.bind(advance);
+        load(RAX, data(IN_POSITION));
+        step(0, RAX);
+        store(data(IN_POSITION), RAX);
+        ret();
+    }
+
+    // r12 digits, r13d how many, r14d the power of ten they are scaled by,
+    // r15d the sign, ebp whether any digit was seen, then the exponent's
+    // sign, and ebx the exponent.
+    static const int kSaved[] = {RBX, RBP, R12, R13, R14, R15};
+    int skip = as.newLabel(), space = as.newLabel(), plus = as.newLabel(), sign = as.newLabel();
+    int body = as.newLabel(), infinity = as.newLabel(), nan = as.newLabel(), intDigits = as.newLabel();
+    int accumulate = as.newLabel(), dropped = as.newLabel(), nextInt = as.newLabel(), afterInt = as.newLabel();
+    int fracDigits = as.newLabel(), accumulateFrac = as.newLabel(), zeroFrac = as.newLabel();
+    int nextFrac = as.newLabel(), exponent = as.newLabel(), expPlus = as.newLabel(), expSigned = as.newLabel();
+    int expDigits = as.newLabel(), expNext = as.newLabel(), expEnd = as.newLabel(), expAdd = as.newLabel();
+    int scale = as.newLabel(), divide = as.newLabel(), extended = as.newLabel(), extendedDivide = as.newLabel();
+    int mulLoop = as.newLabel(), lastMul = as.newLabel(), divLoop = as.newLabel(), lastDiv = as.newLabel();
+    int rounded = as.newLabel(), negate = as.newLabel(), ok = as.newLabel(), fail = as.newLabel(), out = as.newLabel();
+
+    as.bind(readDouble);
+    for (int r : kSaved) as.push(r);
+    as.bind(skip);
+    call(peek);
+    aluImm(7, RAX, ' ', false);
+    jump(CC_E, space);
+    lea(RCX, inMemory(RAX, -'\t'));
+    aluImm(7, RCX, '\r' - '\t', false);
+    jump(CC_A, sign);
+    as.bind(space);
+    call(advance);
+    jump(-1, skip);
+
+    as.bind(sign);
+    zero(R15);
+    aluImm(7, RAX, '-', false);
+    jump(CC_NE, plus);
+    as.movImm(R15, 1);
+    call(advance);
+    call(peek);
+    jump(-1, body);
+    as.bind(plus);
+    aluImm(7, RAX, '+', false);
+    jump(CC_NE, body);
+    call(advance);
+    call(peek);
+
+    as.bind(body);
+    alu(0x8B, RCX, RAX, false);
+    aluImm(1, RCX, 0x20, false);
+    aluImm(7, RCX, 'i', false);
+    jump(CC_E, infinity);
+    aluImm(7, RCX, 'n', false);
+    jump(CC_E, nan);
+    zero(R12);
+    zero(R13);
+    zero(R14);
+    zero(RBP);
+
+    as.bind(intDigits);
+    call(peek);
+    aluImm(5, RAX, '0', false);
+    aluImm(7, RAX, 9, false);
+    jump(CC_A, afterInt);
+    as.movImm(RBP, 1);
+    alu(0x85, R12, R12);
+    jump(CC_NE, accumulate);
+    alu(0x85, RAX, RAX, false);
+    jump(CC_E, nextInt);
+    as.bind(accumulate);
+    aluImm(7, R13, 18, false);
+    jump(CC_AE, dropped);
+    as.modrm(0, true, 0x6B, R12, inReg(R12));
+    as.byte(10);
+    alu(0x03, R12, RAX);
+    step(0, R13, false);
+    jump(-1, nextInt);
+    as.bind(dropped);
+    step(0, R14, false);
+    as.bind(nextInt);
+    call(advance);
+    jump(-1, intDigits);
+
+    as.bind(afterInt);
+    aluImm(7, RAX, '.' - '0', false);
+    jump(CC_NE, exponent);
+    call(advance);
+    as.bind(fracDigits);
+    call(peek);
+    aluImm(5, RAX, '0', false);
+    aluImm(7, RAX, 9, false);
+    jump(CC_A, exponent);
+    as.movImm(RBP, 1);
+    aluImm(7, R13, 18, false);
+    jump(CC_AE, nextFrac);
+    alu(0x85, R12, R12);
+    jump(CC_NE, accumulateFrac);
+    alu(0x85, RAX, RAX, false);
+    jump(CC_E, zeroFrac);
+    as.bind(accumulateFrac);
+    as.modrm(0, true, 0x6B, R12, inReg(R12));
+    as.byte(10);
+    alu(0x03, R12, RAX);
+    step(0, R13, false);
+    as.bind(zeroFrac);
+    step(1, R14, false);
+    as.bind(nextFrac);
+    call(advance);
+    jump(-1, fracDigits);
+
+    // An 'e' with no digits after it ends the number, as in glibc.
+    as.bind(exponent);
+    alu(0x85, RBP, RBP, false);
+    jump(CC_E, fail);
+    aluImm(0, RAX, '0', false);
+    aluImm(1, RAX, 0x20, false);
+    aluImm(7, RAX, 'e', false);
+    jump(CC_NE, scale);
+    call(advance);
+    call(peek);
+    zero(RBX);
+    zero(RBP);
+    aluImm(7, RAX, '-', false);
+    jump(CC_NE, expPlus);
+    as.movImm(RBP, 1);
+    jump(-1, expSigned);
+    as.bind(expPlus);
+    aluImm(7, RAX, '+', false);
+    jump(CC_NE, expDigits);
+    as.bind(expSigned);
+    call(advance);
+    as.bind(expDigits);
+    call(peek);
+    aluImm(5, RAX, '0', false);
+    aluImm(7, RAX, 9, false);
+    jump(CC_A, expEnd);
+    aluImm(7, RBX, 100000, false);
+    jump(CC_AE, expNext);
+    as.modrm(0, false, 0x6B, RBX, inReg(RBX));
+    as.byte(10);
+    alu(0x03, RBX, RAX, false);
+    as.bind(expNext);
+    call(advance);
+    jump(-1, expDigits);
+    as.bind(expEnd);
+    alu(0x85, RBP, RBP, false);
+    jump(CC_E, expAdd);
+    unary(3, RBX, false);
+    as.bind(expAdd);
+    alu(0x03, R14, RBX, false);
+
+    // Digits and a power of ten that are both exact doubles give the
+    // correctly rounded result in one SSE multiply or divide. Anything else
+    // is scaled by up to 10^22 at a time in x87 extended precision (fild,
+    // fmul DC /1 or fdiv DC /6, fstp), then rounded once to a double.
+    auto tableEntry = [&]() {
+        as.modrm(0, true, 0x63, RAX, inReg(R14));
+        shift(4, RAX, 3);
+        alu(0x03, RAX, RCX);
+    };
+    as.bind(scale);
+    lea(RCX, label(pow10));
+    movImm64(RAX, uint64_t(1) << 53);
+    alu(0x3B, R12, RAX);
+    jump(CC_A, extended);
+    lea(RAX, inMemory(R14, kPow10Count - 1));
+    aluImm(7, RAX, 2 * (kPow10Count - 1), false);
+    jump(CC_A, extended);
+    as.modrm(0xF2, true, 0x0F2A, XMM0, inReg(R12));
+    alu(0x85, R14, R14, false);
+    jump(CC_S, divide);
+    tableEntry();
+    as.modrm(0xF2, false, 0x0F59, XMM0, inMemory(RAX, 0));
+    jump(-1, negate);
+    as.bind(divide);
+    unary(3, R14, false);
+    tableEntry();
+    as.modrm(0xF2, false, 0x0F5E, XMM0, inMemory(RAX, 0));
+    jump(-1, negate);
+
+    as.bind(extended);
+    as.push(R12);
+    as.modrm(0, false, 0xDF, 5, inMemory(RSP, 0));
+    alu(0x85, R14, R14, false);
+    jump(CC_S, extendedDivide);
+    as.bind(mulLoop);
+    aluImm(7, R14, kPow10Count - 1, false);
+    jump(CC_LE, lastMul);
+    as.modrm(0, false, 0xDC, 1, inMemory(RCX, 8 * (kPow10Count - 1)));
+    aluImm(5, R14, kPow10Count - 1, false);
+    jump(-1, mulLoop);
+    as.bind(lastMul);
+    tableEntry();
+    as.modrm(0, false, 0xDC, 1, inMemory(RAX, 0));
+    jump(-1, rounded);
+    as.bind(extendedDivide);
+    unary(3, R14, false);
+    as.bind(divLoop);
+    aluImm(7, R14, kPow10Count - 1, false);
+    jump(CC_LE, lastDiv);
+    as.modrm(0, false, 0xDC, 6, inMemory(RCX, 8 * (kPow10Count - 1)));
+    aluImm(5, R14, kPow10Count - 1, false);
+    jump(-1, divLoop);
+    as.bind(lastDiv);
+    tableEntry();
+    as.modrm(0, false, 0xDC, 6, inMemory(RAX, 0));
+    as.bind(rounded);
+    as.modrm(0, false, 0xDD, 3, inMemory(RSP, 0));
+    as.modrm(0xF2, false, 0x0F10, XMM0, inMemory(RSP, 0));
+    as.pop(RAX);
+    jump(-1, negate);
+
+    // inf, infinity and nan, in any case.
+    as.bind(infinity);
+    call(advance);
+    expectChar('n', fail);
+    expectChar('f', fail);
+    movImm64(RAX, 0x7FF0000000000000ull);
+    as.modrm(0x66, true, 0x0F6E, XMM0, inReg(RAX));
+    call(peek);
+    aluImm(1, RAX, 0x20, false);
+    aluImm(7, RAX, 'i', false);
+    jump(CC_NE, negate);
+    call(advance);
+    for (const char* c = "nity"; *c; ++c) expectChar(*c, fail);
+    jump(-1, negate);
+    as.bind(nan);
+    call(advance);
+    expectChar('a', fail);
+    expectChar('n', fail);
+    movImm64(RAX, 0x7FF8000000000000ull);
+    as.modrm(0x66, true, 0x0F6E, XMM0, inReg(RAX));
+
+    as.bind(negate);
+    alu(0x85, R15, R15, false);
+    jump(CC_E, ok);
+    as.modrm(0x66, true, 0x0F7E, XMM0, inReg(RAX));
+    movImm64(RCX, uint64_t(1) << 63);
+    alu(0x33, RAX, RCX);
+    as.modrm(0x66, true, 0x0F6E, XMM0, inReg(RAX));
+    as.bind(ok);
+    as.movImm(RAX, 1);
+    jump(-1, out);
+    as.bind(fail);
+    zero(RAX);
+    as.bind(out);
+    for (int k = sizeof(kSaved) / sizeof(int); k-- > 0;) as.pop(kSaved[k]);
+    ret();
+}
+
+void RuntimeEmitter::emitTable(int table, const std::vector<std::string>& strings) {
+    while (as.here() % 4) as.byte(0);
+    as.bind(table);
+    uint32_t offset = static_cast<uint32_t>(8 * strings.size());
+    for (const std::string& text : strings) {
+        as.dword(offset);
+        as.dword(static_cast<uint32_t>(text.size()));
+        offset += static_cast<uint32_t>(text.size());
+    }
+    for (const std::string& text : strings) as.bytes.insert(as.bytes.end(), text.begin(), text.end());
+}
+
+void RuntimeEmitter::emitData() {
+    while (as.here() % 8) as.byte(0xCC);
+    as.bind(pow10);
+    double power = 1.0;
+    for (int k = 0; k < kPow10Count; ++k, power *= 10.0) {
+        uint64_t bits;
+        std::memcpy(&bits, &power, 8);
+        as.qword(bits);
+    }
+    for (const auto& entry : literals) {
+        as.bind(entry.first);
+        as.bytes.insert(as.bytes.end(), entry.second.begin(), entry.second.end());
+    }
+    emitTable(textTable, program.texts);
+    emitTable(formatTable, program.formats);
+    emitTable(nameTable, program.symbolNames);
+}
+
+void put16(std::vector<uint8_t>& out, uint16_t v) {
+    for (int k = 0; k < 2; ++k) out.push_back(static_cast<uint8_t>(v >> (8 * k)));
+}
+
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int k = 0; k < 4; ++k) out.push_back(static_cast<uint8_t>(v >> (8 * k)));
+}
+
+void put64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int k = 0; k < 8; ++k) out.push_back(static_cast<uint8_t>(v >> (8 * k)));
+}
+
+void putProgramHeader(std::vector<uint8_t>& out, uint32_t type, uint32_t flags, uint64_t offset, uint64_t address,
+                      uint64_t fileSize, uint64_t memorySize) {
+    put32(out, type);
+    put32(out, flags);
+    put64(out, offset);
+    put64(out, address);
+    put64(out, address);
+    put64(out, fileSize);
+    put64(out, memorySize);
+    put64(out, kPageSize);
+}
+
+}  // namespace
+
+ElfWriter::ElfWriter(const IRProgram& ir) {
+    Bytecode program(ir);
+    X64Translator translator(program, nullptr);
+    translator.translate();
+    RuntimeEmitter runtime(translator, program);
+    size_t entry = runtime.emit();
+
+    X64Assembler& as = translator.as;
+    const uint64_t fileSize = kCodeOffset + as.bytes.size();
+    const uint64_t dataOffset = (fileSize + kPageSize - 1) / kPageSize * kPageSize;
+    const uint64_t dataSize = uint64_t(kFrame) + 8 * uint64_t(translator.slotCount);
+    runtime.bindData(dataOffset - kCodeOffset);
+    as.resolveLabels();
+
+    // ELF header: 64-bit, little endian, System V, an x86-64 executable.
+    std::vector<uint8_t>& out = fileImage;
+    static const uint8_t kIdent[16] = {0x7F, 'E', 'L', 'F', 2, 1, 1, 0};
+    out.assign(kIdent, kIdent + 16);
+    put16(out, 2);
+    put16(out, 62);
+    put32(out, 1);
+    put64(out, kBaseAddress + kCodeOffset + entry);
+    put64(out, 64);
+    put64(out, 0);
+    put32(out, 0);
+    put16(out, 64);
+    put16(out, 56);
+    put16(out, 3);
+    put16(out, 64);
+    put16(out, 0);
+    put16(out, 0);
+
+    // Code and constants read and execute, data read and write, and a
+    // stack that does not execute.
+    putProgramHeader(out, 1, 5, 0, kBaseAddress, fileSize, fileSize);
+    putProgramHeader(out, 1, 6, dataOffset, kBaseAddress + dataOffset, 0, dataSize);
+    putProgramHeader(out, 0x6474E551, 6, 0, 0, 0, 0);
+    out.resize(kCodeOffset, 0);
+    out.insert(out.end(), as.bytes.begin(), as.bytes.end());
+}
+
+bool ElfWriter::write(const std::string& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        errorMessage = "Could not create " + path + ".";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(fileImage.data()), static_cast<std::streamsize>(fileImage.size()));
+    file.close();
+    if (!file) {
+        errorMessage = "Could not write " + path + ".";
+        return false;
+    }
+#ifndef _WIN32
+    chmod(path.c_str(), 0755);
+#endif
+    return true;
+}
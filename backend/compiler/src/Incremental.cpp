@@ -0,0 +1,255 @@
+#include "Incremental.h"
+#include "Driver.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+
+// Records are spliced in from this many different source versions at most
+// before the next update reparses everything into one.
+static const size_t kMaxGenerationRuns = 16;
+
+static size_t countNewlines(std::string_view text, size_t begin, size_t end) {
+    return static_cast<size_t>(std::count(text.begin() + begin, text.begin() + end, '\n'));
+}
+
+static void shiftExpression(Expression* expr, int delta);
+
+static void shiftStatement(Statement* stmt, int delta) {
+    if (!stmt) return;
+    stmt->line += delta;
+    switch (stmt->kind) {
+        case NodeKind::VAR_DECL:
+            shiftExpression(static_cast<VarDecl*>(stmt)->value, delta);
+            break;
+        case NodeKind::OUTPUT:
+            shiftExpression(static_cast<OutputStmt*>(stmt)->value, delta);
+            break;
+        case NodeKind::IF: {
+            auto ifStmt = static_cast<IfStmt*>(stmt);
+            shiftExpression(ifStmt->condition, delta);
+            for (Statement* s : ifStmt->thenBranch) shiftStatement(s, delta);
+            for (Statement* s : ifStmt->elseIfBranches) shiftStatement(s, delta);
+            for (Statement* s : ifStmt->elseBranch) shiftStatement(s, delta);
+            break;
+        }
+        case NodeKind::REPEAT: {
+            auto repeatStmt = static_cast<RepeatStmt*>(stmt);
+            shiftExpression(repeatStmt->start, delta);
+            shiftExpression(repeatStmt->end, delta);
+            shiftExpression(repeatStmt->jump, delta);
+            shiftExpression(repeatStmt->untilCondition, delta);
+            for (Statement* s : repeatStmt->body) shiftStatement(s, delta);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void shiftExpression(Expression* expr, int delta) {
+    if (!expr) return;
+    expr->line += delta;
+    if (expr->kind == NodeKind::REL_OP) {
+        auto rel = static_cast<RelOpExpr*>(expr);
+        shiftExpression(rel->left, delta);
+        shiftExpression(rel->right, delta);
+    }
+}
+
+// Parser errors all read "Line <n>: <message>".
+static void shiftParseError(std::pair<int, std::string>& error, int delta) {
+    size_t prefix = 5 + std::to_string(error.first).size();
+    error.first += delta;
+    error.second.replace(0, prefix, "Line " + std::to_string(error.first));
+}
+
+IncrementalFrontend::IncrementalFrontend() : analyzed(0), lowered(0) {}
+
+IncrementalFrontend::~IncrementalFrontend() {}
+
+size_t IncrementalFrontend::generationRuns() const {
+    size_t runs = 0;
+    const Generation* last = nullptr;
+    for (const auto& record : records) {
+        if (record.generation.get() != last) ++runs;
+        last = record.generation.get();
+    }
+    return runs;
+}
+
+// Takes analysis and lowering back to just before records[first]. Must run
+// while those records, whose names the symbol table still points at, are
+// alive.
+void IncrementalFrontend::rollbackTo(size_t first) {
+    if (analyzed > first) {
+        sema.rollback(first ? records[first - 1].semaEnd : SemanticAnalyzer::Mark());
+        analyzed = first;
+    }
+    if (lowered > first) {
+        icg.getIR().rollback(first ? records[first - 1].irEnd : IRProgram::Mark());
+        lowered = first;
+    }
+}
+
+void IncrementalFrontend::reparse(std::string_view source) {
+    work = Work();
+    if (latest && source == latest->text) {
+        work.reused = records.size();
+        return;
+    }
+
+    auto gen = std::make_shared<Generation>();
+    gen->text.assign(source.data(), source.size());
+    std::string_view text = gen->text;
+    std::string_view old = latest ? std::string_view(latest->text) : std::string_view();
+
+    // The edit covers whole lines: [changeStart, oldSuffix) of the old text
+    // became [changeStart, newSuffix) of the new one.
+    size_t common = static_cast<size_t>(
+        std::mismatch(old.begin(), old.end(), text.begin(), text.end()).first - old.begin());
+    size_t changeStart = common ? old.rfind('\n', common - 1) : std::string_view::npos;
+    changeStart = changeStart == std::string_view::npos ? 0 : changeStart + 1;
+    size_t limit = std::min(old.size(), text.size()) - common;
+    size_t tail = 0;
+    while (tail < limit && old[old.size() - 1 - tail] == text[text.size() - 1 - tail]) ++tail;
+    ptrdiff_t byteDelta = static_cast<ptrdiff_t>(text.size()) - static_cast<ptrdiff_t>(old.size());
+    // The unchanged tail starts at a line start inside the matching bytes,
+    // so positions in it have the same column in both versions.
+    size_t newline = old.find('\n', old.size() - tail);
+    bool haveSuffix = newline != std::string_view::npos;
+    size_t oldSuffix = haveSuffix ? newline + 1 : old.size();
+    size_t newSuffix = static_cast<size_t>(static_cast<ptrdiff_t>(oldSuffix) + byteDelta);
+    int lineDelta = static_cast<int>(countNewlines(text, changeStart, newSuffix)) -
+                    static_cast<int>(countNewlines(old, changeStart, oldSuffix));
+
+    // Statements whose lookahead token ends before the edit parse the same.
+    bool fragmented = generationRuns() > kMaxGenerationRuns;
+    size_t first = 0;
+    if (!fragmented) {
+        first = static_cast<size_t>(std::partition_point(records.begin(), records.end(),
+            [changeStart](const StatementRecord& record) { return record.lookaheadEnd < changeStart; })
+            - records.begin());
+    }
+    rollbackTo(first);
+    if (first == records.size() && !records.empty()) {
+        // Only bytes past an embedded NUL, where scanning stops, changed.
+        latest = std::move(gen);
+        work.reused = records.size();
+        return;
+    }
+
+    LexPosition start = first < records.size() ? records[first].start : LexPosition();
+    LexPosition before = start;
+    LexPosition after = start;
+    Lexer lexer(text, start);
+    Parser parser(lexer, gen->arena, [&](const Token& token) {
+        before = after;
+        after = lexer.position();
+        gen->tokens.push_back(token);
+    });
+
+    std::vector<StatementRecord> fresh;
+    size_t reuse = records.size();
+    size_t candidate = first;
+    size_t errorCount = 0;
+    while (true) {
+        // Back in step with the old parse: the scanner stands in the
+        // unchanged tail of the file, between two tokens, exactly where a
+        // statement used to start.
+        if (!fragmented && haveSuffix && before.offset >= newSuffix) {
+            size_t oldOffset = static_cast<size_t>(static_cast<ptrdiff_t>(before.offset) - byteDelta);
+            while (candidate < records.size() && records[candidate].start.offset < oldOffset) ++candidate;
+            if (candidate < records.size() && records[candidate].start.offset == oldOffset) {
+                reuse = candidate;
+                break;
+            }
+        }
+
+        StatementRecord record;
+        record.generation = gen;
+        record.start = before;
+        record.tokenBegin = gen->tokens.size() - 1;
+        record.stmt = parser.parseNext();
+        record.tokenEnd = gen->tokens.size() - (record.stmt ? 1 : 0);
+        record.lookaheadEnd = after.offset;
+        const auto& errors = parser.getErrors();
+        const auto& errorLines = parser.getErrorLines();
+        for (; errorCount < errors.size(); ++errorCount) {
+            record.parseErrors.emplace_back(errorLines[errorCount], errors[errorCount]);
+        }
+        for (size_t i = record.tokenBegin; i < record.tokenEnd; ++i) {
+            if (gen->tokens[i].type == TokenType::INVALID) ++record.invalidTokens;
+        }
+        fresh.push_back(std::move(record));
+        if (!fresh.back().stmt) break;
+    }
+
+    for (size_t k = reuse; k < records.size(); ++k) {
+        StatementRecord& record = records[k];
+        record.start.offset = static_cast<size_t>(static_cast<ptrdiff_t>(record.start.offset) + byteDelta);
+        record.start.line += lineDelta;
+        record.lookaheadEnd = static_cast<size_t>(static_cast<ptrdiff_t>(record.lookaheadEnd) + byteDelta);
+        if (lineDelta == 0) continue;
+        std::vector<Token>& tokens = record.generation->tokens;
+        for (size_t i = record.tokenBegin; i < record.tokenEnd; ++i) tokens[i].line += lineDelta;
+        for (auto& error : record.parseErrors) shiftParseError(error, lineDelta);
+        shiftStatement(record.stmt, lineDelta);
+    }
+
+    work.reparsed = fresh.size();
+    work.reused = first + (records.size() - reuse);
+    work.rescannedTokens = gen->tokens.size();
+    records.erase(records.begin() + first, records.begin() + reuse);
+    records.insert(records.begin() + first, std::make_move_iterator(fresh.begin()),
+                   std::make_move_iterator(fresh.end()));
+    latest = std::move(gen);
+}
+
+void IncrementalFrontend::analyze() {
+    for (; analyzed < records.size(); ++analyzed) {
+        sema.analyzeNext(records[analyzed].stmt);
+        records[analyzed].semaEnd = sema.mark();
+        ++work.reanalyzed;
+    }
+}
+
+const IRProgram& IncrementalFrontend::lower() {
+    for (; lowered < records.size(); ++lowered) {
+        icg.append(records[lowered].stmt);
+        records[lowered].irEnd = icg.getIR().mark();
+        ++work.relowered;
+    }
+    return icg.getIR();
+}
+
+void IncrementalFrontend::appendErrors(std::vector<std::string>& out) const {
+    for (const auto& record : records) {
+        if (!record.invalidTokens) continue;
+        const std::vector<Token>& tokens = record.generation->tokens;
+        for (size_t i = record.tokenBegin; i < record.tokenEnd; ++i) {
+            if (tokens[i].type == TokenType::INVALID) out.push_back(lexicalErrorMessage(tokens[i]));
+        }
+    }
+    for (const auto& record : records) {
+        for (const auto& error : record.parseErrors) out.push_back(error.second);
+    }
+    const auto& semaErrors = sema.getErrors();
+    out.insert(out.end(), semaErrors.begin(), semaErrors.end());
+}
+
+void IncrementalFrontend::appendTokens(std::string& out) const {
+    for (const auto& record : records) {
+        const std::vector<Token>& tokens = record.generation->tokens;
+        for (size_t i = record.tokenBegin; i < record.tokenEnd; ++i) appendTokenLine(out, tokens[i]);
+    }
+}
+
+size_t IncrementalFrontend::statementCount() const {
+    return records.empty() ? 0 : records.size() - 1;
+}
+
+size_t IncrementalFrontend::tokenCount() const {
+    size_t total = 0;
+    for (const auto& record : records) total += record.tokenEnd - record.tokenBegin;
+    return total;
+}
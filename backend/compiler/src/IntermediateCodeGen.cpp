@@ -1,157 +1,416 @@
 #include "IntermediateCodeGen.h"
 #include <sstream>
+#include <cstdlib>
+#include <charconv>
 
-IntermediateCodeGen::IntermediateCodeGen() : tempVarCounter(0) {}
+size_t IRInstruction::operandCount() const {
+    switch (opcode) {
+        case IROpcode::ASSIGN:
+        case IROpcode::JZ:
+        case IROpcode::JNZ:
+            return 2;
+        case IROpcode::JMP:
+        case IROpcode::LABEL:
+        case IROpcode::INPUT:
+        case IROpcode::OUTPUT:
+            return 1;
+        default:
+            return 3;
+    }
+}
 
-void IntermediateCodeGen::generate(const Program* program) {
-    ir.clear();
-    tempVarCounter = 0;
-    for (const auto& stmt : program->statements) {
-        genStatement(stmt.get());
+int IRInstruction::definedOperand() const {
+    switch (opcode) {
+        case IROpcode::ASSIGN:
+            return 1;
+        case IROpcode::INPUT:
+            return 0;
+        default:
+            return isArithmeticOpcode(opcode) || isRelationalOpcode(opcode) ? 2 : -1;
     }
 }
 
-const std::vector<IRInstruction>& IntermediateCodeGen::getIR() const {
-    return ir;
+bool isArithmeticOpcode(IROpcode op) {
+    return op == IROpcode::ADD || op == IROpcode::SUB ||
+           op == IROpcode::MUL || op == IROpcode::DIV;
 }
 
-std::string IntermediateCodeGen::newTemp() {
-    return "_t" + std::to_string(tempVarCounter++);
+bool isRelationalOpcode(IROpcode op) {
+    return op == IROpcode::LT || op == IROpcode::LE ||
+           op == IROpcode::GT || op == IROpcode::GE ||
+           op == IROpcode::EQ || op == IROpcode::NE;
 }
 
-std::string IntermediateCodeGen::relOpToOpcode(const std::string& op) {
-    if (op == "==") return "EQ";
-    if (op == "!=") return "NE";
-    if (op == "<")  return "LT";
-    if (op == "<=") return "LE";
-    if (op == ">")  return "GT";
-    if (op == ">=") return "GE";
+const char* opcodeName(IROpcode op) {
+    switch (op) {
+        case IROpcode::ASSIGN: return "ASSIGN";
+        case IROpcode::ADD: return "ADD";
+        case IROpcode::SUB: return "SUB";
+        case IROpcode::MUL: return "MUL";
+        case IROpcode::DIV: return "DIV";
+        case IROpcode::LT: return "LT";
+        case IROpcode::LE: return "LE";
+        case IROpcode::GT: return "GT";
+        case IROpcode::GE: return "GE";
+        case IROpcode::EQ: return "EQ";
+        case IROpcode::NE: return "NE";
+        case IROpcode::JZ: return "JZ";
+        case IROpcode::JNZ: return "JNZ";
+        case IROpcode::JMP: return "JMP";
+        case IROpcode::LABEL: return "LABEL";
+        case IROpcode::INPUT: return "INPUT";
+        case IROpcode::OUTPUT: return "OUTPUT";
+    }
     return "INVALID";
 }
 
-void IntermediateCodeGen::genStatement(const Statement* stmt) {
-    if (!stmt) return;
+Operand IRProgram::internSymbol(std::string_view name) {
+    std::string key(name);
+    auto it = symbolIds.find(key);
+    if (it != symbolIds.end()) return Operand(OperandKind::SYMBOL, it->second);
+    uint32_t id = static_cast<uint32_t>(symbols.size());
+    symbols.push_back(key);
+    symbolIds.emplace(std::move(key), id);
+    return Operand(OperandKind::SYMBOL, id);
+}
 
-    if (auto varDecl = dynamic_cast<const VarDecl*>(stmt)) {
-        std::string rhs;
-        genExpression(varDecl->value.get(), rhs);
-        ir.emplace_back("ASSIGN", std::vector<std::string>{rhs, varDecl->varName}, stmt->line);
-        return;
-    }
+Operand IRProgram::internNumber(std::string_view spelling) {
+    std::string key(spelling);
+    auto it = numberIds.find(key);
+    if (it != numberIds.end()) return Operand(OperandKind::NUMBER, it->second);
+    uint32_t id = static_cast<uint32_t>(numbers.size());
+    numbers.push_back(key);
+    numberValues.push_back(std::strtod(key.c_str(), nullptr));
+    numberIds.emplace(std::move(key), id);
+    return Operand(OperandKind::NUMBER, id);
+}
 
-    if (auto inputStmt = dynamic_cast<const InputStmt*>(stmt)) {
-        ir.emplace_back("INPUT", std::vector<std::string>{inputStmt->varName}, stmt->line);
-        return;
+Operand IRProgram::internString(std::string_view text) {
+    std::string key(text);
+    auto it = stringIds.find(key);
+    if (it != stringIds.end()) return Operand(OperandKind::STRING, it->second);
+    uint32_t id = static_cast<uint32_t>(strings.size());
+    strings.push_back(key);
+    stringIds.emplace(std::move(key), id);
+    return Operand(OperandKind::STRING, id);
+}
+
+Operand IRProgram::newTemp() {
+    return Operand(OperandKind::TEMP, nameCounter++);
+}
+
+Operand IRProgram::newTemp(CType type) {
+    Operand temp = newTemp();
+    tempTypes.resize(nameCounter - firstName, CType::NONE);
+    tempTypes.back() = type;
+    return temp;
+}
+
+Operand IRProgram::newLabel() {
+    return Operand(OperandKind::LABEL, nameCounter++);
+}
+
+static void appendUnsigned(std::string& out, unsigned long value) {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr);
+}
+
+void IRProgram::appendOperand(std::string& out, const Operand& op) const {
+    switch (op.kind) {
+        case OperandKind::SYMBOL: out += symbols[op.id]; break;
+        case OperandKind::TEMP: out += "_t"; appendUnsigned(out, op.id); break;
+        case OperandKind::LABEL: out += 'L'; appendUnsigned(out, op.id); break;
+        case OperandKind::NUMBER: out += numbers[op.id]; break;
+        case OperandKind::STRING: out += '"'; out += strings[op.id]; out += '"'; break;
+        case OperandKind::NONE: break;
     }
+}
 
-    if (auto outputStmt = dynamic_cast<const OutputStmt*>(stmt)) {
-        std::string val;
-        genExpression(outputStmt->value.get(), val);
-        ir.emplace_back("OUTPUT", std::vector<std::string>{val}, stmt->line);
-        return;
+static CType promote(CType t1, CType t2) {
+    if (t1 == CType::STRING || t2 == CType::STRING) return CType::STRING;
+    if (t1 == CType::DOUBLE || t2 == CType::DOUBLE) return CType::DOUBLE;
+    return CType::INT;
+}
+
+static bool isInteger(const std::string& s) {
+    if (s.empty()) return false;
+    for (char c : s) {
+        if (c < '0' || c > '9') return false;
     }
+    return true;
+}
 
-    if (auto binOp = dynamic_cast<const BinOpStmt*>(stmt)) {
-        std::string opStr;
-        switch (binOp->op) {
-            case BinOpType::ADD: opStr = "ADD"; break;
-            case BinOpType::SUBTRACT: opStr = "SUB"; break;
-            case BinOpType::MULTIPLY: opStr = "MUL"; break;
-            case BinOpType::DIVIDE: opStr = "DIV"; break;
+void inferTypes(const IRProgram& ir, std::vector<CType>& symbolTypes, std::vector<CType>& tempTypes) {
+    symbolTypes.resize(ir.symbols.size(), CType::NONE);
+    tempTypes.assign(ir.nameCounter - ir.firstName, CType::NONE);
+    auto slot = [&](const Operand& var) -> CType& {
+        return var.kind == OperandKind::SYMBOL ? symbolTypes[var.id] : tempTypes[var.id - ir.firstName];
+    };
+    auto typeOf = [&](const Operand& op) {
+        return op.isVariable() ? slot(op) : CType::NONE;
+    };
+    auto declare = [&](const Operand& var, const Operand& value) {
+        if (!var.isVariable() || slot(var) != CType::NONE) return;
+        CType type = CType::DOUBLE;
+        if (value.kind == OperandKind::STRING) type = CType::STRING;
+        else if (value.kind == OperandKind::NUMBER) type = isInteger(ir.numbers[value.id]) ? CType::INT : CType::DOUBLE;
+        else if (typeOf(value) != CType::NONE) type = typeOf(value);
+        slot(var) = type;
+    };
+
+    for (const auto& instr : ir.code) {
+        if (instr.opcode == IROpcode::ASSIGN) {
+            declare(instr.operands[1], instr.operands[0]);
+        } else if (isArithmeticOpcode(instr.opcode)) {
+            slot(instr.operands[2]) = promote(typeOf(instr.operands[0]), typeOf(instr.operands[1]));
+        } else if (isRelationalOpcode(instr.opcode)) {
+            slot(instr.operands[2]) = CType::INT;
+        } else if (instr.opcode == IROpcode::INPUT) {
+            declare(instr.operands[0], Operand());
         }
-        ir.emplace_back(opStr, std::vector<std::string>{binOp->left, binOp->right, binOp->result}, stmt->line);
-        return;
     }
+}
 
-    if (auto ifStmt = dynamic_cast<const IfStmt*>(stmt)) {
-        std::string cond;
-        genExpression(ifStmt->condition.get(), cond);
-        std::string labelElse = "L" + std::to_string(tempVarCounter++);
-        std::string labelEnd = "L" + std::to_string(tempVarCounter++);
-        ir.emplace_back("JZ", std::vector<std::string>{cond, labelElse}, stmt->line);
+void IRProgram::inferTypes() {
+    ::inferTypes(*this, symbolTypes, tempTypes);
+    typesInferred = true;
+}
 
-        for (const auto& s : ifStmt->thenBranch) genStatement(s.get());
-        ir.emplace_back("JMP", std::vector<std::string>{labelEnd}, stmt->line);
+CType IRProgram::typeOf(const Operand& op) const {
+    if (op.kind == OperandKind::SYMBOL) return op.id < symbolTypes.size() ? symbolTypes[op.id] : CType::NONE;
+    if (op.kind != OperandKind::TEMP) return CType::NONE;
+    uint32_t index = op.id - firstName;
+    return op.id >= firstName && index < tempTypes.size() ? tempTypes[index] : CType::NONE;
+}
 
-        ir.emplace_back("LABEL", std::vector<std::string>{labelElse}, stmt->line);
-        for (const auto& s : ifStmt->elseBranch) genStatement(s.get());  
+std::string IRProgram::operandToString(const Operand& op) const {
+    std::string out;
+    appendOperand(out, op);
+    return out;
+}
 
-        ir.emplace_back("LABEL", std::vector<std::string>{labelEnd}, stmt->line);
-        return;
+void IRProgram::appendInstruction(std::string& out, const IRInstruction& instr) const {
+    out += "Line ";
+    char buf[16];
+    auto res = std::to_chars(buf, buf + sizeof(buf), instr.line);
+    out.append(buf, res.ptr);
+    out += ": ";
+    out += opcodeName(instr.opcode);
+    size_t count = instr.operandCount();
+    for (size_t i = 0; i < count; ++i) {
+        out += (i == 0) ? " " : ", ";
+        appendOperand(out, instr.operands[i]);
     }
+}
 
-    if (auto repeatStmt = dynamic_cast<const RepeatStmt*>(stmt)) {
-        if (!repeatStmt->varName.empty()) {
-            std::string startVal, endVal, jumpVal;
-            genExpression(repeatStmt->start.get(), startVal);
-            genExpression(repeatStmt->end.get(), endVal);
-            genExpression(repeatStmt->jump.get(), jumpVal);
+void IRProgram::clear() {
+    code.clear();
+    symbols.clear();
+    numbers.clear();
+    numberValues.clear();
+    strings.clear();
+    symbolTypes.clear();
+    tempTypes.clear();
+    typesInferred = false;
+    nameCounter = 0;
+    firstName = 0;
+    symbolIds.clear();
+    numberIds.clear();
+    stringIds.clear();
+}
 
-            ir.emplace_back("ASSIGN", std::vector<std::string>{startVal, repeatStmt->varName}, stmt->line);
+void IRProgram::resetFragment() {
+    code.clear();
+    numbers.clear();
+    numberValues.clear();
+    strings.clear();
+    numberIds.clear();
+    stringIds.clear();
+    tempTypes.clear();
+    typesInferred = false;
+    firstName = nameCounter;
+}
 
-            std::string labelStart = "L" + std::to_string(tempVarCounter++);
-            std::string labelEnd = "L" + std::to_string(tempVarCounter++);
-            ir.emplace_back("LABEL", std::vector<std::string>{labelStart}, stmt->line);
+IRProgram::Mark IRProgram::mark() const {
+    Mark m;
+    m.code = code.size();
+    m.symbols = symbols.size();
+    m.numbers = numbers.size();
+    m.strings = strings.size();
+    m.names = nameCounter;
+    return m;
+}
 
-            std::string condTemp = newTemp();
-            ir.emplace_back("LE", std::vector<std::string>{repeatStmt->varName, endVal, condTemp}, stmt->line);
-            ir.emplace_back("JZ", std::vector<std::string>{condTemp, labelEnd}, stmt->line);
+void IRProgram::rollback(const Mark& m) {
+    code.erase(code.begin() + m.code, code.end());
+    for (size_t i = m.symbols; i < symbols.size(); ++i) symbolIds.erase(symbols[i]);
+    for (size_t i = m.numbers; i < numbers.size(); ++i) numberIds.erase(numbers[i]);
+    for (size_t i = m.strings; i < strings.size(); ++i) stringIds.erase(strings[i]);
+    symbols.resize(m.symbols);
+    numbers.resize(m.numbers);
+    numberValues.resize(m.numbers);
+    strings.resize(m.strings);
+    if (symbolTypes.size() > m.symbols) symbolTypes.resize(m.symbols);
+    tempTypes.clear();
+    typesInferred = false;
+    nameCounter = m.names;
+}
 
-            for (const auto& s : repeatStmt->body) genStatement(s.get());
+IntermediateCodeGen::IntermediateCodeGen() {}
 
-            std::string incTemp = newTemp();
-            ir.emplace_back("ADD", std::vector<std::string>{repeatStmt->varName, jumpVal, incTemp}, stmt->line);
-            ir.emplace_back("ASSIGN", std::vector<std::string>{incTemp, repeatStmt->varName}, stmt->line);
+void IntermediateCodeGen::generate(const Program* program) {
+    ir.clear();
+    for (const Statement* stmt : program->statements) {
+        genStatement(stmt);
+    }
+}
 
-            ir.emplace_back("JMP", std::vector<std::string>{labelStart}, stmt->line);
-            ir.emplace_back("LABEL", std::vector<std::string>{labelEnd}, stmt->line);
-        }
-        else if (repeatStmt->untilCondition) {
-            std::string labelStart = "L" + std::to_string(tempVarCounter++);
-            std::string labelEnd = "L" + std::to_string(tempVarCounter++);
-            ir.emplace_back("LABEL", std::vector<std::string>{labelStart}, stmt->line);
+void IntermediateCodeGen::generateNext(const Statement* stmt) {
+    ir.resetFragment();
+    genStatement(stmt);
+}
 
-            std::string cond;
-            genExpression(repeatStmt->untilCondition.get(), cond);
-            ir.emplace_back("JNZ", std::vector<std::string>{cond, labelEnd}, stmt->line);
+void IntermediateCodeGen::append(const Statement* stmt) {
+    genStatement(stmt);
+}
 
-            for (const auto& s : repeatStmt->body) genStatement(s.get());
+const IRProgram& IntermediateCodeGen::getIR() const {
+    return ir;
+}
 
-            ir.emplace_back("JMP", std::vector<std::string>{labelStart}, stmt->line);
-            ir.emplace_back("LABEL", std::vector<std::string>{labelEnd}, stmt->line);
-        }
-        return;
-    }
+IRProgram& IntermediateCodeGen::getIR() {
+    return ir;
 }
 
-void IntermediateCodeGen::genExpression(const Expression* expr, std::string& result) {
-    if (!expr) {
-        result = "";
-        return;
-    }
+IRProgram IntermediateCodeGen::takeIR() {
+    return std::move(ir);
+}
 
-    if (auto id = dynamic_cast<const Identifier*>(expr)) {
-        result = id->name;
-        return;
-    }
-    if (auto num = dynamic_cast<const NumberLiteral*>(expr)) {
-        result = num->value;
-        return;
+IROpcode IntermediateCodeGen::relOpToOpcode(std::string_view op) {
+    if (op == "==") return IROpcode::EQ;
+    if (op == "<")  return IROpcode::LT;
+    if (op == "<=") return IROpcode::LE;
+    if (op == ">")  return IROpcode::GT;
+    if (op == ">=") return IROpcode::GE;
+    return IROpcode::NE;
+}
+
+void IntermediateCodeGen::genStatement(const Statement* stmt) {
+    if (!stmt) return;
+    visitStatement(stmt);
+}
+
+void IntermediateCodeGen::genExpression(const Expression* expr, Operand& result) {
+    result = expr ? visitExpression(expr) : Operand();
+}
+
+void IntermediateCodeGen::visitVarDecl(const VarDecl* varDecl) {
+    Operand rhs;
+    genExpression(varDecl->value, rhs);
+    ir.code.emplace_back(IROpcode::ASSIGN, rhs, ir.internSymbol(varDecl->varName), varDecl->line);
+}
+
+void IntermediateCodeGen::visitInput(const InputStmt* inputStmt) {
+    ir.code.emplace_back(IROpcode::INPUT, ir.internSymbol(inputStmt->varName), inputStmt->line);
+}
+
+void IntermediateCodeGen::visitOutput(const OutputStmt* outputStmt) {
+    Operand val;
+    genExpression(outputStmt->value, val);
+    ir.code.emplace_back(IROpcode::OUTPUT, val, outputStmt->line);
+}
+
+void IntermediateCodeGen::visitBinOp(const BinOpStmt* binOp) {
+    IROpcode op = IROpcode::ADD;
+    switch (binOp->op) {
+        case BinOpType::ADD: op = IROpcode::ADD; break;
+        case BinOpType::SUBTRACT: op = IROpcode::SUB; break;
+        case BinOpType::MULTIPLY: op = IROpcode::MUL; break;
+        case BinOpType::DIVIDE: op = IROpcode::DIV; break;
     }
-    if (auto str = dynamic_cast<const StringLiteral*>(expr)) {
-        result = "\"" + str->value + "\"";
-        return;
+    ir.code.emplace_back(op, ir.internSymbol(binOp->left), ir.internSymbol(binOp->right),
+                         ir.internSymbol(binOp->result), binOp->line);
+}
+
+void IntermediateCodeGen::visitIf(const IfStmt* ifStmt) {
+    int line = ifStmt->line;
+    Operand cond;
+    genExpression(ifStmt->condition, cond);
+    Operand labelElse = ir.newLabel();
+    Operand labelEnd = ir.newLabel();
+    ir.code.emplace_back(IROpcode::JZ, cond, labelElse, line);
+
+    for (const Statement* s : ifStmt->thenBranch) genStatement(s);
+    ir.code.emplace_back(IROpcode::JMP, labelEnd, line);
+
+    ir.code.emplace_back(IROpcode::LABEL, labelElse, line);
+    for (const Statement* s : ifStmt->elseBranch) genStatement(s);
+
+    ir.code.emplace_back(IROpcode::LABEL, labelEnd, line);
+}
+
+void IntermediateCodeGen::visitRepeat(const RepeatStmt* repeatStmt) {
+    int line = repeatStmt->line;
+    if (!repeatStmt->varName.empty()) {
+        Operand startVal, endVal, jumpVal;
+        genExpression(repeatStmt->start, startVal);
+        genExpression(repeatStmt->end, endVal);
+        genExpression(repeatStmt->jump, jumpVal);
+
+        Operand var = ir.internSymbol(repeatStmt->varName);
+        ir.code.emplace_back(IROpcode::ASSIGN, startVal, var, line);
+
+        Operand labelStart = ir.newLabel();
+        Operand labelEnd = ir.newLabel();
+        ir.code.emplace_back(IROpcode::LABEL, labelStart, line);
+
+        Operand condTemp = ir.newTemp();
+        ir.code.emplace_back(IROpcode::LE, var, endVal, condTemp, line);
+        ir.code.emplace_back(IROpcode::JZ, condTemp, labelEnd, line);
+
+        for (const Statement* s : repeatStmt->body) genStatement(s);
+
+        Operand incTemp = ir.newTemp();
+        ir.code.emplace_back(IROpcode::ADD, var, jumpVal, incTemp, line);
+        ir.code.emplace_back(IROpcode::ASSIGN, incTemp, var, line);
+
+        ir.code.emplace_back(IROpcode::JMP, labelStart, line);
+        ir.code.emplace_back(IROpcode::LABEL, labelEnd, line);
     }
-    if (auto rel = dynamic_cast<const RelOpExpr*>(expr)) {
-        std::string leftVal, rightVal;
-        genExpression(rel->left.get(), leftVal);
-        genExpression(rel->right.get(), rightVal);
-        std::string temp = newTemp();
-        std::string opcode = relOpToOpcode(rel->op);
-        ir.emplace_back(opcode, std::vector<std::string>{leftVal, rightVal, temp}, expr->line);
-        result = temp;
-        return;
+    else if (repeatStmt->untilCondition) {
+        Operand labelStart = ir.newLabel();
+        Operand labelEnd = ir.newLabel();
+        ir.code.emplace_back(IROpcode::LABEL, labelStart, line);
+
+        Operand cond;
+        genExpression(repeatStmt->untilCondition, cond);
+        ir.code.emplace_back(IROpcode::JNZ, cond, labelEnd, line);
+
+        for (const Statement* s : repeatStmt->body) genStatement(s);
+
+        ir.code.emplace_back(IROpcode::JMP, labelStart, line);
+        ir.code.emplace_back(IROpcode::LABEL, labelEnd, line);
     }
+}
+
+Operand IntermediateCodeGen::visitIdentifier(const Identifier* id) {
+    return ir.internSymbol(id->name);
+}
+
+Operand IntermediateCodeGen::visitNumber(const NumberLiteral* num) {
+    return ir.internNumber(num->value);
+}
+
+Operand IntermediateCodeGen::visitString(const StringLiteral* str) {
+    return ir.internString(str->value);
+}
 
-    result = "";
+Operand IntermediateCodeGen::visitRelOp(const RelOpExpr* rel) {
+    Operand leftVal, rightVal;
+    genExpression(rel->left, leftVal);
+    genExpression(rel->right, rightVal);
+    Operand temp = ir.newTemp();
+    ir.code.emplace_back(relOpToOpcode(rel->op), leftVal, rightVal, temp, rel->line);
+    return temp;
 }
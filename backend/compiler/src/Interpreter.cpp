@@ -0,0 +1,203 @@
+#include "Interpreter.h"
+#include <algorithm>
+#include <climits>
+
+IRInterpreter::IRInterpreter(const IRProgram& ir) : program(ir) {}
+
+bool IRInterpreter::run(std::FILE* in, std::FILE* out) {
+    using Value = Bytecode::Value;
+    const std::vector<int>& lines = program.lines;
+    const std::vector<std::string>& texts = program.texts;
+    const std::vector<std::string>& formats = program.formats;
+    errorMessage.clear();
+    std::vector<Value> registers(program.registerCount);
+    std::copy(program.constants.begin(), program.constants.end(), registers.begin() + program.firstConstant);
+    Value* r = registers.data();
+    const Bytecode::Instr* base = program.code.data();
+    const Bytecode::Instr* ip = base;
+
+    auto fail = [&](const char* message) {
+        std::fflush(out);
+        errorMessage = "Line " + std::to_string(lines[ip - base]) + ": " + message;
+        return false;
+    };
+    auto input = [&](double& value) {
+        std::fprintf(out, "Enter value for %s: ", program.symbolNames[ip->a].c_str());
+        std::fflush(out);
+        return std::fscanf(in, "%lf", &value) == 1;
+    };
+
+#if defined(__GNUC__)
+#define CODEPIE_OPCODE_LABEL(name) &&op_##name,
+    static const void* const dispatch[] = {CODEPIE_OPCODES(CODEPIE_OPCODE_LABEL)};
+#undef CODEPIE_OPCODE_LABEL
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto* dispatch[ip->op]
+    VM_NEXT();
+#else
+#define VM_CASE(name) case Bytecode::name:
+#define VM_NEXT() continue
+    for (;;) switch (ip->op) {
+#endif
+// Branches: to c when `cond` holds, else on.
+#define VM_BRANCH(cond)                        \
+    ip = (cond) ? base + ip->c : ip + 1; \
+    VM_NEXT();
+#define VM_INT_OP(name, expr)                                                                     \
+    VM_CASE(name) {                                                                               \
+        uint32_t x = static_cast<uint32_t>(r[ip->a].i), y = static_cast<uint32_t>(r[ip->b].i); \
+        r[ip->c].i = static_cast<int32_t>(expr);                                                  \
+        ++ip;                                                                                     \
+        VM_NEXT();                                                                                \
+    }
+#define VM_DOUBLE_OP(name, op)                     \
+    VM_CASE(name) {                                \
+        r[ip->c].d = r[ip->a].d op r[ip->b].d; \
+        ++ip;                                      \
+        VM_NEXT();                                 \
+    }
+#define VM_COMPARE(name, field, op)                          \
+    VM_CASE(name) {                                          \
+        r[ip->c].i = r[ip->a].field op r[ip->b].field ? 1 : 0; \
+        ++ip;                                                \
+        VM_NEXT();                                           \
+    }
+#define VM_COMPARE_BRANCH(name, field, op) \
+    VM_CASE(name) { VM_BRANCH(r[ip->a].field op r[ip->b].field) }
+#define VM_COMPARE_BRANCH_NOT(name, op) \
+    VM_CASE(name) { VM_BRANCH(!(r[ip->a].d op r[ip->b].d)) }
+
+    VM_CASE(HALT) {
+        std::fflush(out);
+        return true;
+    }
+    VM_CASE(MOV) {
+        r[ip->c] = r[ip->a];
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(I2D) {
+        r[ip->c].d = r[ip->a].i;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(D2I) {
+        r[ip->c].i = truncateToInt(r[ip->a].d);
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(CLEAR) {
+        r[ip->c].d = 0.0;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_INT_OP(ADD_I, x + y)
+    VM_INT_OP(SUB_I, x - y)
+    VM_INT_OP(MUL_I, x * y)
+    VM_CASE(DIV_I) {
+        int32_t x = r[ip->a].i, y = r[ip->b].i;
+        if (y == 0) return fail("Integer division by zero.");
+        if (x == INT_MIN && y == -1) return fail("Integer overflow in division.");
+        r[ip->c].i = x / y;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_DOUBLE_OP(ADD_D, +)
+    VM_DOUBLE_OP(SUB_D, -)
+    VM_DOUBLE_OP(MUL_D, *)
+    VM_DOUBLE_OP(DIV_D, /)
+    VM_CASE(ADD_MOV_I) {
+        r[ip->c].i = static_cast<int32_t>(static_cast<uint32_t>(r[ip->a].i) + static_cast<uint32_t>(r[ip->b].i));
+        r[ip->d].i = r[ip->c].i;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_COMPARE(LT_I, i, <)
+    VM_COMPARE(LE_I, i, <=)
+    VM_COMPARE(GT_I, i, >)
+    VM_COMPARE(GE_I, i, >=)
+    VM_COMPARE(EQ_I, i, ==)
+    VM_COMPARE(NE_I, i, !=)
+    VM_COMPARE(LT_D, d, <)
+    VM_COMPARE(LE_D, d, <=)
+    VM_COMPARE(GT_D, d, >)
+    VM_COMPARE(GE_D, d, >=)
+    VM_COMPARE(EQ_D, d, ==)
+    VM_COMPARE(NE_D, d, !=)
+    VM_CASE(JMP) {
+        ip = base + ip->c;
+        VM_NEXT();
+    }
+    VM_CASE(JZ_I) { VM_BRANCH(r[ip->a].i == 0) }
+    VM_CASE(JNZ_I) { VM_BRANCH(r[ip->a].i != 0) }
+    VM_CASE(JZ_D) { VM_BRANCH(r[ip->a].d == 0.0) }
+    VM_CASE(JNZ_D) { VM_BRANCH(r[ip->a].d != 0.0) }
+    VM_COMPARE_BRANCH(BLT_I, i, <)
+    VM_COMPARE_BRANCH(BLE_I, i, <=)
+    VM_COMPARE_BRANCH(BGT_I, i, >)
+    VM_COMPARE_BRANCH(BGE_I, i, >=)
+    VM_COMPARE_BRANCH(BEQ_I, i, ==)
+    VM_COMPARE_BRANCH(BNE_I, i, !=)
+    VM_COMPARE_BRANCH(BLT_D, d, <)
+    VM_COMPARE_BRANCH(BLE_D, d, <=)
+    VM_COMPARE_BRANCH(BGT_D, d, >)
+    VM_COMPARE_BRANCH(BGE_D, d, >=)
+    VM_COMPARE_BRANCH(BEQ_D, d, ==)
+    VM_COMPARE_BRANCH(BNE_D, d, !=)
+    VM_COMPARE_BRANCH_NOT(BNLT_D, <)
+    VM_COMPARE_BRANCH_NOT(BNLE_D, <=)
+    VM_COMPARE_BRANCH_NOT(BNGT_D, >)
+    VM_COMPARE_BRANCH_NOT(BNGE_D, >=)
+    VM_COMPARE_BRANCH_NOT(BNEQ_D, ==)
+    VM_COMPARE_BRANCH_NOT(BNNE_D, !=)
+    VM_CASE(IN_I) {
+        double value;
+        if (input(value)) r[ip->a].i = truncateToInt(value);
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(IN_D) {
+        double value;
+        if (input(value)) r[ip->a].d = value;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(IN_S) {
+        double value;
+        if (input(value)) r[ip->a].d = 0.0;
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(OUT_I) {
+        std::fprintf(out, "%d\n", r[ip->a].i);
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(OUT_D) {
+        std::fprintf(out, "%lf\n", r[ip->a].d);
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(OUT_S) {
+        std::fputs(texts[r[ip->a].s].c_str(), out);
+        std::fputc('\n', out);
+        ++ip;
+        VM_NEXT();
+    }
+    VM_CASE(OUT_FMT) {
+        std::fputs(formats[ip->a].c_str(), out);
+        ++ip;
+        VM_NEXT();
+    }
+#if !defined(__GNUC__)
+    }
+#endif
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BRANCH
+#undef VM_INT_OP
+#undef VM_DOUBLE_OP
+#undef VM_COMPARE
+#undef VM_COMPARE_BRANCH
+#undef VM_COMPARE_BRANCH_NOT
+}
@@ -1,33 +1,39 @@
 #include "Lexer.h"
-#include <cctype>
-#include <unordered_map>
-
-static const std::unordered_map<std::string, TokenType> keywords = {
-    {"let", TokenType::LET},
-    {"be", TokenType::BE},
-    {"input", TokenType::INPUT},
-    {"output", TokenType::OUTPUT},
-    {"add", TokenType::ADD},
-    {"subtract", TokenType::SUBTRACT},
-    {"multiply", TokenType::MULTIPLY},
-    {"divide", TokenType::DIVIDE},
-    {"store", TokenType::STORE},
-    {"in", TokenType::IN},
-    {"and", TokenType::AND},
-    {"if", TokenType::IF},
-    {"else", TokenType::ELSE},
-    {"otherwise", TokenType::OTHERWISE},
-    {"then", TokenType::THEN},
-    {"repeat", TokenType::REPEAT},
-    {"from", TokenType::FROM},
-    {"to", TokenType::TO},
-    {"jump", TokenType::JUMP},
-    {"until", TokenType::UNTIL}
-};
-
-Lexer::Lexer(const std::string& src)
+#include "ScanKernels.h"
+
+static_assert(lookupKeyword("let") == TokenType::LET &&
+              lookupKeyword("be") == TokenType::BE &&
+              lookupKeyword("input") == TokenType::INPUT &&
+              lookupKeyword("output") == TokenType::OUTPUT &&
+              lookupKeyword("add") == TokenType::ADD &&
+              lookupKeyword("subtract") == TokenType::SUBTRACT &&
+              lookupKeyword("multiply") == TokenType::MULTIPLY &&
+              lookupKeyword("divide") == TokenType::DIVIDE &&
+              lookupKeyword("store") == TokenType::STORE &&
+              lookupKeyword("in") == TokenType::IN &&
+              lookupKeyword("and") == TokenType::AND &&
+              lookupKeyword("if") == TokenType::IF &&
+              lookupKeyword("else") == TokenType::ELSE &&
+              lookupKeyword("otherwise") == TokenType::OTHERWISE &&
+              lookupKeyword("then") == TokenType::THEN &&
+              lookupKeyword("repeat") == TokenType::REPEAT &&
+              lookupKeyword("from") == TokenType::FROM &&
+              lookupKeyword("to") == TokenType::TO &&
+              lookupKeyword("jump") == TokenType::JUMP &&
+              lookupKeyword("until") == TokenType::UNTIL,
+              "keyword table out of sync");
+static_assert(lookupKeyword("lets") == TokenType::IDENTIFIER &&
+              lookupKeyword("i") == TokenType::IDENTIFIER &&
+              lookupKeyword("Let") == TokenType::IDENTIFIER &&
+              lookupKeyword("it") == TokenType::IDENTIFIER,
+              "identifiers must not classify as keywords");
+
+Lexer::Lexer(std::string_view src)
     : source(src), pos(0), line(1), column(1) {}
 
+Lexer::Lexer(std::string_view src, LexPosition start)
+    : source(src), pos(start.offset), line(start.line), column(start.column) {}
+
 char Lexer::peek() const {
     if (pos >= source.length()) return '\0';
     return source[pos];
@@ -45,41 +51,54 @@ char Lexer::get() {
     return c;
 }
 
+void Lexer::advance(size_t count) {
+    const char* begin = source.data() + pos;
+    const char* lastNewline = nullptr;
+    size_t newlines = countNewlines(begin, begin + count, &lastNewline);
+    pos += count;
+    if (newlines) {
+        line += static_cast<int>(newlines);
+        column = static_cast<int>(source.data() + pos - lastNewline);
+    } else {
+        column += static_cast<int>(count);
+    }
+}
+
 void Lexer::skipWhitespace() {
-    while (std::isspace(peek())) get();
+    const char* end = source.data() + source.size();
+    advance(scanWhitespace(source.data() + pos, end));
 }
 
 Token Lexer::identifierOrKeyword() {
     int startCol = column;
-    std::string lexeme;
-    while (std::isalnum(peek()) || peek() == '_') {
-        lexeme += get();
-    }
-    auto it = keywords.find(lexeme);
-    if (it != keywords.end()) {
-        return Token(it->second, lexeme, line, startCol);
-    }
-    return Token(TokenType::IDENTIFIER, lexeme, line, startCol);
+    size_t start = pos;
+    size_t length = scanIdentifier(source.data() + pos, source.data() + source.size());
+    pos += length;
+    column += static_cast<int>(length);
+    std::string_view lexeme = source.substr(start, pos - start);
+    return Token(lookupKeyword(lexeme), lexeme, line, startCol);
 }
 
 Token Lexer::number() {
     int startCol = column;
-    std::string lexeme;
-    bool hasDot = false;
-    while (std::isdigit(peek()) || (!hasDot && peek() == '.')) {
-        if (peek() == '.') hasDot = true;
-        lexeme += get();
+    size_t start = pos;
+    const char* end = source.data() + source.size();
+    size_t length = scanDigits(source.data() + pos, end);
+    if (pos + length < source.size() && source[pos + length] == '.') {
+        ++length;
+        length += scanDigits(source.data() + pos + length, end);
     }
-    return Token(TokenType::NUMBER, lexeme, line, startCol);
+    pos += length;
+    column += static_cast<int>(length);
+    return Token(TokenType::NUMBER, source.substr(start, pos - start), line, startCol);
 }
 
 Token Lexer::stringLiteral() {
     int startCol = column;
-    std::string lexeme;
     get(); 
-    while (peek() != '"' && peek() != '\0') {
-        lexeme += get();
-    }
+    size_t start = pos;
+    advance(scanStringBody(source.data() + pos, source.data() + source.size()));
+    std::string_view lexeme = source.substr(start, pos - start);
     if (peek() == '"') get(); 
     else return Token(TokenType::INVALID, lexeme, line, startCol); 
     return Token(TokenType::STRING, lexeme, line, startCol);
@@ -87,12 +106,13 @@ Token Lexer::stringLiteral() {
 
 Token Lexer::relOp() {
     int startCol = column;
+    size_t start = pos;
     char c = get();
-    std::string lexeme(1, c);
+    std::string_view lexeme = source.substr(start, 1);
 
     if (peek() == '=' && (c == '<' || c == '>' || c == '=' || c == '!')) {
-        lexeme += get();
-        return Token(TokenType::REL_OP, lexeme, line, startCol);
+        get();
+        return Token(TokenType::REL_OP, source.substr(start, 2), line, startCol);
     }
     else if (c == '<' || c == '>') {
         return Token(TokenType::REL_OP, lexeme, line, startCol);
@@ -100,52 +120,59 @@ Token Lexer::relOp() {
     return Token(TokenType::INVALID, lexeme, line, startCol);
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
-    while (true) {
-        skipWhitespace();
+Token Lexer::next() {
+    skipWhitespace();
 
-        char c = peek();
-        if (c == '\0') {
-            tokens.emplace_back(TokenType::END_OF_FILE, "", line, column);
-            break;
-        }
+    char c = peek();
+    if (c == '\0') {
+        return Token(TokenType::END_OF_FILE, "", line, column);
+    }
 
-        if (std::isalpha(c) || c == '_') {
-            tokens.push_back(identifierOrKeyword());
-        }
-        else if (std::isdigit(c)) {
-            tokens.push_back(number());
-        }
-        else if (c == '"') {
-            tokens.push_back(stringLiteral());
-        }
-        else if (c == '=')
+    if (isIdentStart(c)) {
+        return identifierOrKeyword();
+    }
+    else if (isDigit(c)) {
+        return number();
+    }
+    else if (c == '"') {
+        return stringLiteral();
+    }
+    else if (c == '=')
+    {
+        get();
+        if (peek() == '=')
         {
             get();
-            if (peek() == '=')
-            {
-                get();
-                tokens.push_back(Token(TokenType::REL_OP, "==", line, column));
-            }
-            else
-            {
-                tokens.push_back(Token(TokenType::ASSIGN, "=", line, column));
-            }
-            }
-            else if (c == '<' || c == '>' || c == '!')
-            {
-                tokens.push_back(relOp());
-            }
-
-        else if (c == '\n') {
-            get();
-            tokens.emplace_back(TokenType::END_OF_LINE, "\\n", line - 1, 1);
-        }
-        else {
-            get(); 
-            tokens.emplace_back(TokenType::INVALID, std::string(1, c), line, column);
+            return Token(TokenType::REL_OP, source.substr(pos - 2, 2), line, column);
         }
+        return Token(TokenType::ASSIGN, source.substr(pos - 1, 1), line, column);
+    }
+    else if (c == '<' || c == '>' || c == '!')
+    {
+        return relOp();
+    }
+    else if (c == '\n') {
+        get();
+        return Token(TokenType::END_OF_LINE, "\\n", line - 1, 1);
+    }
+
+    get(); 
+    return Token(TokenType::INVALID, source.substr(pos - 1, 1), line, column);
+}
+
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    while (true) {
+        tokens.push_back(next());
+        if (tokens.back().type == TokenType::END_OF_FILE) break;
     }
     return tokens;
 }
+
+size_t Lexer::offset() const {
+    return pos;
+}
+
+LexPosition Lexer::position() const {
+    return LexPosition{pos, line, column};
+}
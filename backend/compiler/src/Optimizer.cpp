@@ -1,86 +1,1239 @@
 #include "Optimizer.h"
-#include <sstream>
+#include "ControlFlowGraph.h"
+#include "SSA.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
 #include <unordered_map>
 
-Optimizer::Optimizer() {}
+Optimizer::Optimizer() : wholeProgram(true) {}
 
-void Optimizer::optimize(const std::vector<IRInstruction>& inputIR) {
-    optimizedIR = inputIR;
-    constantFolding();
-    removeRedundantAssignments();
+void Optimizer::optimize(IRProgram inputIR) {
+    optimizedIR = std::move(inputIR);
+    wholeProgram = true;
+    runPasses(optimizedIR);
 }
 
-const std::vector<IRInstruction>& Optimizer::getOptimizedIR() const {
+void Optimizer::optimizeFragment(IRProgram& fragment) {
+    wholeProgram = false;
+    runPasses(fragment);
+}
+
+void Optimizer::setPassObserver(PassObserver passObserver) {
+    observer = std::move(passObserver);
+}
+
+void Optimizer::runPasses(IRProgram& ir) {
+    struct Pass {
+        const char* name;
+        void (Optimizer::*run)(IRProgram&);
+    };
+    static const Pass passes[] = {
+        {"constant_propagation", &Optimizer::propagateConstants},
+        {"loop_optimization", &Optimizer::optimizeLoops},
+        {"value_numbering", &Optimizer::numberValues},
+        {"jump_threading", &Optimizer::threadJumps},
+        {"remove_redundant_assignments", &Optimizer::removeRedundantAssignments},
+        {"dead_code_elimination", &Optimizer::eliminateDeadCode},
+    };
+    // Types are fixed from the code as lowered; the passes keep them.
+    ir.inferTypes();
+    for (const Pass& pass : passes) {
+        if (observer) observer({pass.name, false, ir.code.size()});
+        (this->*pass.run)(ir);
+        if (observer) observer({pass.name, true, ir.code.size()});
+    }
+}
+
+const IRProgram& Optimizer::getOptimizedIR() const {
     return optimizedIR;
 }
 
-bool Optimizer::isNumber(const std::string& s) const {
-    if (s.empty()) return false;
-    std::istringstream iss(s);
-    double d;
-    iss >> d;
-    return iss.eof() && !iss.fail();
-}
-
-void Optimizer::constantFolding() {
-    for (auto& instr : optimizedIR) {
-        if ((instr.opcode == "ADD" || instr.opcode == "SUB" ||
-             instr.opcode == "MUL" || instr.opcode == "DIV") &&
-            instr.operands.size() == 3) {
-            
-            if (isNumber(instr.operands[0]) && isNumber(instr.operands[1])) {
-                double left = std::stod(instr.operands[0]);
-                double right = std::stod(instr.operands[1]);
-                double result = 0.0;
-                if (instr.opcode == "ADD") result = left + right;
-                else if (instr.opcode == "SUB") result = left - right;
-                else if (instr.opcode == "MUL") result = left * right;
-                else if (instr.opcode == "DIV") result = (right != 0.0) ? left / right : 0.0;
-                instr.opcode = "ASSIGN";
-                instr.operands = { std::to_string(result), instr.operands[2] };
-            }
-        }
-        
-        if ((instr.opcode == "LT" || instr.opcode == "LE" || 
-             instr.opcode == "GT" || instr.opcode == "GE" ||
-             instr.opcode == "EQ" || instr.opcode == "NE") &&
-            instr.operands.size() == 3) {
-            
-            if (isNumber(instr.operands[0]) && isNumber(instr.operands[1])) {
-                double left = std::stod(instr.operands[0]);
-                double right = std::stod(instr.operands[1]);
-                bool result = false;
-                
-                if (instr.opcode == "LT") result = (left < right);
-                else if (instr.opcode == "LE") result = (left <= right);
-                else if (instr.opcode == "GT") result = (left > right);
-                else if (instr.opcode == "GE") result = (left >= right);
-                else if (instr.opcode == "EQ") result = (left == right);
-                else if (instr.opcode == "NE") result = (left != right);
-                
-                instr.opcode = "ASSIGN";
-                instr.operands = { std::to_string(result ? 1 : 0), instr.operands[2] };
-            }
-        }
-    }
-}
-
-void Optimizer::removeRedundantAssignments() {
-    std::vector<IRInstruction> filtered;
-    for (const auto& instr : optimizedIR) {
-        bool isRedundant = (instr.opcode == "ASSIGN" && 
-                            instr.operands.size() == 2 &&
-                            instr.operands[0] == instr.operands[1]);
-        
-        if (!isRedundant && !filtered.empty() &&
-            instr.opcode == "ASSIGN" &&
-            filtered.back().opcode == "ASSIGN" &&
-            filtered.back().operands.size() == 2 &&
-            filtered.back().operands[0] == instr.operands[0]) {
-            isRedundant = true;
-        }
-        
-        if (!isRedundant) filtered.push_back(instr);
-    }
-    optimizedIR = std::move(filtered);
+IRProgram Optimizer::takeOptimizedIR() {
+    return std::move(optimizedIR);
+}
+
+// Constants are evaluated the way the emitted C computes them: int and
+// double values, int arithmetic when neither side is a double, and a
+// conversion to the destination's type on every store. Anything C leaves
+// undefined (int overflow or division by zero, out of range conversions)
+// or that has no literal spelling (infinities, NaN) is never folded.
+enum class LatticeState : uint8_t { UNKNOWN, CONSTANT, VARYING };
+
+struct LatticeValue {
+    LatticeState state = LatticeState::UNKNOWN;
+    double number = 0.0;
+    // INT or DOUBLE for constants.
+    CType type = CType::NONE;
+};
+
+static LatticeValue varying() {
+    LatticeValue v;
+    v.state = LatticeState::VARYING;
+    return v;
+}
+
+static LatticeValue constant(double number, CType type) {
+    LatticeValue v;
+    v.state = LatticeState::CONSTANT;
+    v.number = number;
+    v.type = type;
+    return v;
+}
+
+static bool sameConstant(const LatticeValue& a, const LatticeValue& b) {
+    return a.type == b.type && a.number == b.number && std::signbit(a.number) == std::signbit(b.number);
+}
+
+static void meet(LatticeValue& into, const LatticeValue& from) {
+    if (from.state == LatticeState::UNKNOWN || into.state == LatticeState::VARYING) return;
+    if (into.state == LatticeState::UNKNOWN) into = from;
+    else if (from.state == LatticeState::VARYING || !sameConstant(into, from)) into = varying();
+}
+
+// The value C stores when `value` is assigned to a variable of `type`.
+static LatticeValue convertTo(const LatticeValue& value, CType type) {
+    if (value.state != LatticeState::CONSTANT) return value;
+    if (type == CType::DOUBLE) return constant(value.number, CType::DOUBLE);
+    if (type != CType::INT) return varying();
+    if (!(value.number > INT_MIN - 1.0 && value.number < INT_MAX + 1.0)) return varying();
+    return constant(static_cast<double>(static_cast<int>(value.number)), CType::INT);
+}
+
+static LatticeValue literalValue(const IRProgram& ir, const Operand& op) {
+    if (op.kind != OperandKind::NUMBER) return varying();
+    const std::string& spelling = ir.numbers[op.id];
+    double number = ir.numberValues[op.id];
+    bool integer = spelling.find_first_not_of("0123456789") == std::string::npos;
+    if (!integer) return std::isfinite(number) ? constant(number, CType::DOUBLE) : varying();
+    // Leading zeros make an octal literal in C; big ones are not ints.
+    if ((spelling.size() > 1 && spelling[0] == '0') || number > INT_MAX) return varying();
+    return constant(number, CType::INT);
+}
+
+static LatticeValue arithmetic(IROpcode op, const LatticeValue& a, const LatticeValue& b) {
+    if (a.type == CType::INT && b.type == CType::INT) {
+        long long x = static_cast<long long>(a.number), y = static_cast<long long>(b.number), r = 0;
+        switch (op) {
+            case IROpcode::ADD: r = x + y; break;
+            case IROpcode::SUB: r = x - y; break;
+            case IROpcode::MUL: r = x * y; break;
+            default:
+                if (y == 0) return varying();
+                r = x / y;
+                break;
+        }
+        if (r < INT_MIN || r > INT_MAX) return varying();
+        return constant(static_cast<double>(r), CType::INT);
+    }
+    double r = 0.0;
+    switch (op) {
+        case IROpcode::ADD: r = a.number + b.number; break;
+        case IROpcode::SUB: r = a.number - b.number; break;
+        case IROpcode::MUL: r = a.number * b.number; break;
+        default: r = a.number / b.number; break;
+    }
+    return std::isfinite(r) ? constant(r, CType::DOUBLE) : varying();
+}
+
+static bool compare(IROpcode op, double a, double b) {
+    switch (op) {
+        case IROpcode::LT: return a < b;
+        case IROpcode::LE: return a <= b;
+        case IROpcode::GT: return a > b;
+        case IROpcode::GE: return a >= b;
+        case IROpcode::EQ: return a == b;
+        default: return a != b;
+    }
+}
+
+// A literal C reads back as exactly this value and type.
+static Operand numberLiteral(IRProgram& ir, const LatticeValue& value) {
+    char buffer[40];
+    if (value.type == CType::INT) {
+        std::snprintf(buffer, sizeof(buffer), "%d", static_cast<int>(value.number));
+        return ir.internNumber(buffer);
+    }
+    for (int precision = 1; precision <= 17; ++precision) {
+        std::snprintf(buffer, sizeof(buffer), "%.*g", precision, value.number);
+        if (std::strtod(buffer, nullptr) == value.number) break;
+    }
+    std::string spelling = buffer;
+    if (spelling.find_first_of(".e") == std::string::npos) spelling += ".0";
+    return ir.internNumber(spelling);
+}
+
+// Sparse conditional constant propagation (Wegman and Zadeck) over the SSA
+// form: values start unknown and only ever move down to a constant and then
+// to varying, and a block is only looked at once an executable edge reaches
+// it, so constants flow through branches that a constant condition decides.
+class ConstantPropagation {
+public:
+    ConstantPropagation(const IRProgram& program, const ControlFlowGraph& graph, const SSAForm& form,
+                        bool wholeProgram)
+        : ir(program), cfg(graph), ssa(form), lattice(form.valueCount()),
+          blockExecutable(graph.blockCount(), 0), blockOf(program.code.size(), kNoBlock) {
+        predBase.assign(cfg.blockCount() + 1, 0);
+        for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+            predBase[b + 1] = predBase[b] + static_cast<uint32_t>(cfg.preds(b).size());
+            for (size_t i = cfg.block(b).begin; i < cfg.block(b).end; ++i) blockOf[i] = b;
+        }
+        edgeExecutable.assign(predBase.back(), 0);
+
+        // C initializes every variable to 0; a fragment's symbols were set
+        // by statements before it.
+        for (uint32_t var = 0; var < ssa.variableCount(); ++var) {
+            Operand op = ssa.variableOperand(var);
+            CType type = ir.typeOf(op);
+            bool known = (type == CType::INT || type == CType::DOUBLE) &&
+                         (wholeProgram || op.kind == OperandKind::TEMP);
+            lattice[var] = known ? constant(0.0, type) : varying();
+        }
+    }
+
+    void run() {
+        if (cfg.blockCount() == 0) return;
+        blockExecutable[0] = 1;
+        visitBlock(0);
+        while (!edgeWork.empty() || !valueWork.empty()) {
+            while (!edgeWork.empty()) {
+                auto edge = edgeWork.back();
+                edgeWork.pop_back();
+                reachEdge(edge.first, edge.second);
+            }
+            while (!valueWork.empty()) {
+                uint32_t v = valueWork.back();
+                valueWork.pop_back();
+                for (uint32_t user : ssa.users(v)) {
+                    if (user & SSAForm::kPhiUser) {
+                        const SSAForm::Phi& phi = ssa.phis()[user & ~SSAForm::kPhiUser];
+                        if (blockExecutable[phi.block]) visitPhi(phi);
+                    } else if (blockExecutable[blockOf[user]]) {
+                        visitInstruction(user);
+                    }
+                }
+            }
+        }
+    }
+
+    bool executable(uint32_t block) const { return blockExecutable[block] != 0; }
+    const LatticeValue& valueOf(uint32_t v) const { return lattice[v]; }
+
+    LatticeValue operandValue(size_t instr, size_t k) const {
+        const Operand& op = ir.code[instr].operands[k];
+        if (!op.isVariable()) return literalValue(ir, op);
+        uint32_t v = ssa.useValue(instr, k);
+        return v == kNoValue ? varying() : lattice[v];
+    }
+
+private:
+    const IRProgram& ir;
+    const ControlFlowGraph& cfg;
+    const SSAForm& ssa;
+    std::vector<LatticeValue> lattice;
+    std::vector<char> blockExecutable;
+    std::vector<uint32_t> blockOf;
+    // Edge p -> b, the k-th of cfg.preds(b), is edgeExecutable[predBase[b] + k].
+    std::vector<uint32_t> predBase;
+    std::vector<char> edgeExecutable;
+    std::vector<std::pair<uint32_t, uint32_t>> edgeWork;
+    std::vector<uint32_t> valueWork;
+
+    void update(uint32_t v, LatticeValue value) {
+        LatticeValue& slot = lattice[v];
+        meet(value, slot);
+        if (value.state == slot.state && (value.state != LatticeState::CONSTANT || sameConstant(value, slot))) return;
+        slot = value;
+        valueWork.push_back(v);
+    }
+
+    void reachEdge(uint32_t from, uint32_t to) {
+        BlockList preds = cfg.preds(to);
+        size_t k = 0;
+        while (preds[k] != from) ++k;
+        char& flag = edgeExecutable[predBase[to] + k];
+        if (flag) return;
+        flag = 1;
+        if (!blockExecutable[to]) {
+            blockExecutable[to] = 1;
+            visitBlock(to);
+            return;
+        }
+        for (uint32_t p = ssa.phiStart(to); p < ssa.phiStart(to + 1); ++p) visitPhi(ssa.phis()[p]);
+    }
+
+    void visitBlock(uint32_t b) {
+        for (uint32_t p = ssa.phiStart(b); p < ssa.phiStart(b + 1); ++p) visitPhi(ssa.phis()[p]);
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) visitInstruction(i);
+        IROpcode last = ir.code[block.end - 1].opcode;
+        if (last != IROpcode::JMP && last != IROpcode::JZ && last != IROpcode::JNZ) {
+            for (uint32_t s : cfg.succs(b)) edgeWork.emplace_back(b, s);
+        }
+    }
+
+    void visitPhi(const SSAForm::Phi& phi) {
+        LatticeValue merged;
+        BlockList preds = cfg.preds(phi.block);
+        for (uint32_t k = 0; k < phi.argCount; ++k) {
+            // The entry block's extra argument comes in from outside.
+            bool live = k >= preds.size() || edgeExecutable[predBase[phi.block] + k];
+            if (live) meet(merged, lattice[ssa.phiArg(phi, k)]);
+        }
+        update(phi.value, merged);
+    }
+
+    void visitInstruction(size_t i) {
+        const IRInstruction& instr = ir.code[i];
+        uint32_t b = blockOf[i];
+        switch (instr.opcode) {
+            case IROpcode::JMP:
+                edgeWork.emplace_back(b, cfg.blockOfLabel(instr.operands[0]));
+                return;
+            case IROpcode::JZ:
+            case IROpcode::JNZ: {
+                LatticeValue cond = operandValue(i, 0);
+                if (cond.state == LatticeState::UNKNOWN) return;
+                uint32_t target = cfg.blockOfLabel(instr.operands[1]);
+                uint32_t next = b + 1 < cfg.blockCount() ? b + 1 : kNoBlock;
+                bool jumps = (cond.number == 0.0) == (instr.opcode == IROpcode::JZ);
+                if (cond.state == LatticeState::VARYING || jumps) {
+                    if (target != kNoBlock) edgeWork.emplace_back(b, target);
+                }
+                if (cond.state == LatticeState::VARYING || !jumps) {
+                    if (next != kNoBlock) edgeWork.emplace_back(b, next);
+                }
+                return;
+            }
+            default:
+                break;
+        }
+
+        uint32_t v = ssa.defValue(i);
+        if (v == kNoValue) return;
+        CType type = ir.typeOf(instr.operands[instr.definedOperand()]);
+        LatticeValue result = varying();
+        if (instr.opcode == IROpcode::ASSIGN) {
+            result = operandValue(i, 0);
+        } else if (isArithmeticOpcode(instr.opcode) || isRelationalOpcode(instr.opcode)) {
+            LatticeValue a = operandValue(i, 0), b = operandValue(i, 1);
+            if (a.state == LatticeState::VARYING || b.state == LatticeState::VARYING) {
+                result = varying();
+            } else if (a.state == LatticeState::UNKNOWN || b.state == LatticeState::UNKNOWN) {
+                result = LatticeValue();
+            } else if (isArithmeticOpcode(instr.opcode)) {
+                result = arithmetic(instr.opcode, a, b);
+            } else {
+                result = constant(compare(instr.opcode, a.number, b.number) ? 1.0 : 0.0, CType::INT);
+            }
+        }
+        update(v, convertTo(result, type));
+    }
+};
+
+// A division by a constant zero is left reading its variables: C leaves
+// it undefined, and a literal 0 / 0 traps where x / x often does not.
+static bool dividesByZero(const ConstantPropagation& sccp, size_t instr) {
+    LatticeValue divisor = sccp.operandValue(instr, 1);
+    return divisor.state == LatticeState::CONSTANT && divisor.number == 0.0;
+}
+
+// Folds whatever SCCP proves constant: definitions become stores of the
+// constant, reads in arithmetic, comparisons and copies read the literal,
+// decided branches become a JMP or go away, and blocks no executable edge
+// reaches are deleted. OUTPUT keeps its variable, since C prints a literal
+// differently.
+void Optimizer::propagateConstants(IRProgram& ir) {
+    ControlFlowGraph cfg(ir);
+    SSAForm ssa(ir, cfg);
+    ConstantPropagation sccp(ir, cfg, ssa, wholeProgram);
+    sccp.run();
+
+    auto& code = ir.code;
+    size_t kept = 0;
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        if (!sccp.executable(b)) continue;
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) {
+            IRInstruction instr = code[i];
+            if (instr.opcode == IROpcode::JZ || instr.opcode == IROpcode::JNZ) {
+                LatticeValue cond = sccp.operandValue(i, 0);
+                if (cond.state == LatticeState::CONSTANT) {
+                    if ((cond.number == 0.0) != (instr.opcode == IROpcode::JZ)) continue;
+                    instr = IRInstruction(IROpcode::JMP, instr.operands[1], instr.line);
+                }
+            } else if (instr.opcode == IROpcode::ASSIGN || isArithmeticOpcode(instr.opcode) ||
+                       isRelationalOpcode(instr.opcode)) {
+                uint32_t v = ssa.defValue(i);
+                Operand dest = instr.operands[instr.definedOperand()];
+                bool storesLiteral = instr.opcode == IROpcode::ASSIGN && instr.operands[0].isLiteral();
+                if (v != kNoValue && !storesLiteral && sccp.valueOf(v).state == LatticeState::CONSTANT) {
+                    instr = IRInstruction(IROpcode::ASSIGN, numberLiteral(ir, sccp.valueOf(v)), dest, instr.line);
+                } else if (instr.opcode != IROpcode::DIV || !dividesByZero(sccp, i)) {
+                    for (size_t k = 0; k < 2; ++k) {
+                        if (static_cast<int>(k) == instr.definedOperand() || !instr.operands[k].isVariable()) continue;
+                        LatticeValue value = sccp.operandValue(i, k);
+                        if (value.state == LatticeState::CONSTANT) instr.operands[k] = numberLiteral(ir, value);
+                    }
+                }
+            }
+            code[kept++] = instr;
+        }
+    }
+    code.erase(code.begin() + kept, code.end());
+}
+
+// What a literal is in a C expression, or NONE if no variable stores it
+// unchanged (octal spellings, integers past int).
+static CType literalType(const IRProgram& ir, const Operand& op) {
+    if (op.kind == OperandKind::STRING) return CType::STRING;
+    const std::string& spelling = ir.numbers[op.id];
+    if (spelling.find_first_not_of("0123456789") != std::string::npos) return CType::DOUBLE;
+    if ((spelling.size() > 1 && spelling[0] == '0') || ir.numberValues[op.id] > INT_MAX) return CType::NONE;
+    return CType::INT;
+}
+
+// An expression by the value numbers of its operands and the type of the
+// variable it is stored in, which decides the stored value.
+struct ExpressionKey {
+    IROpcode opcode;
+    CType type;
+    uint32_t lhs;
+    uint32_t rhs;
+
+    bool operator==(const ExpressionKey& other) const {
+        return opcode == other.opcode && type == other.type && lhs == other.lhs && rhs == other.rhs;
+    }
+};
+
+struct ExpressionKeyHash {
+    size_t operator()(const ExpressionKey& key) const {
+        uint64_t h = (static_cast<uint64_t>(key.lhs) << 32 | key.rhs) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h ^ (h >> 29) ^ (static_cast<uint64_t>(key.opcode) << 8 | static_cast<uint64_t>(key.type)));
+    }
+};
+
+// Dominator-based value numbering (Briggs, Cooper and Simpson) over the SSA
+// form. Walking the dominator tree, every value gets a number such that
+// equal numbers hold equal values: a copy takes its source's number, and an
+// expression the number of an equal expression in a dominating block (or
+// earlier in the same one, which is the local case). Uses are then
+// rewritten to the variable that holds the number at that point, so copies
+// and recomputations go dead.
+//
+// Numbers are SSA value ids, or literalBase plus a literal's index for
+// values that equal a literal. Equal numbers imply equal C types, so a
+// replacement never changes how an expression is computed or printed.
+class ValueNumbering {
+public:
+    ValueNumbering(IRProgram& program, const ControlFlowGraph& graph, const SSAForm& form)
+        : ir(program), cfg(graph), ssa(form), literalBase(static_cast<uint32_t>(form.valueCount())),
+          number(form.valueCount(), kNoValue), holder(form.valueCount(), kNoValue),
+          current(form.variableCount()), stores(form.variableCount(), 0), removed(program.code.size(), 0) {
+        for (size_t i = 0; i < ir.code.size(); ++i) {
+            uint32_t v = ssa.defValue(i);
+            if (v != kNoValue && stores[ssa.value(v).variable] < 2) ++stores[ssa.value(v).variable];
+        }
+        for (uint32_t var = 0; var < current.size(); ++var) {
+            current[var] = var;
+            number[var] = var;
+            holder[var] = var;
+        }
+    }
+
+    void run() {
+        if (cfg.blockCount() == 0) return;
+        table.reserve(ir.code.size() / 4);
+        struct Frame {
+            uint32_t block;
+            uint32_t child;
+            size_t undoMark;
+        };
+        std::vector<Frame> stack;
+        stack.push_back({0, 0, undo.size()});
+        visitBlock(0);
+        while (!stack.empty()) {
+            Frame& top = stack.back();
+            BlockList children = cfg.dominatorChildren(top.block);
+            if (top.child < children.size()) {
+                uint32_t child = children[top.child++];
+                stack.push_back({child, 0, undo.size()});
+                visitBlock(child);
+                continue;
+            }
+            while (undo.size() > top.undoMark) {
+                const Undo& u = undo.back();
+                if (u.kind == Undo::CURRENT) current[u.slot] = u.previous;
+                else if (u.kind == Undo::HOLDER) holder[u.slot] = u.previous;
+                else table.erase(u.key);
+                undo.pop_back();
+            }
+            stack.pop_back();
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < ir.code.size(); ++i) {
+            if (!removed[i]) ir.code[kept++] = ir.code[i];
+        }
+        ir.code.erase(ir.code.begin() + kept, ir.code.end());
+    }
+
+private:
+    struct Undo {
+        enum Kind : uint8_t { CURRENT, HOLDER, TABLE } kind;
+        uint32_t slot;
+        uint32_t previous;
+        ExpressionKey key;
+    };
+
+    IRProgram& ir;
+    const ControlFlowGraph& cfg;
+    const SSAForm& ssa;
+    uint32_t literalBase;
+    std::vector<uint32_t> number;
+    // Value that represents each number where the walk is.
+    std::vector<uint32_t> holder;
+    // Value each variable holds where the walk is.
+    std::vector<uint32_t> current;
+    // Instructions storing each variable, counted up to 2.
+    std::vector<uint8_t> stores;
+    std::vector<char> removed;
+    std::unordered_map<ExpressionKey, uint32_t, ExpressionKeyHash> table;
+    std::vector<Undo> undo;
+    uint32_t blockBegin = 0;
+
+    void setCurrent(uint32_t var, uint32_t v) {
+        undo.push_back({Undo::CURRENT, var, current[var], {}});
+        current[var] = v;
+    }
+
+    void setHolder(uint32_t n, uint32_t v) {
+        undo.push_back({Undo::HOLDER, n, holder[n], {}});
+        holder[n] = v;
+    }
+
+    uint32_t literalNumber(const Operand& op) const {
+        uint32_t index = op.kind == OperandKind::NUMBER ? op.id : static_cast<uint32_t>(ir.numbers.size()) + op.id;
+        return literalBase + index;
+    }
+
+    Operand literalOperand(uint32_t n) const {
+        uint32_t index = n - literalBase;
+        if (index < ir.numbers.size()) return Operand(OperandKind::NUMBER, index);
+        return Operand(OperandKind::STRING, index - static_cast<uint32_t>(ir.numbers.size()));
+    }
+
+    uint32_t operandNumber(size_t i, size_t k) const {
+        const Operand& op = ir.code[i].operands[k];
+        if (op.isLiteral()) return literalNumber(op);
+        uint32_t v = ssa.useValue(i, k);
+        return v == kNoValue ? kNoValue : number[v];
+    }
+
+    // Whether `var` holds a value numbered n before instruction i. A
+    // variable without phis is only known after a store that dominates i
+    // and that no other store can follow: its only one, or an earlier one
+    // in this block.
+    bool holds(uint32_t var, uint32_t n, size_t i) const {
+        uint32_t v = current[var];
+        if (number[v] != n) return false;
+        if (ssa.isGlobal(var)) return true;
+        const SSAForm::Value& value = ssa.value(v);
+        if (value.kind != SSAForm::DefKind::INSTRUCTION) return false;
+        return stores[var] == 1 || (value.def >= blockBegin && value.def < i);
+    }
+
+    // A variable holding number n before instruction i, or kNoValue.
+    uint32_t holderVariable(uint32_t n, size_t i) const {
+        if (n >= literalBase || holder[n] == kNoValue) return kNoValue;
+        uint32_t var = ssa.value(holder[n]).variable;
+        return holds(var, n, i) ? var : kNoValue;
+    }
+
+    void visitBlock(uint32_t b) {
+        blockBegin = static_cast<uint32_t>(cfg.block(b).begin);
+        for (uint32_t p = ssa.phiStart(b); p < ssa.phiStart(b + 1); ++p) {
+            const SSAForm::Phi& phi = ssa.phis()[p];
+            // Arguments along back edges are not numbered yet.
+            uint32_t n = ssa.phiArg(phi, 0) == kNoValue ? kNoValue : number[ssa.phiArg(phi, 0)];
+            for (uint32_t k = 1; k < phi.argCount && n != kNoValue; ++k) {
+                uint32_t arg = ssa.phiArg(phi, k);
+                if (arg == kNoValue || number[arg] != n) n = kNoValue;
+            }
+            define(phi.value, phi.variable, n == kNoValue ? phi.value : n, blockBegin);
+        }
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) visitInstruction(i);
+    }
+
+    // Numbers value v of variable var, stored by instruction i. It becomes
+    // the number's holder unless one that is still valid exists, or it can
+    // stand in for one that is only known within its block.
+    void define(uint32_t v, uint32_t var, uint32_t n, size_t i) {
+        number[v] = n;
+        if (n < literalBase) {
+            uint32_t old = holderVariable(n, i);
+            if (old == kNoValue || (stores[old] > 1 && !ssa.isGlobal(old) && ssa.isGlobal(var))) setHolder(n, v);
+        }
+        setCurrent(var, v);
+    }
+
+    void visitInstruction(size_t i) {
+        IRInstruction& instr = ir.code[i];
+        int defined = instr.definedOperand();
+        uint32_t v = ssa.defValue(i);
+
+        ExpressionKey key{instr.opcode, CType::NONE, kNoValue, kNoValue};
+        if (v != kNoValue && instr.opcode != IROpcode::INPUT) {
+            key.type = ir.typeOf(instr.operands[defined]);
+            key.lhs = operandNumber(i, 0);
+            if (defined == 2) key.rhs = operandNumber(i, 1);
+        }
+
+        // Rewrite the reads first: equal numbers mean equal values. A
+        // division by zero keeps its operands, as in propagateConstants.
+        uint32_t divisor = instr.opcode == IROpcode::DIV ? operandNumber(i, 1) : kNoValue;
+        bool keepReads = divisor != kNoValue && divisor >= literalBase &&
+                         literalOperand(divisor).kind == OperandKind::NUMBER &&
+                         ir.numberValues[literalOperand(divisor).id] == 0.0;
+        for (size_t k = 0; k < instr.operandCount() && !keepReads; ++k) {
+            if (static_cast<int>(k) == defined || !instr.operands[k].isVariable()) continue;
+            uint32_t n = operandNumber(i, k);
+            if (n == kNoValue) continue;
+            // C prints a literal differently from a variable holding it.
+            if (n >= literalBase) {
+                if (instr.opcode != IROpcode::OUTPUT) instr.operands[k] = literalOperand(n);
+                continue;
+            }
+            uint32_t var = holderVariable(n, i);
+            if (var != kNoValue) instr.operands[k] = ssa.variableOperand(var);
+        }
+        if (v == kNoValue) return;
+        uint32_t var = ssa.value(v).variable;
+        if (instr.opcode == IROpcode::INPUT || key.type == CType::NONE || key.lhs == kNoValue ||
+            (defined == 2 && key.rhs == kNoValue)) {
+            define(v, var, v, i);
+            return;
+        }
+
+        uint32_t n = kNoValue;
+        if (instr.opcode == IROpcode::ASSIGN) {
+            const Operand& src = instr.operands[0];
+            CType srcType = src.isLiteral() ? literalType(ir, src) : ir.typeOf(src);
+            if (srcType == key.type) n = key.lhs;
+        } else {
+            if (instr.opcode == IROpcode::GT || instr.opcode == IROpcode::GE) {
+                key.opcode = instr.opcode == IROpcode::GT ? IROpcode::LT : IROpcode::LE;
+                std::swap(key.lhs, key.rhs);
+            }
+            bool commutes = key.opcode == IROpcode::ADD || key.opcode == IROpcode::MUL ||
+                            key.opcode == IROpcode::EQ || key.opcode == IROpcode::NE;
+            if (commutes && key.lhs > key.rhs) std::swap(key.lhs, key.rhs);
+        }
+        if (n == kNoValue) {
+            auto found = table.find(key);
+            if (found != table.end()) {
+                n = found->second;
+            } else {
+                table.emplace(key, v);
+                undo.push_back({Undo::TABLE, 0, 0, key});
+            }
+        }
+        if (n == kNoValue) {
+            define(v, var, v, i);
+            return;
+        }
+
+        // The variable already holds the value: the store does nothing.
+        if (holds(var, n, i)) {
+            number[v] = n;
+            removed[i] = 1;
+            return;
+        }
+        uint32_t source = holderVariable(n, i);
+        if (instr.opcode != IROpcode::ASSIGN && source != kNoValue) {
+            instr = IRInstruction(IROpcode::ASSIGN, ssa.variableOperand(source), instr.operands[defined], instr.line);
+        }
+        define(v, var, n, i);
+    }
+};
+
+void Optimizer::numberValues(IRProgram& ir) {
+    ControlFlowGraph cfg(ir);
+    SSAForm ssa(ir, cfg);
+    ValueNumbering(ir, cfg, ssa).run();
+}
+
+static CType operandType(const IRProgram& ir, const Operand& op) {
+    return op.isLiteral() ? literalType(ir, op) : ir.typeOf(op);
+}
+
+// The C type an arithmetic or relational instruction computes in, before
+// the result is converted to its destination's type.
+static CType expressionType(const IRProgram& ir, const IRInstruction& instr) {
+    if (isRelationalOpcode(instr.opcode)) return CType::INT;
+    bool isDouble = operandType(ir, instr.operands[0]) == CType::DOUBLE ||
+                    operandType(ir, instr.operands[1]) == CType::DOUBLE;
+    return isDouble ? CType::DOUBLE : CType::INT;
+}
+
+// Stores `OP a, b, t; ASSIGN t, x` straight into x when t is a temp nothing
+// else reads or writes, such as the increment temp of every repeat-from
+// loop. Not when t is an int catching a double that x would keep whole.
+static void coalesceResultTemps(IRProgram& ir) {
+    auto& code = ir.code;
+    std::vector<uint8_t> reads(ir.nameCounter - ir.firstName, 0), writes(reads.size(), 0);
+    auto count = [&](std::vector<uint8_t>& counts, const Operand& op) {
+        if (op.kind != OperandKind::TEMP || op.id < ir.firstName) return;
+        uint8_t& n = counts[op.id - ir.firstName];
+        if (n < 2) ++n;
+    };
+    for (const IRInstruction& instr : code) {
+        int defined = instr.definedOperand();
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            count(static_cast<int>(k) == defined ? writes : reads, instr.operands[k]);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        IRInstruction& instr = code[i];
+        code[kept++] = instr;
+        if (!isArithmeticOpcode(instr.opcode) && !isRelationalOpcode(instr.opcode)) continue;
+        if (i + 1 == code.size() || code[i + 1].opcode != IROpcode::ASSIGN) continue;
+        const Operand& temp = instr.operands[2];
+        const Operand& dest = code[i + 1].operands[1];
+        if (code[i + 1].operands[0] != temp || temp.kind != OperandKind::TEMP || temp.id < ir.firstName) continue;
+        if (reads[temp.id - ir.firstName] != 1 || writes[temp.id - ir.firstName] != 1) continue;
+        CType tempType = ir.typeOf(temp), destType = ir.typeOf(dest);
+        if (tempType != CType::INT && tempType != CType::DOUBLE) continue;
+        if (destType != CType::INT && destType != CType::DOUBLE) continue;
+        if (tempType == CType::INT && destType == CType::DOUBLE && expressionType(ir, instr) == CType::DOUBLE) continue;
+        code[kept - 1].operands[2] = dest;
+        ++i;
+    }
+    code.erase(code.begin() + kept, code.end());
+}
+
+// Loop optimizations on the natural loops of the CFG, for the loops
+// repeat-from lowers to and any other:
+//
+// - An arithmetic or comparison whose operands no instruction in the loop
+//   writes is computed once before the loop, into a new temp the loop
+//   copies from, hoisted out of as many enclosing loops as it is invariant
+//   in. The loop may never run it, so int arithmetic is only hoisted when
+//   it cannot overflow: ADD, SUB and MUL when the ranges of its operands
+//   bound the result to an int, DIV by a nonzero literal other than -1.
+// - A loop counter is a variable set to an int literal just before the
+//   loop, whose only store in it is `ADD i, step, i` with a positive int
+//   literal step, outside the header, and which the header's exit test
+//   keeps `i < bound` or `i <= bound` for a literal bound. Inside the loop
+//   it stays within [start, bound + step]; a literal is its own range.
+// - Int products `i * c` of the innermost loop's counter and an invariant c
+//   become a running value r = i * c, set before the loop and advanced by
+//   step * c right after each increment of i, when the ranges keep every
+//   value r takes an int.
+//
+// New code goes just above the loop header's LABEL, which runs on entry
+// only when the loop is entered by falling into its header from the one
+// block before it; loops entered any other way are left alone.
+void Optimizer::optimizeLoops(IRProgram& ir) {
+    coalesceResultTemps(ir);
+    ControlFlowGraph cfg(ir);
+    const std::vector<Loop>& loops = cfg.loops();
+    if (loops.empty()) return;
+    auto& code = ir.code;
+
+    // Stores per loop, as (variable slot, instruction) pairs sorted by slot.
+    std::vector<std::vector<std::pair<size_t, size_t>>> loopStores(loops.size());
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        if (cfg.loopOf(b) == kNoLoop) continue;
+        for (size_t i = cfg.block(b).begin; i < cfg.block(b).end; ++i) {
+            int defined = code[i].definedOperand();
+            if (defined < 0 || !code[i].operands[defined].isVariable()) continue;
+            size_t slot = ir.variableSlot(code[i].operands[defined]);
+            for (uint32_t l = cfg.loopOf(b); l != kNoLoop; l = loops[l].parent) loopStores[l].emplace_back(slot, i);
+        }
+    }
+    for (auto& stores : loopStores) std::sort(stores.begin(), stores.end());
+    auto storesIn = [&](uint32_t l, const Operand& op) {
+        auto range = std::equal_range(loopStores[l].begin(), loopStores[l].end(),
+                                      std::make_pair(ir.variableSlot(op), size_t(0)),
+                                      [](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+                                          return a.first < b.first;
+                                      });
+        return std::make_pair(range.first, range.second);
+    };
+    auto invariant = [&](uint32_t l, const Operand& op) {
+        if (op.isLiteral()) return true;
+        auto range = storesIn(l, op);
+        return range.first == range.second;
+    };
+
+    // Where each loop's entry code goes, or SIZE_MAX.
+    std::vector<size_t> entry(loops.size(), SIZE_MAX);
+    for (uint32_t l = 0; l < loops.size(); ++l) {
+        uint32_t h = loops[l].header;
+        const BasicBlock& header = cfg.block(h);
+        if (code[header.begin].opcode != IROpcode::LABEL) continue;
+        bool usable = true;
+        for (uint32_t p : cfg.preds(h)) {
+            if (std::binary_search(loops[l].blocks.begin(), loops[l].blocks.end(), p)) continue;
+            const IRInstruction& last = code[cfg.block(p).end - 1];
+            bool jumps = last.opcode == IROpcode::JMP || last.opcode == IROpcode::JZ || last.opcode == IROpcode::JNZ;
+            if (p + 1 != h || (jumps && cfg.blockOfLabel(last.opcode == IROpcode::JMP ? last.operands[0] : last.operands[1]) == h)) {
+                usable = false;
+            }
+        }
+        if (usable) entry[l] = header.begin;
+    }
+
+    // Each loop's counter, if it has one, and the range it stays in.
+    struct Counter {
+        Operand var;
+        double lo = 0, hi = 0;
+    };
+    std::vector<Counter> counters(loops.size());
+    auto intLiteral = [&](const Operand& op) { return op.kind == OperandKind::NUMBER && literalType(ir, op) == CType::INT; };
+    for (uint32_t l = 0; l < loops.size(); ++l) {
+        const BasicBlock& header = cfg.block(loops[l].header);
+        if (entry[l] == SIZE_MAX || entry[l] == 0 || header.end - header.begin < 3) continue;
+        const IRInstruction& exit = code[header.end - 1];
+        const IRInstruction& test = code[header.end - 2];
+        if (exit.opcode != IROpcode::JZ || test.operands[2] != exit.operands[0]) continue;
+        if (std::binary_search(loops[l].blocks.begin(), loops[l].blocks.end(), cfg.blockOfLabel(exit.operands[1]))) continue;
+        bool below = test.opcode == IROpcode::LT || test.opcode == IROpcode::LE;
+        bool above = test.opcode == IROpcode::GT || test.opcode == IROpcode::GE;
+        if (!(below || above)) continue;
+        const Operand& var = test.operands[below ? 0 : 1];
+        const Operand& bound = test.operands[below ? 1 : 0];
+        if (!var.isVariable() || ir.typeOf(var) != CType::INT || bound.kind != OperandKind::NUMBER) continue;
+        const IRInstruction& init = code[entry[l] - 1];
+        if (init.opcode != IROpcode::ASSIGN || init.operands[1] != var || !intLiteral(init.operands[0])) continue;
+        auto range = storesIn(l, var);
+        if (range.second - range.first != 1) continue;
+        size_t at = range.first->second;
+        const IRInstruction& step = code[at];
+        if (step.opcode != IROpcode::ADD || step.operands[2] != var) continue;
+        const Operand& stride = step.operands[0] == var ? step.operands[1] : step.operands[0];
+        if (!(step.operands[0] == var || step.operands[1] == var) || !intLiteral(stride) || ir.numberValues[stride.id] == 0) {
+            continue;
+        }
+        if (at >= header.begin && at < header.end) continue;
+        bool once = false;
+        for (uint32_t b : loops[l].blocks) once |= at >= cfg.block(b).begin && at < cfg.block(b).end && cfg.loopOf(b) == l;
+        if (!once) continue;
+        double start = ir.numberValues[init.operands[0].id];
+        counters[l] = {var, start, std::max(start, ir.numberValues[bound.id] + ir.numberValues[stride.id])};
+    }
+    // The range an int operand stays in anywhere in loop l and the loops
+    // around it, or false if it is not known there.
+    auto rangeIn = [&](uint32_t l, const Operand& op, double& lo, double& hi) {
+        if (op.kind == OperandKind::NUMBER) {
+            lo = hi = ir.numberValues[op.id];
+            return true;
+        }
+        for (; l != kNoLoop; l = loops[l].parent) {
+            if (counters[l].var.kind != OperandKind::NONE && counters[l].var == op) {
+                lo = counters[l].lo, hi = counters[l].hi;
+                return true;
+            }
+        }
+        return false;
+    };
+    // Whether `lhs op rhs` stays an int for any operand values in loop l.
+    auto fitsInt = [&](IROpcode op, uint32_t l, const Operand& lhs, const Operand& rhs) {
+        double a, b, c, d;
+        if (!rangeIn(l, lhs, a, b) || !rangeIn(l, rhs, c, d)) return false;
+        double lo, hi;
+        if (op == IROpcode::ADD) {
+            lo = a + c, hi = b + d;
+        } else if (op == IROpcode::SUB) {
+            lo = a - d, hi = b - c;
+        } else {
+            lo = std::min(std::min(a * c, a * d), std::min(b * c, b * d));
+            hi = std::max(std::max(a * c, a * d), std::max(b * c, b * d));
+        }
+        return lo >= INT_MIN && hi <= INT_MAX;
+    };
+
+    // Instructions to insert, each before the instruction at its index.
+    std::vector<std::pair<size_t, IRInstruction>> inserts;
+    for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+        uint32_t innermost = cfg.loopOf(b);
+        if (innermost == kNoLoop) continue;
+        for (size_t i = cfg.block(b).begin; i < cfg.block(b).end; ++i) {
+            IRInstruction& instr = code[i];
+            if (!isArithmeticOpcode(instr.opcode) && !isRelationalOpcode(instr.opcode)) continue;
+            const Operand& lhs = instr.operands[0];
+            const Operand& rhs = instr.operands[1];
+            const Operand dest = instr.operands[2];
+            CType destType = ir.typeOf(dest);
+            if (destType != CType::INT && destType != CType::DOUBLE) continue;
+
+            uint32_t target = kNoLoop;
+            for (uint32_t l = innermost; l != kNoLoop && invariant(l, lhs) && invariant(l, rhs); l = loops[l].parent) {
+                if (entry[l] != SIZE_MAX) target = l;
+            }
+            bool safe = true;
+            if (expressionType(ir, instr) == CType::INT && instr.opcode == IROpcode::DIV) {
+                safe = rhs.kind == OperandKind::NUMBER && ir.numberValues[rhs.id] != 0.0 && ir.numberValues[rhs.id] != -1.0;
+            } else if (expressionType(ir, instr) == CType::INT && isArithmeticOpcode(instr.opcode)) {
+                safe = target != kNoLoop && fitsInt(instr.opcode, loops[target].parent, lhs, rhs);
+            }
+            if (target != kNoLoop && safe && !(lhs.isLiteral() && rhs.isLiteral())) {
+                Operand temp = ir.newTemp(destType);
+                inserts.emplace_back(entry[target], IRInstruction(instr.opcode, lhs, rhs, temp, instr.line));
+                instr = IRInstruction(IROpcode::ASSIGN, temp, dest, instr.line);
+                continue;
+            }
+
+            // Strength reduction of i * c in the innermost loop.
+            const Counter& counter = counters[innermost];
+            if (instr.opcode != IROpcode::MUL || counter.var.kind == OperandKind::NONE) continue;
+            if (expressionType(ir, instr) != CType::INT) continue;
+            for (size_t k = 0; k < 2; ++k) {
+                const Operand& iv = instr.operands[k];
+                const Operand& factor = instr.operands[1 - k];
+                if (iv != counter.var || !invariant(innermost, factor) || operandType(ir, factor) != CType::INT) continue;
+                auto range = storesIn(innermost, iv);
+                const IRInstruction& step = code[range.first->second];
+                const Operand& stride = step.operands[0] == iv ? step.operands[1] : step.operands[0];
+                if (!fitsInt(IROpcode::MUL, innermost, iv, factor) || !fitsInt(IROpcode::MUL, innermost, stride, factor)) continue;
+
+                Operand running = ir.newTemp(CType::INT);
+                Operand delta;
+                if (factor.kind == OperandKind::NUMBER) {
+                    delta = ir.internNumber(std::to_string(static_cast<long long>(ir.numberValues[stride.id]) *
+                                                           static_cast<long long>(ir.numberValues[factor.id])));
+                } else {
+                    delta = ir.newTemp(CType::INT);
+                    inserts.emplace_back(entry[innermost], IRInstruction(IROpcode::MUL, stride, factor, delta, instr.line));
+                }
+                inserts.emplace_back(entry[innermost], IRInstruction(IROpcode::MUL, iv, factor, running, instr.line));
+                inserts.emplace_back(range.first->second + 1,
+                                     IRInstruction(IROpcode::ADD, running, delta, running, step.line));
+                instr = IRInstruction(IROpcode::ASSIGN, running, dest, instr.line);
+                break;
+            }
+        }
+    }
+    if (inserts.empty()) return;
+
+    // Inserts at one index keep the order they were made in.
+    std::vector<uint32_t> order(inserts.size());
+    for (uint32_t k = 0; k < order.size(); ++k) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return inserts[a].first != inserts[b].first ? inserts[a].first < inserts[b].first : a < b;
+    });
+    std::vector<IRInstruction> merged;
+    merged.reserve(code.size() + inserts.size());
+    size_t next = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        for (; next < order.size() && inserts[order[next]].first == i; ++next) merged.push_back(inserts[order[next]].second);
+        merged.push_back(code[i]);
+    }
+    code = std::move(merged);
+}
+
+// Drops self-copies, and copies that repeat the copy just before them in
+// the same basic block. Nothing is carried across a block boundary: a
+// label may be reached with other values.
+void Optimizer::removeRedundantAssignments(IRProgram& ir) {
+    ControlFlowGraph cfg(ir);
+    auto& code = ir.code;
+    size_t kept = 0;
+    for (const BasicBlock& block : cfg.blocks()) {
+        size_t blockStart = kept;
+        for (size_t i = block.begin; i < block.end; ++i) {
+            const IRInstruction& instr = code[i];
+            if (instr.opcode == IROpcode::ASSIGN) {
+                const Operand& src = instr.operands[0];
+                const Operand& dst = instr.operands[1];
+                if (src == dst) continue;
+                if (kept > blockStart) {
+                    const IRInstruction& prev = code[kept - 1];
+                    if (prev.opcode == IROpcode::ASSIGN && prev.operands[0] == src && prev.operands[1] == dst) continue;
+                }
+            }
+            code[kept++] = instr;
+        }
+    }
+    code.erase(code.begin() + kept, code.end());
+}
+
+// Global liveness over the SSA values: a value is live if an OUTPUT or a
+// branch reads it, or a live value is computed from it (through phis too).
+// A fragment's symbols are read by the fragments after it, so there every
+// store to a symbol counts as a read.
+static std::vector<char> liveValues(const IRProgram& ir, const ControlFlowGraph& cfg, const SSAForm& ssa,
+                                    bool wholeProgram) {
+    std::vector<char> live(ssa.valueCount(), 0);
+    std::vector<uint32_t> worklist;
+    auto mark = [&](uint32_t v) {
+        if (v == kNoValue || live[v]) return;
+        live[v] = 1;
+        worklist.push_back(v);
+    };
+    auto markUses = [&](size_t i) {
+        const IRInstruction& instr = ir.code[i];
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            if (static_cast<int>(k) != instr.definedOperand()) mark(ssa.useValue(i, k));
+        }
+    };
+
+    for (uint32_t b : cfg.reversePostOrder()) {
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) {
+            int defined = ir.code[i].definedOperand();
+            if (defined < 0) markUses(i);
+            else if (!wholeProgram && ir.code[i].operands[defined].kind == OperandKind::SYMBOL) mark(ssa.defValue(i));
+        }
+    }
+    while (!worklist.empty()) {
+        const SSAForm::Value& value = ssa.value(worklist.back());
+        worklist.pop_back();
+        if (value.kind == SSAForm::DefKind::INSTRUCTION) {
+            markUses(value.def);
+        } else if (value.kind == SSAForm::DefKind::PHI) {
+            const SSAForm::Phi& phi = ssa.phis()[value.def];
+            for (size_t k = 0; k < phi.argCount; ++k) mark(ssa.phiArg(phi, k));
+        }
+    }
+    return live;
+}
+
+static bool isJump(IROpcode op) {
+    return op == IROpcode::JMP || op == IROpcode::JZ || op == IROpcode::JNZ;
+}
+
+static Operand& jumpTarget(IRInstruction& instr) {
+    return instr.operands[instr.opcode == IROpcode::JMP ? 0 : 1];
+}
+
+// Deletes the labels nothing jumps to. Returns whether any went.
+static bool removeUnusedLabels(IRProgram& ir) {
+    auto& code = ir.code;
+    std::vector<char> referenced(ir.nameCounter - ir.firstName, 0);
+    for (IRInstruction& instr : code) {
+        if (isJump(instr.opcode)) referenced[jumpTarget(instr).id - ir.firstName] = 1;
+    }
+    size_t kept = 0;
+    for (const IRInstruction& instr : code) {
+        if (instr.opcode == IROpcode::LABEL && !referenced[instr.operands[0].id - ir.firstName]) continue;
+        code[kept++] = instr;
+    }
+    bool removed = kept != code.size();
+    code.erase(code.begin() + kept, code.end());
+    return removed;
+}
+
+// Drops jumps to a label in the run of labels right after them, then the
+// labels nothing jumps to. A dropped branch often leaves the temp it tested
+// unread, and with it the instruction computing it, which may in turn
+// leave the branch before that jumping to the next label: those go in the
+// same sweep, so nested ifs that lost their bodies fold at once. Returns
+// whether a condition left unread may still be stored somewhere.
+static bool removeJumpsToNext(IRProgram& ir) {
+    auto& code = ir.code;
+    uint32_t base = ir.firstName;
+    std::vector<uint32_t> reads(ir.nameCounter - base, 0);
+    auto countReads = [&](const IRInstruction& instr, int delta) {
+        for (size_t k = 0; k < instr.operandCount(); ++k) {
+            const Operand& op = instr.operands[k];
+            if (op.kind == OperandKind::TEMP && static_cast<int>(k) != instr.definedOperand()) reads[op.id - base] += delta;
+        }
+    };
+    for (const IRInstruction& instr : code) countReads(instr, 1);
+
+    std::vector<Operand> droppedConditions;
+    size_t kept = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        IRInstruction instr = code[i];
+        auto toNext = [&](IRInstruction& jump) {
+            bool found = false;
+            for (size_t j = i + 1; j < code.size() && code[j].opcode == IROpcode::LABEL && !found; ++j) {
+                found = code[j].operands[0] == jumpTarget(jump);
+            }
+            return found;
+        };
+        if (!isJump(instr.opcode) || !toNext(instr)) {
+            code[kept++] = instr;
+            continue;
+        }
+        countReads(instr, -1);
+        if (instr.opcode != IROpcode::JMP) droppedConditions.push_back(instr.operands[0]);
+        while (kept > 0) {
+            IRInstruction& prev = code[kept - 1];
+            int defined = prev.definedOperand();
+            bool deadTemp = defined >= 0 && prev.opcode != IROpcode::INPUT &&
+                            prev.operands[defined].kind == OperandKind::TEMP &&
+                            reads[prev.operands[defined].id - base] == 0;
+            if (!deadTemp && !(isJump(prev.opcode) && toNext(prev))) break;
+            if (prev.opcode == IROpcode::JZ || prev.opcode == IROpcode::JNZ) droppedConditions.push_back(prev.operands[0]);
+            countReads(prev, -1);
+            --kept;
+        }
+    }
+    code.erase(code.begin() + kept, code.end());
+    removeUnusedLabels(ir);
+
+    std::vector<char> stored(reads.size(), 0);
+    for (const IRInstruction& instr : code) {
+        int defined = instr.definedOperand();
+        if (defined >= 0 && instr.operands[defined].kind == OperandKind::TEMP) stored[instr.operands[defined].id - base] = 1;
+    }
+    for (const Operand& cond : droppedConditions) {
+        if (cond.kind != OperandKind::TEMP || (reads[cond.id - base] == 0 && stored[cond.id - base])) return true;
+    }
+    return false;
+}
+
+// Deletes unreachable blocks and every store whose value is never read,
+// then the jumps that only fall through and the labels left unused. A
+// removed branch can leave its condition dead, so that repeats.
+void Optimizer::eliminateDeadCode(IRProgram& ir) {
+    do {
+        ControlFlowGraph cfg(ir);
+        SSAForm ssa(ir, cfg);
+        std::vector<char> live = liveValues(ir, cfg, ssa, wholeProgram);
+
+        auto& code = ir.code;
+        size_t kept = 0;
+        for (uint32_t b = 0; b < cfg.blockCount(); ++b) {
+            if (!cfg.isReachable(b)) continue;
+            const BasicBlock& block = cfg.block(b);
+            for (size_t i = block.begin; i < block.end; ++i) {
+                uint32_t v = ssa.defValue(i);
+                if (v != kNoValue && !live[v] && code[i].opcode != IROpcode::INPUT) continue;
+                code[kept++] = code[i];
+            }
+        }
+        code.erase(code.begin() + kept, code.end());
+    } while (removeJumpsToNext(ir));
+}
+
+static const int kMaxThreadingRounds = 8;
+
+// Whether a conditional jump is taken, or -1 when that is not known here:
+// its condition is a literal, or the copy right before it stores one.
+static int branchTaken(const IRProgram& ir, const IRInstruction& jump, const IRInstruction* prev) {
+    const Operand& cond = jump.operands[0];
+    LatticeValue value;
+    if (cond.kind == OperandKind::NUMBER) {
+        value = constant(ir.numberValues[cond.id], CType::DOUBLE);
+    } else if (prev && prev->opcode == IROpcode::ASSIGN && prev->operands[1] == cond) {
+        value = convertTo(literalValue(ir, prev->operands[0]), ir.typeOf(cond));
+    }
+    if (value.state != LatticeState::CONSTANT) return -1;
+    return (value.number == 0) == (jump.opcode == IROpcode::JZ);
+}
+
+// One round of threadJumps, linear in the code and the labels. Returns
+// whether it changed anything.
+static bool threadJumpsOnce(IRProgram& ir) {
+    auto& code = ir.code;
+    uint32_t base = ir.firstName;
+    size_t names = ir.nameCounter - base;
+    std::vector<uint32_t> labelAt(names, UINT32_MAX);
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].opcode == IROpcode::LABEL) labelAt[code[i].operands[0].id - base] = static_cast<uint32_t>(i);
+    }
+
+    // Where a jump to each label ends up once the JMPs that start its
+    // block are followed. A cycle of them, an empty infinite loop, ends at
+    // the label it closes on.
+    std::vector<uint32_t> threadedTo(names, UINT32_MAX);
+    std::vector<uint32_t> path;
+    for (uint32_t label = base; label < ir.nameCounter; ++label) {
+        if (labelAt[label - base] == UINT32_MAX || threadedTo[label - base] != UINT32_MAX) continue;
+        uint32_t cur = label;
+        while (threadedTo[cur - base] == UINT32_MAX) {
+            threadedTo[cur - base] = cur;
+            path.push_back(cur);
+            size_t at = labelAt[cur - base];
+            while (at < code.size() && code[at].opcode == IROpcode::LABEL) ++at;
+            if (at == code.size() || code[at].opcode != IROpcode::JMP) break;
+            uint32_t next = code[at].operands[0].id;
+            if (labelAt[next - base] == UINT32_MAX) break;
+            cur = next;
+        }
+        uint32_t result = threadedTo[cur - base];
+        for (uint32_t l : path) threadedTo[l - base] = result;
+        path.clear();
+    }
+    auto resolve = [&](const Operand& label) {
+        uint32_t to = threadedTo[label.id - base];
+        return to == UINT32_MAX ? label : Operand(OperandKind::LABEL, to);
+    };
+
+    bool changed = false;
+    bool unreachable = false;
+    size_t kept = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        IRInstruction instr = code[i];
+        if (instr.opcode == IROpcode::LABEL) {
+            unreachable = false;
+        } else if (unreachable) {
+            changed = true;
+            continue;
+        }
+        if (!isJump(instr.opcode)) {
+            code[kept++] = instr;
+            continue;
+        }
+
+        Operand& target = jumpTarget(instr);
+        Operand threaded = resolve(target);
+        changed |= threaded != target;
+        target = threaded;
+        if (instr.opcode != IROpcode::JMP) {
+            int taken = branchTaken(ir, instr, kept > 0 ? &code[kept - 1] : nullptr);
+            if (taken == 0) {
+                changed = true;
+                continue;
+            }
+            if (taken == 1) {
+                instr = IRInstruction(IROpcode::JMP, target, instr.line);
+                changed = true;
+            }
+        }
+        // `JZ c, L1; JMP L2; LABEL L1` branches once: `JNZ c, L2; LABEL L1`.
+        if (instr.opcode != IROpcode::JMP && i + 2 < code.size() && code[i + 1].opcode == IROpcode::JMP &&
+            code[i + 2].opcode == IROpcode::LABEL && resolve(code[i + 2].operands[0]) == target) {
+            instr.opcode = instr.opcode == IROpcode::JZ ? IROpcode::JNZ : IROpcode::JZ;
+            instr.operands[1] = resolve(code[i + 1].operands[0]);
+            changed = true;
+            ++i;
+        }
+        bool toNext = false;
+        for (size_t j = i + 1; j < code.size() && code[j].opcode == IROpcode::LABEL && !toNext; ++j) {
+            toNext = code[j].operands[0] == jumpTarget(instr);
+        }
+        if (toNext) {
+            changed = true;
+            continue;
+        }
+        unreachable = instr.opcode == IROpcode::JMP;
+        code[kept++] = instr;
+    }
+    code.erase(code.begin() + kept, code.end());
+    return removeUnusedLabels(ir) || changed;
+}
+
+// Peephole cleanup of the control flow the lowering and the other passes
+// leave behind: jumps to a label whose block starts with a JMP go straight
+// to where that leads, branches on a known condition become a JMP or go
+// away, a conditional jump over a JMP is inverted into one branch, and
+// code after a JMP that no label starts is dropped, as are jumps to the
+// next instruction and unused labels. A dropped label merges the blocks
+// either side of it. Rounds repeat until nothing changes, at most
+// kMaxThreadingRounds times, so each instruction is visited a bounded
+// number of times.
+void Optimizer::threadJumps(IRProgram& ir) {
+    for (int round = 0; round < kMaxThreadingRounds && threadJumpsOnce(ir); ++round) {
+    }
 }
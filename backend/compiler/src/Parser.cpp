@@ -1,18 +1,38 @@
 #include "Parser.h"
 #include <iostream>
 
-#define CURRENT_TOKEN (pos < tokens.size() ? tokens[pos] : tokens.back())
+#define CURRENT_TOKEN (pos < tokens->size() ? (*tokens)[pos] : tokens->back())
+
+Parser::Parser(const std::vector<Token>& tks, Arena& astArena)
+    : tokens(&tks), lexer(nullptr),
+      current(TokenType::END_OF_FILE, "", 0, 0), previous(current),
+      arena(astArena), pos(0), nodeCount(0) {}
+
+Parser::Parser(Lexer& lex, Arena& astArena, TokenObserver observer)
+    : tokens(nullptr), lexer(&lex), onToken(std::move(observer)),
+      current(TokenType::END_OF_FILE, "", 0, 0), previous(current),
+      arena(astArena), pos(0), nodeCount(0) {
+    pull();
+}
 
-Parser::Parser(const std::vector<Token>& tks)
-    : tokens(tks), pos(0) {}
+void Parser::pull() {
+    current = lexer->next();
+    if (onToken) onToken(current);
+}
 
 const Token& Parser::peek() const {
+    if (lexer) return current;
     return CURRENT_TOKEN;
 }
 
 const Token& Parser::get() {
-    if (pos < tokens.size()) return tokens[pos++];
-    return tokens.back();
+    if (lexer) {
+        previous = current;
+        if (current.type != TokenType::END_OF_FILE) pull();
+        return previous;
+    }
+    if (pos < tokens->size()) return (*tokens)[pos++];
+    return tokens->back();
 }
 
 bool Parser::match(TokenType type) {
@@ -27,23 +47,35 @@ bool Parser::matchKeyword(TokenType type) {
     return match(type);
 }
 
+void Parser::error(const std::string& message) {
+    errors.push_back("Line " + std::to_string(peek().line) + ": " + message);
+    errorLines.push_back(peek().line);
+}
+
 void Parser::expect(TokenType type, const std::string& errorMsg) {
     if (!match(type)) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": " + errorMsg);
+        error(errorMsg);
     }
 }
 
-std::unique_ptr<Program> Parser::parse() {
-    auto program = std::make_unique<Program>();
-    while (peek().type != TokenType::END_OF_FILE) {
-        auto stmt = parseStatement();
-        if (stmt) program->statements.push_back(std::move(stmt));
-        else get(); 
+Program* Parser::parse() {
+    auto program = makeNode<Program>();
+    while (Statement* stmt = parseNext()) {
+        program->statements.push_back(arena, stmt);
     }
     return program;
 }
 
-std::unique_ptr<Statement> Parser::parseStatement() {
+Statement* Parser::parseNext() {
+    while (peek().type != TokenType::END_OF_FILE) {
+        Statement* stmt = parseStatement();
+        if (stmt) return stmt;
+        get(); 
+    }
+    return nullptr;
+}
+
+Statement* Parser::parseStatement() {
     if (peek().type == TokenType::LET) return parseVarDecl();
     if (peek().type == TokenType::INPUT) return parseInput();
     if (peek().type == TokenType::OUTPUT) return parseOutput();
@@ -52,17 +84,17 @@ std::unique_ptr<Statement> Parser::parseStatement() {
         return parseBinOp();
     if (peek().type == TokenType::IF) return parseIf();
     if (peek().type == TokenType::REPEAT) return parseRepeat();
-    errors.push_back("Line " + std::to_string(peek().line) + ": Unexpected statement.");
+    error("Unexpected statement.");
     return nullptr;
 }
 
-std::unique_ptr<Statement> Parser::parseVarDecl() {
-    auto stmt = std::make_unique<VarDecl>();
+Statement* Parser::parseVarDecl() {
+    auto stmt = makeNode<VarDecl>();
     stmt->line = peek().line;
     stmt->column = peek().column;
     expect(TokenType::LET, "Expected 'let'");
     if (peek().type != TokenType::IDENTIFIER) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected variable name.");
+        error("Expected variable name.");
         return nullptr;
     }
     stmt->varName = get().lexeme;
@@ -71,21 +103,21 @@ std::unique_ptr<Statement> Parser::parseVarDecl() {
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::parseInput() {
-    auto stmt = std::make_unique<InputStmt>();
+Statement* Parser::parseInput() {
+    auto stmt = makeNode<InputStmt>();
     stmt->line = peek().line;
     stmt->column = peek().column;
     expect(TokenType::INPUT, "Expected 'input'");
     if (peek().type != TokenType::IDENTIFIER) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected variable name after 'input'.");
+        error("Expected variable name after 'input'.");
         return nullptr;
     }
     stmt->varName = get().lexeme;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::parseOutput() {
-    auto stmt = std::make_unique<OutputStmt>();
+Statement* Parser::parseOutput() {
+    auto stmt = makeNode<OutputStmt>();
     stmt->line = peek().line;
     stmt->column = peek().column;
     expect(TokenType::OUTPUT, "Expected 'output'");
@@ -93,7 +125,7 @@ std::unique_ptr<Statement> Parser::parseOutput() {
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::parseBinOp() {
+Statement* Parser::parseBinOp() {
     BinOpType opType;
     if (peek().type == TokenType::ADD) opType = BinOpType::ADD;
     else if (peek().type == TokenType::SUBTRACT) opType = BinOpType::SUBTRACT;
@@ -101,23 +133,23 @@ std::unique_ptr<Statement> Parser::parseBinOp() {
     else opType = BinOpType::DIVIDE;
     get();
 
-    auto stmt = std::make_unique<BinOpStmt>();
+    auto stmt = makeNode<BinOpStmt>();
     stmt->line = peek().line;
     stmt->op = opType;
 
     if (peek().type != TokenType::IDENTIFIER) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected first operand.");
+        error("Expected first operand.");
         return nullptr;
     }
     stmt->left = get().lexeme;
 
     if (!matchKeyword(TokenType::IN) && !matchKeyword(TokenType::AND)) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected 'and' or 'in' after first operand.");
+        error("Expected 'and' or 'in' after first operand.");
         return nullptr;
     }
 
     if (peek().type != TokenType::IDENTIFIER) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected second operand.");
+        error("Expected second operand.");
         return nullptr;
     }
     stmt->right = get().lexeme;
@@ -125,41 +157,41 @@ std::unique_ptr<Statement> Parser::parseBinOp() {
     expect(TokenType::STORE, "Expected 'store'");
     expect(TokenType::IN, "Expected 'in'");
     if (peek().type != TokenType::IDENTIFIER) {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected result variable after 'in'.");
+        error("Expected result variable after 'in'.");
         return nullptr;
     }
     stmt->result = get().lexeme;
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::parseIf() {
-    auto stmt = std::make_unique<IfStmt>();
+Statement* Parser::parseIf() {
+    auto stmt = makeNode<IfStmt>();
     stmt->line = peek().line;
     expect(TokenType::IF, "Expected 'if'");
     stmt->condition = parseExpression();
     expect(TokenType::THEN, "Expected 'then' after condition.");
-    stmt->thenBranch.push_back(parseStatement());
+    stmt->thenBranch.push_back(arena, parseStatement());
     if (peek().type == TokenType::ELSE) {
         get();
         expect(TokenType::IF, "Expected 'if' after 'else' for else-if, or 'otherwise' for else.");
-        stmt->elseIfBranches.push_back(parseStatement());
+        stmt->elseIfBranches.push_back(arena, parseStatement());
     }
     if (peek().type == TokenType::OTHERWISE) {
         get();
-        stmt->elseBranch.push_back(parseStatement());
+        stmt->elseBranch.push_back(arena, parseStatement());
     }
     return stmt;
 }
 
-std::unique_ptr<Statement> Parser::parseRepeat() {
-    auto stmt = std::make_unique<RepeatStmt>();
+Statement* Parser::parseRepeat() {
+    auto stmt = makeNode<RepeatStmt>();
     stmt->line = peek().line;
     expect(TokenType::REPEAT, "Expected 'repeat'");
 
     if (peek().type == TokenType::FROM) {
         get(); 
         if (peek().type != TokenType::IDENTIFIER) {
-            errors.push_back("Line " + std::to_string(peek().line) + ": Expected variable name after 'from'.");
+            error("Expected variable name after 'from'.");
             return nullptr;
         }
         stmt->varName = get().lexeme;
@@ -167,7 +199,7 @@ std::unique_ptr<Statement> Parser::parseRepeat() {
         if (peek().type == TokenType::ASSIGN) {
             get(); 
         } else {
-            errors.push_back("Line " + std::to_string(peek().line) + ": Expected '=' after variable name.");
+            error("Expected '=' after variable name.");
             return nullptr;
         }
 
@@ -177,65 +209,65 @@ std::unique_ptr<Statement> Parser::parseRepeat() {
         expect(TokenType::JUMP, "Expected 'jump'");
         stmt->jump = parseExpression();
 
-        stmt->body.push_back(parseStatement());
+        stmt->body.push_back(arena, parseStatement());
     } else if (peek().type == TokenType::UNTIL) {
         get(); 
         stmt->untilCondition = parseExpression();
-        stmt->body.push_back(parseStatement());
+        stmt->body.push_back(arena, parseStatement());
     } else {
-        errors.push_back("Line " + std::to_string(peek().line) + ": Expected 'from' or 'until' after 'repeat'.");
+        error("Expected 'from' or 'until' after 'repeat'.");
         return nullptr;
     }
     return stmt;
 }
 
 
-std::unique_ptr<Expression> Parser::parsePrimary() {
+Expression* Parser::parsePrimary() {
     if (peek().type == TokenType::IDENTIFIER) {
-        auto id = std::make_unique<Identifier>();
+        auto id = makeNode<Identifier>();
         id->name = get().lexeme;
         id->line = peek().line;
         id->column = peek().column;
         return id;
     }
     if (peek().type == TokenType::NUMBER) {
-        auto num = std::make_unique<NumberLiteral>();
+        auto num = makeNode<NumberLiteral>();
         num->value = get().lexeme;
         num->line = peek().line;
         num->column = peek().column;
         return num;
     }
     if (peek().type == TokenType::STRING) {
-        auto str = std::make_unique<StringLiteral>();
+        auto str = makeNode<StringLiteral>();
         str->value = get().lexeme;
         str->line = peek().line;
         str->column = peek().column;
         return str;
     }
 
-    errors.push_back("Line " + std::to_string(peek().line) + ": Expected a primary expression (identifier, number, or string).");
+    error("Expected a primary expression (identifier, number, or string).");
     return nullptr;
 }
 
-std::unique_ptr<Expression> Parser::parseExpression() {
+Expression* Parser::parseExpression() {
     auto left = parsePrimary();
     if (!left) return nullptr;
 
     if (peek().type == TokenType::REL_OP) {
-        std::string op = get().lexeme;
+        std::string_view op = get().lexeme;
 
         auto right = parsePrimary();
         if (!right) {
-            errors.push_back("Line " + std::to_string(peek().line) + ": Expected right-hand operand after relational operator.");
+            error("Expected right-hand operand after relational operator.");
             return nullptr;
         }
 
-        auto rel = std::make_unique<RelOpExpr>();
+        auto rel = makeNode<RelOpExpr>();
         rel->line = left->line;
         rel->column = left->column;
         rel->op = op;
-        rel->left = std::move(left);
-        rel->right = std::move(right);
+        rel->left = left;
+        rel->right = right;
 
         return rel;
     }
@@ -243,6 +275,10 @@ std::unique_ptr<Expression> Parser::parseExpression() {
     return left;
 }
 
-std::vector<std::string> Parser::getErrors() const {
+const std::vector<std::string>& Parser::getErrors() const {
     return errors;
 }
+
+const std::vector<int>& Parser::getErrorLines() const {
+    return errorLines;
+}
@@ -0,0 +1,215 @@
+#include "SSA.h"
+#include <utility>
+
+SSAForm::SSAForm(const IRProgram& ir, const ControlFlowGraph& cfg)
+    : symbolCount(static_cast<uint32_t>(ir.symbols.size())),
+      tempCount(ir.nameCounter - ir.firstName),
+      firstName(ir.firstName) {
+    uint32_t count = static_cast<uint32_t>(variableCount());
+    values.reserve(count + ir.code.size());
+    for (uint32_t v = 0; v < count; ++v) values.push_back({DefKind::ENTRY, v, 0});
+    uses.assign(ir.code.size() * 3, kNoValue);
+    defs.assign(ir.code.size(), kNoValue);
+    placePhis(ir, cfg);
+    rename(ir, cfg);
+    buildUsers();
+}
+
+uint32_t SSAForm::variableOf(const Operand& op) const {
+    if (op.kind == OperandKind::SYMBOL) return op.id < symbolCount ? op.id : kNoValue;
+    if (op.kind != OperandKind::TEMP || op.id < firstName || op.id - firstName >= tempCount) return kNoValue;
+    return symbolCount + (op.id - firstName);
+}
+
+Operand SSAForm::variableOperand(uint32_t variable) const {
+    if (variable < symbolCount) return Operand(OperandKind::SYMBOL, variable);
+    return Operand(OperandKind::TEMP, variable - symbolCount + firstName);
+}
+
+// Groups (key, item) pairs by key: items of key k end up in
+// list[start[k], start[k + 1]).
+static void groupByKey(const std::vector<std::pair<uint32_t, uint32_t>>& pairs, size_t keys,
+                       std::vector<uint32_t>& start, std::vector<uint32_t>& list) {
+    start.assign(keys + 1, 0);
+    for (const auto& p : pairs) ++start[p.first + 1];
+    for (size_t k = 0; k < keys; ++k) start[k + 1] += start[k];
+    list.resize(pairs.size());
+    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+    for (const auto& p : pairs) list[fill[p.first]++] = p.second;
+}
+
+void SSAForm::placePhis(const IRProgram& ir, const ControlFlowGraph& cfg) {
+    size_t blocks = cfg.blockCount();
+    uint32_t count = static_cast<uint32_t>(variableCount());
+
+    // Variables read before written in some block, and the blocks
+    // writing each variable.
+    std::vector<char>& global = globalVariables;
+    global.assign(count, 0);
+    std::vector<uint32_t> lastDefBlock(count, kNoBlock);
+    std::vector<std::pair<uint32_t, uint32_t>> defSites;
+    for (uint32_t b : cfg.reversePostOrder()) {
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) {
+            const IRInstruction& instr = ir.code[i];
+            int defined = instr.definedOperand();
+            for (size_t k = 0; k < instr.operandCount(); ++k) {
+                if (static_cast<int>(k) == defined) continue;
+                uint32_t var = variableOf(instr.operands[k]);
+                if (var != kNoValue && lastDefBlock[var] != b) global[var] = 1;
+            }
+            if (defined < 0) continue;
+            uint32_t var = variableOf(instr.operands[defined]);
+            if (var == kNoValue || lastDefBlock[var] == b) continue;
+            lastDefBlock[var] = b;
+            defSites.emplace_back(var, b);
+        }
+    }
+    std::vector<uint32_t> defStart, defBlocks;
+    groupByKey(defSites, count, defStart, defBlocks);
+
+    // Dominance frontiers (Cooper, Harvey and Kennedy). The entry block
+    // is a join whenever it has a predecessor, through the implicit edge
+    // into the program.
+    std::vector<std::pair<uint32_t, uint32_t>> frontierPairs;
+    for (uint32_t b : cfg.reversePostOrder()) {
+        size_t incoming = (b == 0) ? 1 : 0;
+        for (uint32_t p : cfg.preds(b)) incoming += cfg.isReachable(p) ? 1 : 0;
+        if (incoming < 2) continue;
+        for (uint32_t p : cfg.preds(b)) {
+            if (!cfg.isReachable(p)) continue;
+            for (uint32_t runner = p; runner != cfg.idom(b); runner = cfg.idom(runner)) {
+                frontierPairs.emplace_back(runner, b);
+                if (runner == 0) break;
+            }
+        }
+    }
+    std::vector<uint32_t> frontierStart, frontier;
+    groupByKey(frontierPairs, blocks, frontierStart, frontier);
+
+    // Iterated frontiers of each variable's definitions. Marks are stamped
+    // with the variable so they never need clearing.
+    std::vector<std::pair<uint32_t, uint32_t>> placed;
+    std::vector<uint32_t> hasPhi(blocks, kNoValue), queued(blocks, kNoValue);
+    std::vector<uint32_t> worklist;
+    for (uint32_t var = 0; var < count; ++var) {
+        if (!global[var]) continue;
+        worklist.assign(defBlocks.begin() + defStart[var], defBlocks.begin() + defStart[var + 1]);
+        for (uint32_t b : worklist) queued[b] = var;
+        while (!worklist.empty()) {
+            uint32_t b = worklist.back();
+            worklist.pop_back();
+            for (uint32_t i = frontierStart[b]; i < frontierStart[b + 1]; ++i) {
+                uint32_t d = frontier[i];
+                if (hasPhi[d] == var) continue;
+                hasPhi[d] = var;
+                placed.emplace_back(d, var);
+                if (queued[d] != var) {
+                    queued[d] = var;
+                    worklist.push_back(d);
+                }
+            }
+        }
+    }
+
+    std::vector<uint32_t> phiVars;
+    groupByKey(placed, blocks, blockPhis, phiVars);
+    phiList.reserve(phiVars.size());
+    for (uint32_t b = 0; b < blocks; ++b) {
+        uint32_t argCount = static_cast<uint32_t>(cfg.preds(b).size()) + (b == 0 ? 1 : 0);
+        for (uint32_t i = blockPhis[b]; i < blockPhis[b + 1]; ++i) {
+            Phi phi;
+            phi.block = b;
+            phi.variable = phiVars[i];
+            phi.value = static_cast<uint32_t>(values.size());
+            phi.firstArg = static_cast<uint32_t>(phiArgs.size());
+            phi.argCount = argCount;
+            values.push_back({DefKind::PHI, phi.variable, i});
+            phiArgs.resize(phiArgs.size() + argCount, kNoValue);
+            if (b == 0) phiArgs.back() = phi.variable;
+            phiList.push_back(phi);
+        }
+    }
+}
+
+// Walks the dominator tree keeping the value each variable holds; an undo
+// log restores it on the way back up.
+void SSAForm::rename(const IRProgram& ir, const ControlFlowGraph& cfg) {
+    if (cfg.blockCount() == 0) return;
+    std::vector<uint32_t> current(variableCount());
+    for (uint32_t v = 0; v < current.size(); ++v) current[v] = v;
+    std::vector<std::pair<uint32_t, uint32_t>> undo;
+    auto assign = [&](uint32_t var, uint32_t value) {
+        undo.emplace_back(var, current[var]);
+        current[var] = value;
+    };
+
+    struct Frame {
+        uint32_t block;
+        uint32_t child;
+        size_t undoMark;
+    };
+    std::vector<Frame> stack;
+    auto enter = [&](uint32_t b) {
+        stack.push_back({b, 0, undo.size()});
+        for (uint32_t p = blockPhis[b]; p < blockPhis[b + 1]; ++p) assign(phiList[p].variable, phiList[p].value);
+
+        const BasicBlock& block = cfg.block(b);
+        for (size_t i = block.begin; i < block.end; ++i) {
+            const IRInstruction& instr = ir.code[i];
+            int defined = instr.definedOperand();
+            for (size_t k = 0; k < instr.operandCount(); ++k) {
+                if (static_cast<int>(k) == defined) continue;
+                uint32_t var = variableOf(instr.operands[k]);
+                if (var != kNoValue) uses[i * 3 + k] = current[var];
+            }
+            if (defined < 0) continue;
+            uint32_t var = variableOf(instr.operands[defined]);
+            if (var == kNoValue) continue;
+            uint32_t value = static_cast<uint32_t>(values.size());
+            values.push_back({DefKind::INSTRUCTION, var, static_cast<uint32_t>(i)});
+            defs[i] = value;
+            assign(var, value);
+        }
+
+        for (uint32_t s : cfg.succs(b)) {
+            BlockList preds = cfg.preds(s);
+            size_t k = 0;
+            while (preds[k] != b) ++k;
+            for (uint32_t p = blockPhis[s]; p < blockPhis[s + 1]; ++p) {
+                phiArgs[phiList[p].firstArg + k] = current[phiList[p].variable];
+            }
+        }
+    };
+
+    enter(0);
+    while (!stack.empty()) {
+        Frame& top = stack.back();
+        BlockList children = cfg.dominatorChildren(top.block);
+        if (top.child < children.size()) {
+            enter(children[top.child++]);
+            continue;
+        }
+        while (undo.size() > top.undoMark) {
+            current[undo.back().first] = undo.back().second;
+            undo.pop_back();
+        }
+        stack.pop_back();
+    }
+}
+
+void SSAForm::buildUsers() {
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(uses.size() / 2 + phiArgs.size());
+    for (size_t slot = 0; slot < uses.size(); ++slot) {
+        if (uses[slot] != kNoValue) pairs.emplace_back(uses[slot], static_cast<uint32_t>(slot / 3));
+    }
+    for (uint32_t p = 0; p < phiList.size(); ++p) {
+        const Phi& phi = phiList[p];
+        for (uint32_t k = 0; k < phi.argCount; ++k) {
+            uint32_t arg = phiArgs[phi.firstArg + k];
+            if (arg != kNoValue) pairs.emplace_back(arg, p | kPhiUser);
+        }
+    }
+    groupByKey(pairs, values.size(), userStart, userList);
+}
@@ -0,0 +1,233 @@
+#include "ScanKernels.h"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SCAN_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_HAVE_X86 0
+#endif
+
+namespace {
+
+enum : uint8_t { CLS_SPACE = 1, CLS_IDENT = 2, CLS_DIGIT = 4 };
+
+struct ClassTable {
+    uint8_t bits[256];
+    ClassTable() : bits() {
+        const char spaces[] = {' ', '\t', '\n', '\v', '\f', '\r'};
+        for (char c : spaces) bits[static_cast<uint8_t>(c)] |= CLS_SPACE;
+        for (int c = '0'; c <= '9'; ++c) bits[c] |= CLS_IDENT | CLS_DIGIT;
+        for (int c = 'a'; c <= 'z'; ++c) bits[c] |= CLS_IDENT;
+        for (int c = 'A'; c <= 'Z'; ++c) bits[c] |= CLS_IDENT;
+        bits[static_cast<uint8_t>('_')] |= CLS_IDENT;
+    }
+};
+
+const ClassTable classTable;
+
+inline bool hasClass(char c, uint8_t cls) {
+    return (classTable.bits[static_cast<uint8_t>(c)] & cls) != 0;
+}
+
+size_t scalarRun(const char* p, const char* end, uint8_t cls) {
+    const char* start = p;
+    while (p < end && hasClass(*p, cls)) ++p;
+    return static_cast<size_t>(p - start);
+}
+
+size_t scalarString(const char* p, const char* end) {
+    const char* start = p;
+    while (p < end && *p != '"' && *p != '\0') ++p;
+    return static_cast<size_t>(p - start);
+}
+
+size_t scalarNewlines(const char* p, const char* end, const char** lastNewline) {
+    size_t count = 0;
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            ++count;
+            *lastNewline = p;
+        }
+    }
+    return count;
+}
+
+#if SCAN_HAVE_X86
+
+// Each SIMD matcher produces a mask with one bit set per byte that belongs
+// to the class. Bytes >= 0x80 compare as negative and never match.
+
+inline __m128i inRange128(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), v));
+}
+
+inline unsigned spaceMask128(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), inRange128(v, '\t', '\r'));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline unsigned digitMask128(__m128i v) {
+    return static_cast<unsigned>(_mm_movemask_epi8(inRange128(v, '0', '9')));
+}
+
+inline unsigned identMask128(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i m = _mm_or_si128(inRange128(lower, 'a', 'z'), inRange128(v, '0', '9'));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+inline unsigned stringEndMask128(__m128i v) {
+    __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                             _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+
+template <unsigned (*Match)(__m128i), bool Stop>
+size_t sse2Run(const char* p, const char* end, size_t (*tail)(const char*, const char*)) {
+    const char* start = p;
+    while (end - p >= 16) {
+        unsigned mask = Match(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        unsigned stop = Stop ? mask : (~mask & 0xFFFFu);
+        if (stop) return static_cast<size_t>(p - start) + __builtin_ctz(stop);
+        p += 16;
+    }
+    return static_cast<size_t>(p - start) + tail(p, end);
+}
+
+size_t tailSpace(const char* p, const char* end) { return scalarRun(p, end, CLS_SPACE); }
+size_t tailIdent(const char* p, const char* end) { return scalarRun(p, end, CLS_IDENT); }
+size_t tailDigit(const char* p, const char* end) { return scalarRun(p, end, CLS_DIGIT); }
+
+size_t sse2Whitespace(const char* p, const char* end) { return sse2Run<spaceMask128, false>(p, end, tailSpace); }
+size_t sse2Identifier(const char* p, const char* end) { return sse2Run<identMask128, false>(p, end, tailIdent); }
+size_t sse2Digits(const char* p, const char* end) { return sse2Run<digitMask128, false>(p, end, tailDigit); }
+size_t sse2String(const char* p, const char* end) { return sse2Run<stringEndMask128, true>(p, end, scalarString); }
+
+size_t sse2Newlines(const char* p, const char* end, const char** lastNewline) {
+    size_t count = 0;
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), nl)));
+        if (mask) {
+            count += __builtin_popcount(mask);
+            *lastNewline = p + (31 - __builtin_clz(mask));
+        }
+        p += 16;
+    }
+    return count + scalarNewlines(p, end, lastNewline);
+}
+
+#define SCAN_AVX2 __attribute__((target("avx2")))
+
+SCAN_AVX2 inline __m256i inRange256(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+SCAN_AVX2 inline uint32_t spaceMask256(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), inRange256(v, '\t', '\r'));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+}
+
+SCAN_AVX2 inline uint32_t digitMask256(__m256i v) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(inRange256(v, '0', '9')));
+}
+
+SCAN_AVX2 inline uint32_t identMask256(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i m = _mm256_or_si256(inRange256(lower, 'a', 'z'), inRange256(v, '0', '9'));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+}
+
+SCAN_AVX2 inline uint32_t stringEndMask256(__m256i v) {
+    __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+}
+
+// The 32-byte loop hands its remainder to the SSE2 kernel, which in turn
+// finishes with the scalar table walk.
+#define SCAN_AVX2_RUN(name, matcher, stopOnMatch, rest)                                  \
+    SCAN_AVX2 size_t name(const char* p, const char* end) {                              \
+        const char* start = p;                                                           \
+        while (end - p >= 32) {                                                          \
+            uint32_t mask = matcher(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); \
+            uint32_t stop = stopOnMatch ? mask : ~mask;                                  \
+            if (stop) return static_cast<size_t>(p - start) + __builtin_ctz(stop);       \
+            p += 32;                                                                     \
+        }                                                                                \
+        return static_cast<size_t>(p - start) + rest(p, end);                            \
+    }
+
+SCAN_AVX2_RUN(avx2Whitespace, spaceMask256, false, sse2Whitespace)
+SCAN_AVX2_RUN(avx2Identifier, identMask256, false, sse2Identifier)
+SCAN_AVX2_RUN(avx2Digits, digitMask256, false, sse2Digits)
+SCAN_AVX2_RUN(avx2String, stringEndMask256, true, sse2String)
+
+SCAN_AVX2 size_t avx2Newlines(const char* p, const char* end, const char** lastNewline) {
+    size_t count = 0;
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), nl)));
+        if (mask) {
+            count += __builtin_popcount(mask);
+            *lastNewline = p + (31 - __builtin_clz(mask));
+        }
+        p += 32;
+    }
+    return count + sse2Newlines(p, end, lastNewline);
+}
+
+#endif
+
+#if !SCAN_HAVE_X86
+size_t scalarWhitespace(const char* p, const char* end) { return scalarRun(p, end, CLS_SPACE); }
+size_t scalarIdentifier(const char* p, const char* end) { return scalarRun(p, end, CLS_IDENT); }
+size_t scalarDigits(const char* p, const char* end) { return scalarRun(p, end, CLS_DIGIT); }
+#endif
+
+struct KernelSet {
+    const char* name;
+    size_t (*whitespace)(const char*, const char*);
+    size_t (*identifier)(const char*, const char*);
+    size_t (*digits)(const char*, const char*);
+    size_t (*string)(const char*, const char*);
+    size_t (*newlines)(const char*, const char*, const char**);
+};
+
+KernelSet selectKernels() {
+#if SCAN_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {"avx2", avx2Whitespace, avx2Identifier, avx2Digits, avx2String, avx2Newlines};
+    return {"sse2", sse2Whitespace, sse2Identifier, sse2Digits, sse2String, sse2Newlines};
+#else
+    return {"scalar", scalarWhitespace, scalarIdentifier, scalarDigits, scalarString, scalarNewlines};
+#endif
+}
+
+const KernelSet kernels = selectKernels();
+
+}
+
+size_t scanWhitespace(const char* p, const char* end) { return kernels.whitespace(p, end); }
+size_t scanIdentifier(const char* p, const char* end) { return kernels.identifier(p, end); }
+size_t scanDigits(const char* p, const char* end) { return kernels.digits(p, end); }
+size_t scanStringBody(const char* p, const char* end) { return kernels.string(p, end); }
+
+bool isIdentStart(char c) { return hasClass(c, CLS_IDENT) && !hasClass(c, CLS_DIGIT); }
+bool isDigit(char c) { return hasClass(c, CLS_DIGIT); }
+
+size_t countNewlines(const char* p, const char* end, const char** lastNewline) {
+    return kernels.newlines(p, end, lastNewline);
+}
+
+const char* activeScanKernel() {
+    return kernels.name;
+}
@@ -0,0 +1,212 @@
+#include "Server.h"
+#include "Driver.h"
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#include <cstdio>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
+#endif
+
+namespace {
+
+// Larger bodies are refused and end the connection: they are not read,
+// so nothing after them can be framed.
+const unsigned long long kMaxSourceBytes = 64ull << 20;
+
+long readFd(int fd, char* buf, size_t len) {
+#ifdef _WIN32
+    return _read(fd, buf, static_cast<unsigned>(len));
+#else
+    return static_cast<long>(::read(fd, buf, len));
+#endif
+}
+
+long writeFd(int fd, const char* buf, size_t len) {
+#ifdef _WIN32
+    return _write(fd, buf, static_cast<unsigned>(len));
+#else
+    return static_cast<long>(::write(fd, buf, len));
+#endif
+}
+
+class FrameChannel {
+public:
+    FrameChannel(int in, int out) : inFd(in), outFd(out), start(0) {}
+
+    bool readLine(std::string& line) {
+        while (true) {
+            size_t nl = buffer.find('\n', start);
+            if (nl != std::string::npos) {
+                line.assign(buffer, start, nl - start);
+                start = nl + 1;
+                return true;
+            }
+            if (!fill()) return false;
+        }
+    }
+
+    bool readExact(size_t count, std::string& out) {
+        while (buffer.size() - start < count) {
+            if (!fill()) return false;
+        }
+        out.assign(buffer, start, count);
+        start += count;
+        return true;
+    }
+
+    bool skip(size_t count) {
+        while (buffer.size() - start < count) {
+            count -= buffer.size() - start;
+            start = buffer.size();
+            if (!fill()) return false;
+        }
+        start += count;
+        return true;
+    }
+
+    bool writeAll(const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            long n = writeFd(outFd, data.data() + done, data.size() - done);
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+private:
+    int inFd;
+    int outFd;
+    std::string buffer;
+    size_t start;
+
+    bool fill() {
+        if (start > 0) {
+            buffer.erase(0, start);
+            start = 0;
+        }
+        char chunk[65536];
+        long n = readFd(inFd, chunk, sizeof(chunk));
+        if (n <= 0) return false;
+        buffer.append(chunk, static_cast<size_t>(n));
+        return true;
+    }
+};
+
+void writeError(std::string& response, const std::string& message) {
+    response += "CODEPIE 1\n";
+    appendSection(response, "error", message);
+}
+
+void serveChannel(FrameChannel& channel, CompilerDriver& driver) {
+    std::string line;
+    std::string source;
+    std::string response;
+    while (channel.readLine(line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        if (line == "QUIT") return;
+
+        response.clear();
+        if (line.compare(0, 8, "COMPILE ") == 0) {
+            // Once the length parses, its body is consumed whatever else is
+            // wrong with the header, so the next line read is a request.
+            const char* digits = line.c_str() + 8;
+            char* end = nullptr;
+            unsigned long long length = std::strtoull(digits, &end, 10);
+            unsigned emit = EMIT_ALL;
+            bool sized = *digits >= '0' && *digits <= '9';
+            bool valid = sized;
+            if (valid && *end == ' ') valid = parseEmitList(end + 1, emit);
+            else if (valid) valid = *end == '\0';
+            if (sized && length > kMaxSourceBytes) {
+                writeError(response, "COMPILE body too large: " + line);
+                channel.writeAll(response);
+                return;
+            }
+            if (!valid) {
+                if (sized && !channel.skip(static_cast<size_t>(length))) return;
+                writeError(response, "Malformed COMPILE header: " + line);
+            } else if (!channel.readExact(static_cast<size_t>(length), source)) {
+                return;
+            } else {
+                appendArtifactSections(response, driver.compile(source, emit));
+            }
+        } else {
+            writeError(response, "Unknown request: " + line);
+        }
+        if (!channel.writeAll(response)) return;
+    }
+}
+
+#ifndef _WIN32
+int serveUnixSocket(const std::string& path, CompilerDriver& driver) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Failed to create socket.\n";
+        return 1;
+    }
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Socket path too long: " << path << "\n";
+        ::close(listener);
+        return 1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    ::unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listener, 16) != 0) {
+        std::cerr << "Failed to listen on " << path << "\n";
+        ::close(listener);
+        return 1;
+    }
+    while (true) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) continue;
+        FrameChannel channel(conn, conn);
+        serveChannel(channel, driver);
+        ::close(conn);
+    }
+}
+#endif
+
+}
+
+int runCompileServer(const std::string& endpoint, CompileCache* cache) {
+    CompilerDriver driver;
+    driver.setIncremental(true);
+    driver.setCache(cache);
+#ifndef _WIN32
+    // A client that goes away before reading its response ends only its own
+    // connection: the write fails with EPIPE instead of killing the server.
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if (endpoint.empty()) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        FrameChannel channel(0, 1);
+        serveChannel(channel, driver);
+        return 0;
+    }
+    if (endpoint.compare(0, 5, "unix:") == 0) {
+#ifndef _WIN32
+        return serveUnixSocket(endpoint.substr(5), driver);
+#else
+        std::cerr << "Unix domain sockets are not supported on this platform.\n";
+        return 1;
+#endif
+    }
+    std::cerr << "Unknown server endpoint: " << endpoint << "\n";
+    return 1;
+}
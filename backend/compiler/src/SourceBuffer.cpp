@@ -0,0 +1,133 @@
+#include "SourceBuffer.h"
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#undef UNICODE
+#undef _UNICODE
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceBuffer::SourceBuffer()
+    : data(""), size(0), mapping(nullptr), mappingHandle(nullptr) {}
+
+SourceBuffer::~SourceBuffer() {
+    close();
+}
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+    : data(""), size(0), mapping(nullptr), mappingHandle(nullptr) {
+    *this = std::move(other);
+}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this == &other) return *this;
+    close();
+    mapping = other.mapping;
+    mappingHandle = other.mappingHandle;
+    size = other.size;
+    if (mapping) {
+        data = other.data;
+    } else {
+        owned = std::move(other.owned);
+        data = owned.data();
+    }
+    other.mapping = nullptr;
+    other.mappingHandle = nullptr;
+    other.data = "";
+    other.size = 0;
+    return *this;
+}
+
+bool SourceBuffer::open(const std::string& path) {
+    close();
+    return map(path) || read(path);
+}
+
+void SourceBuffer::assign(std::string text) {
+    close();
+    owned = std::move(text);
+    data = owned.data();
+    size = owned.size();
+}
+
+void SourceBuffer::close() {
+    if (mapping) {
+#ifdef _WIN32
+        UnmapViewOfFile(mapping);
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+#else
+        munmap(mapping, size);
+#endif
+    }
+    mapping = nullptr;
+    mappingHandle = nullptr;
+    owned.clear();
+    data = "";
+    size = 0;
+}
+
+void SourceBuffer::release(size_t offset) {
+#ifndef _WIN32
+    if (!mapping) return;
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t length = (offset < size ? offset : size) / page * page;
+    if (length > 0) madvise(mapping, length, MADV_DONTNEED);
+#else
+    (void)offset;
+#endif
+}
+
+bool SourceBuffer::map(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!handle) return false;
+    void* view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(handle);
+        return false;
+    }
+    mapping = view;
+    mappingHandle = handle;
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) return false;
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    mapping = view;
+    size = static_cast<size_t>(st.st_size);
+#endif
+    data = static_cast<const char*>(mapping);
+    return true;
+}
+
+bool SourceBuffer::read(const std::string& path) {
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile.is_open()) return false;
+    owned.assign((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+    data = owned.data();
+    size = owned.size();
+    return true;
+}
@@ -0,0 +1,244 @@
+#include "Telemetry.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Each block carries its size in a header so delete can keep the live count
+// without relying on sized deallocation. 16 bytes keeps the default new
+// alignment intact. Blocks allocated before tracking was switched on record
+// a size of 0 and never touch the counters.
+static const size_t kHeapHeader = 16;
+
+static std::atomic<bool> heapTracking{false};
+
+// Counters are per thread, so the compiles a --batch run spreads over its
+// workers each see only their own heap traffic. Plain integers with constant
+// initialization keep them free of TLS constructors, which operator new could
+// not afford. Live bytes are signed: a block freed on another thread than
+// the one that allocated it is debited to the freeing thread.
+static thread_local uint64_t heapAllocations = 0;
+static thread_local uint64_t heapAllocatedBytes = 0;
+static thread_local int64_t heapLiveBytes = 0;
+static thread_local int64_t heapPeakBytes = 0;
+
+void* operator new(size_t size) {
+    char* block = static_cast<char*>(std::malloc(size + kHeapHeader));
+    if (!block) throw std::bad_alloc();
+    if (!heapTracking.load(std::memory_order_relaxed)) {
+        *reinterpret_cast<size_t*>(block) = 0;
+        return block + kHeapHeader;
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+
+    ++heapAllocations;
+    heapAllocatedBytes += size;
+    heapLiveBytes += static_cast<int64_t>(size);
+    if (heapLiveBytes > heapPeakBytes) heapPeakBytes = heapLiveBytes;
+    return block + kHeapHeader;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    // Integer arithmetic: the header lies outside the object GCC sees.
+    char* block = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(p) - kHeapHeader);
+    size_t size = *reinterpret_cast<size_t*>(block);
+    if (size) heapLiveBytes -= static_cast<int64_t>(size);
+    std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+
+void enableHeapTracking() {
+    heapTracking.store(true, std::memory_order_relaxed);
+}
+
+static uint64_t clampToZero(int64_t bytes) {
+    return bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+}
+
+HeapCounters readHeapCounters() {
+    HeapCounters counters;
+    counters.allocations = heapAllocations;
+    counters.allocatedBytes = heapAllocatedBytes;
+    counters.liveBytes = clampToZero(heapLiveBytes);
+    counters.peakLiveBytes = clampToZero(heapPeakBytes);
+    return counters;
+}
+
+void resetHeapPeak() {
+    heapPeakBytes = heapLiveBytes;
+}
+
+uint64_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS info;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info))) return 0;
+    return info.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+CompileTelemetry::CompileTelemetry() : totalUs(0), peakHeapBytes(0) {}
+
+void CompileTelemetry::start() {
+    enableHeapTracking();
+    origin = std::chrono::steady_clock::now();
+    phases.clear();
+    open.clear();
+    counters.clear();
+    totalUs = 0;
+    resetHeapPeak();
+    peakHeapBytes = readHeapCounters().peakLiveBytes;
+}
+
+double CompileTelemetry::nowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void CompileTelemetry::beginPhase(const char* name) {
+    // The peak is reset per phase, so fold it into the enclosing ones first.
+    uint64_t peak = readHeapCounters().peakLiveBytes;
+    for (size_t index : open) {
+        if (peak > phases[index].peakHeapBytes) phases[index].peakHeapBytes = peak;
+    }
+    if (peak > peakHeapBytes) peakHeapBytes = peak;
+    resetHeapPeak();
+
+    // Book-keeping allocations happen before the snapshot so they are not
+    // charged to the phase.
+    open.push_back(phases.size());
+    phases.emplace_back();
+    Phase& phase = phases.back();
+    phase.name = name;
+    phase.depth = static_cast<int>(open.size()) - 1;
+    phase.heapAtStart = readHeapCounters();
+    phase.peakHeapBytes = phase.heapAtStart.liveBytes;
+    phase.allocations = 0;
+    phase.allocatedBytes = 0;
+    phase.durationUs = 0;
+    phase.startUs = nowUs();
+}
+
+void CompileTelemetry::endPhase() {
+    if (open.empty()) return;
+    double end = nowUs();
+    HeapCounters heap = readHeapCounters();
+    for (size_t index : open) {
+        if (heap.peakLiveBytes > phases[index].peakHeapBytes) phases[index].peakHeapBytes = heap.peakLiveBytes;
+    }
+    if (heap.peakLiveBytes > peakHeapBytes) peakHeapBytes = heap.peakLiveBytes;
+
+    Phase& phase = phases[open.back()];
+    open.pop_back();
+    phase.durationUs = end - phase.startUs;
+    phase.allocations = heap.allocations - phase.heapAtStart.allocations;
+    phase.allocatedBytes = heap.allocatedBytes - phase.heapAtStart.allocatedBytes;
+    if (end > totalUs) totalUs = end;
+}
+
+void CompileTelemetry::setCounter(const std::string& name, uint64_t value) {
+    for (auto& counter : counters) {
+        if (counter.first == name) {
+            counter.second = value;
+            return;
+        }
+    }
+    counters.emplace_back(name, value);
+}
+
+static void appendNumber(std::string& out, double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", value);
+    out += buf;
+}
+
+static void appendUnsigned(std::string& out, uint64_t value) {
+    out += std::to_string(value);
+}
+
+void CompileTelemetry::appendJson(std::string& out) const {
+    out += "{\n  \"total_ms\": ";
+    appendNumber(out, totalUs / 1000.0);
+    out += ",\n  \"peak_rss_bytes\": ";
+    appendUnsigned(out, peakResidentBytes());
+    out += ",\n  \"peak_heap_bytes\": ";
+    appendUnsigned(out, peakHeapBytes);
+    out += ",\n  \"phases\": [";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const Phase& phase = phases[i];
+        out += i ? ",\n" : "\n";
+        out += "    {\"name\": \"";
+        out += phase.name;
+        out += "\", \"depth\": ";
+        appendUnsigned(out, static_cast<uint64_t>(phase.depth));
+        out += ", \"start_ms\": ";
+        appendNumber(out, phase.startUs / 1000.0);
+        out += ", \"wall_ms\": ";
+        appendNumber(out, phase.durationUs / 1000.0);
+        out += ", \"allocations\": ";
+        appendUnsigned(out, phase.allocations);
+        out += ", \"allocated_bytes\": ";
+        appendUnsigned(out, phase.allocatedBytes);
+        out += ", \"peak_heap_bytes\": ";
+        appendUnsigned(out, phase.peakHeapBytes);
+        out += "}";
+    }
+    out += phases.empty() ? "],\n" : "\n  ],\n";
+    out += "  \"counters\": {";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        out += i ? ",\n    \"" : "\n    \"";
+        out += counters[i].first;
+        out += "\": ";
+        appendUnsigned(out, counters[i].second);
+    }
+    out += counters.empty() ? "}\n}\n" : "\n  }\n}\n";
+}
+
+void CompileTelemetry::appendChromeTrace(std::string& out) const {
+    out += "{\"traceEvents\": [\n";
+    out += "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"codepie compiler\"}}";
+    for (const Phase& phase : phases) {
+        out += ",\n  {\"name\": \"";
+        out += phase.name;
+        out += "\", \"cat\": \"compile\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": ";
+        appendNumber(out, phase.startUs);
+        out += ", \"dur\": ";
+        appendNumber(out, phase.durationUs);
+        out += ", \"args\": {\"allocations\": ";
+        appendUnsigned(out, phase.allocations);
+        out += ", \"allocated_bytes\": ";
+        appendUnsigned(out, phase.allocatedBytes);
+        out += ", \"peak_heap_bytes\": ";
+        appendUnsigned(out, phase.peakHeapBytes);
+        out += "}}";
+    }
+    // Counters land at the end of the timeline as one counter track each.
+    for (const auto& counter : counters) {
+        out += ",\n  {\"name\": \"";
+        out += counter.first;
+        out += "\", \"cat\": \"compile\", \"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"ts\": ";
+        appendNumber(out, totalUs);
+        out += ", \"args\": {\"value\": ";
+        appendUnsigned(out, counter.second);
+        out += "}}";
+    }
+    out += "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
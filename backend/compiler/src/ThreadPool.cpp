@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(unsigned threads)
+    : queued(0), unfinished(0), nextQueue(0), stopping(false) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(Task task) {
+    unsigned target;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        target = nextQueue;
+        nextQueue = (nextQueue + 1) % size();
+        ++unfinished;
+        // Counted under the state lock, before the push, so a worker about
+        // to sleep cannot miss it and the count never dips below zero.
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    idle.wait(lock, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::take(unsigned index, Task& task) {
+    {
+        Queue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (unsigned step = 1; step < size(); ++step) {
+        Queue& victim = *queues[(index + step) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(unsigned index) {
+    for (;;) {
+        Task task;
+        if (take(index, task)) {
+            task(index);
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (--unfinished == 0) idle.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(stateMutex);
+        wake.wait(lock, [this] { return stopping || queued.load(std::memory_order_relaxed) > 0; });
+        if (stopping && queued.load(std::memory_order_relaxed) == 0) return;
+    }
+}
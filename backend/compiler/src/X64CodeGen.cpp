@@ -0,0 +1,908 @@
+#include "X64CodeGen.h"
+#include "ControlFlowGraph.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+using Op = Bytecode::Op;
+using Value = Bytecode::Value;
+using Instr = Bytecode::Instr;
+
+const int XMM0 = 0;
+const int XMM_ZERO = 14;
+const int XMM_SCRATCH = 15;
+
+// Int relations by offset from LT in LT, LE, GT, GE, EQ, NE order.
+const int kIntCondition[] = {CC_L, CC_LE, CC_G, CC_GE, CC_E, CC_NE};
+
+// rbx holds the frame, r12 the runtime, and rax, rdx, r11, xmm14 and
+// xmm15 are scratch. The rest are allocated, the callee-saved ones first
+// so fewer need saving around runtime calls.
+const int kGprPool[] = {RBP, R13, R14, R15, RSI, RDI, R8, R9, R10, RCX};
+const int kXmmPool[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13};
+
+bool isCalleeSaved(int gpr) {
+    return gpr == RBP || gpr == R13 || gpr == R14 || gpr == R15;
+}
+
+// Liveness bitsets are limited to this many words per set; past it only
+// the most used variables crossing blocks get registers.
+const size_t kMaxLivenessWords = size_t(1) << 20;
+
+bool sameLoc(const Loc& x, const Loc& y) {
+    return x.kind == y.kind && x.value == y.value && x.disp == y.disp;
+}
+
+// Register operands of an instruction, as masks over a = 1, b = 2, c = 4
+// and d = 8. INPUT reads its variable too: a failed read leaves it as is.
+unsigned readMask(Op op) {
+    switch (op) {
+        case Bytecode::HALT:
+        case Bytecode::CLEAR:
+        case Bytecode::JMP:
+        case Bytecode::OUT_FMT:
+            return 0;
+        case Bytecode::MOV:
+        case Bytecode::I2D:
+        case Bytecode::D2I:
+        case Bytecode::JZ_I:
+        case Bytecode::JNZ_I:
+        case Bytecode::JZ_D:
+        case Bytecode::JNZ_D:
+        case Bytecode::IN_I:
+        case Bytecode::IN_D:
+        case Bytecode::IN_S:
+        case Bytecode::OUT_I:
+        case Bytecode::OUT_D:
+        case Bytecode::OUT_S:
+            return 1;
+        default:
+            return 3;
+    }
+}
+
+unsigned writeMask(Op op) {
+    if (op == Bytecode::ADD_MOV_I) return 12;
+    if (op >= Bytecode::IN_I && op <= Bytecode::IN_S) return 1;
+    if (op >= Bytecode::MOV && op <= Bytecode::NE_D) return 4;
+    return 0;
+}
+
+uint32_t& operand(Instr& instr, int k) {
+    return k == 0 ? instr.a : k == 1 ? instr.b : k == 2 ? instr.c : instr.d;
+}
+
+bool isJump(Op op) {
+    return op >= Bytecode::JMP && op <= Bytecode::BNNE_D;
+}
+
+bool isCall(Op op) {
+    return op >= Bytecode::IN_I && op <= Bytecode::OUT_FMT;
+}
+
+// The bytecode's basic blocks as a graph for solveDataflow. Block b runs
+// from blockStart[b] up to the next block's start; a jump to the end of the
+// code has no successor.
+class BytecodeGraph {
+public:
+    BytecodeGraph(const std::vector<Instr>& code, const std::vector<uint32_t>& blockStart,
+                  const std::vector<uint32_t>& blockOf) {
+        const uint32_t n = static_cast<uint32_t>(code.size());
+        const uint32_t count = static_cast<uint32_t>(blockStart.size());
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+        for (uint32_t b = 0; b < count; ++b) {
+            uint32_t last = b + 1 < count ? blockStart[b + 1] - 1 : n - 1;
+            Op op = code[last].op;
+            uint32_t target = isJump(op) && code[last].c < n ? blockOf[code[last].c] : kNoBlock;
+            uint32_t next = op != Bytecode::HALT && op != Bytecode::JMP && last + 1 < n ? b + 1 : kNoBlock;
+            if (target != kNoBlock) edges.emplace_back(b, target);
+            if (next != kNoBlock && next != target) edges.emplace_back(b, next);
+        }
+        group(edges, count, succStart, succList);
+        for (auto& edge : edges) std::swap(edge.first, edge.second);
+        group(edges, count, predStart, predList);
+
+        // Iterative depth-first search from the entry for the postorder.
+        rpoIndex.assign(count, kNoBlock);
+        std::vector<char> seen(count, 0);
+        std::vector<std::pair<uint32_t, uint32_t>> stack;
+        if (count) {
+            seen[0] = 1;
+            stack.emplace_back(0, 0);
+        }
+        while (!stack.empty()) {
+            uint32_t b = stack.back().first;
+            uint32_t& edge = stack.back().second;
+            if (edge < succStart[b + 1] - succStart[b]) {
+                uint32_t s = succList[succStart[b] + edge++];
+                if (!seen[s]) {
+                    seen[s] = 1;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+            rpo.push_back(b);
+            stack.pop_back();
+        }
+        std::reverse(rpo.begin(), rpo.end());
+        for (uint32_t i = 0; i < rpo.size(); ++i) rpoIndex[rpo[i]] = i;
+    }
+
+    size_t blockCount() const { return rpoIndex.size(); }
+    BlockList preds(uint32_t b) const { return {predList.data() + predStart[b], predList.data() + predStart[b + 1]}; }
+    BlockList succs(uint32_t b) const { return {succList.data() + succStart[b], succList.data() + succStart[b + 1]}; }
+    const std::vector<uint32_t>& reversePostOrder() const { return rpo; }
+    bool isReachable(uint32_t b) const { return rpoIndex[b] != kNoBlock; }
+
+private:
+    std::vector<uint32_t> succList, succStart, predList, predStart;
+    std::vector<uint32_t> rpo, rpoIndex;
+
+    // Targets of the edges from block b end up in list[start[b], start[b + 1]).
+    static void group(const std::vector<std::pair<uint32_t, uint32_t>>& edges, uint32_t count,
+                      std::vector<uint32_t>& start, std::vector<uint32_t>& list) {
+        start.assign(count + 1, 0);
+        for (const auto& edge : edges) ++start[edge.first + 1];
+        for (uint32_t b = 0; b < count; ++b) start[b + 1] += start[b];
+        list.resize(edges.size());
+        std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+        for (const auto& edge : edges) list[fill[edge.first]++] = edge.second;
+    }
+};
+
+// Backward liveness of the variables crossing blocks, as bitsets of `words`
+// words indexed by their global number.
+struct Liveness {
+    using Value = std::vector<uint64_t>;
+
+    const std::vector<uint64_t>& gen;
+    const std::vector<uint64_t>& kill;
+    size_t words;
+
+    Value initial() const { return Value(words, 0); }
+    Value boundary() const { return Value(words, 0); }
+    void meet(Value& into, const Value& from) const {
+        for (size_t w = 0; w < words; ++w) into[w] |= from[w];
+    }
+    void transfer(uint32_t block, const Value& out, Value& in) const {
+        for (size_t w = 0; w < words; ++w) in[w] = gen[block * words + w] | (out[w] & ~kill[block * words + w]);
+    }
+};
+
+}  // namespace
+
+void X64Assembler::dword(uint32_t v) {
+    for (int k = 0; k < 4; ++k) byte(static_cast<int>(v >> (8 * k)));
+}
+
+void X64Assembler::qword(uint64_t v) {
+    for (int k = 0; k < 8; ++k) byte(static_cast<int>(v >> (8 * k)));
+}
+
+void X64Assembler::patch32(size_t at, int32_t v) {
+    std::memcpy(&bytes[at], &v, 4);
+}
+
+void X64Assembler::modrm(int prefix, bool wide, uint32_t opcode, int reg, const Loc& rm) {
+    if (prefix) byte(prefix);
+    int base = rm.kind == Loc::REG || rm.kind == Loc::MEM ? rm.value : rm.kind == Loc::SLOT ? RBX : -1;
+    int rex = (wide ? 8 : 0) | ((reg >> 3) << 2) | (base >= 0 ? base >> 3 : 0);
+    if (rex) byte(0x40 | rex);
+    if (opcode > 0xFFFF) byte(static_cast<int>(opcode >> 16));
+    if (opcode > 0xFF) byte(static_cast<int>(opcode >> 8));
+    byte(static_cast<int>(opcode));
+    int field = (reg & 7) << 3;
+    if (rm.kind == Loc::REG) {
+        byte(0xC0 | field | (rm.value & 7));
+    } else if (rm.kind == Loc::SLOT || rm.kind == Loc::MEM) {
+        int64_t disp = rm.kind == Loc::SLOT ? int64_t(rm.value) * 8 : rm.disp;
+        // [rbp] and [r13] have no form without a displacement, and [rsp]
+        // and [r12] need a SIB byte.
+        int mod = disp == 0 && (base & 7) != RBP ? 0x00 : disp >= -128 && disp < 128 ? 0x40 : 0x80;
+        byte(mod | field | (base & 7));
+        if ((base & 7) == RSP) byte(0x24);
+        if (mod == 0x40) byte(static_cast<int>(disp));
+        else if (mod == 0x80) dword(static_cast<uint32_t>(disp));
+    } else {
+        byte(0x05 | field);
+        if (rm.kind == Loc::LABEL) {
+            labelRef(rm.value);
+        } else {
+            poolRefs.push_back({here(), static_cast<uint32_t>(rm.value)});
+            dword(0);
+        }
+    }
+}
+
+void X64Assembler::aluImm(int ext, const Loc& rm, int32_t imm, bool wide) {
+    bool small = imm >= -128 && imm <= 127;
+    modrm(0, wide, small ? 0x83 : 0x81, ext, rm);
+    if (small) byte(imm);
+    else dword(static_cast<uint32_t>(imm));
+}
+
+void X64Assembler::movImm(int reg, uint32_t value) {
+    if (reg >= 8) byte(0x41);
+    byte(0xB8 + (reg & 7));
+    dword(value);
+}
+
+void X64Assembler::push(int reg) {
+    if (reg >= 8) byte(0x41);
+    byte(0x50 + (reg & 7));
+}
+
+void X64Assembler::pop(int reg) {
+    if (reg >= 8) byte(0x41);
+    byte(0x58 + (reg & 7));
+}
+
+void X64Assembler::jump(int cc, uint32_t target) {
+    if (cc < 0) {
+        byte(0xE9);
+    } else {
+        byte(0x0F);
+        byte(0x80 | cc);
+    }
+    jumpRefs.push_back({here(), target});
+    dword(0);
+}
+
+void X64Assembler::jumpToStub(int cc, uint32_t stub) {
+    byte(0x0F);
+    byte(0x80 | cc);
+    stubRefs.push_back({here(), stub});
+    dword(0);
+}
+
+void X64Assembler::call(const void* function) {
+    byte(0x48);
+    byte(0xB8);
+    qword(reinterpret_cast<uint64_t>(function));
+    byte(0xFF);
+    byte(0xD0);
+}
+
+int X64Assembler::newLabel() {
+    labels.push_back(0);
+    return static_cast<int>(labels.size() - 1);
+}
+
+void X64Assembler::labelRef(int label) {
+    labelRefs.push_back({here(), label});
+    dword(0);
+}
+
+void X64Assembler::jumpTo(int cc, int label) {
+    if (cc < 0) {
+        byte(0xE9);
+    } else {
+        byte(0x0F);
+        byte(0x80 | cc);
+    }
+    labelRef(label);
+}
+
+void X64Assembler::callLabel(int label) {
+    byte(0xE8);
+    labelRef(label);
+}
+
+void X64Assembler::resolveLabels() {
+    for (const auto& ref : labelRefs) {
+        patch32(ref.first, static_cast<int32_t>(int64_t(labels[ref.second]) - int64_t(ref.first + 4)));
+    }
+}
+
+X64Translator::X64Translator(const Bytecode& program, const void* const* routines)
+    : program(program), routines(routines), code(program.code) {
+    for (int k = 0; k < ROUTINE_COUNT; ++k) routineLabels[k] = routines ? -1 : as.newLabel();
+}
+
+void X64Translator::renameScratch() {
+    slotCount = program.registerCount;
+    isDouble.resize(slotCount);
+    for (uint32_t r = 0; r < slotCount; ++r) isDouble[r] = program.types[r] == CType::DOUBLE;
+
+    const uint32_t scratchCount = program.firstConstant - program.firstScratch;
+    std::vector<uint32_t> current(scratchCount);
+    for (uint32_t k = 0; k < scratchCount; ++k) current[k] = program.firstScratch + k;
+    auto isScratch = [&](uint32_t r) { return r >= program.firstScratch && r < program.firstConstant; };
+
+    for (Instr& instr : code) {
+        unsigned reads = readMask(instr.op), writes = writeMask(instr.op);
+        for (int k = 0; k < 4; ++k) {
+            uint32_t& r = operand(instr, k);
+            if ((reads >> k & 1) && isScratch(r)) r = current[r - program.firstScratch];
+        }
+        for (int k = 0; k < 4; ++k) {
+            uint32_t& r = operand(instr, k);
+            if (!(writes >> k & 1) || !isScratch(r)) continue;
+            current[r - program.firstScratch] = slotCount;
+            r = slotCount++;
+            Op op = instr.op;
+            isDouble.push_back(op == Bytecode::I2D || (op >= Bytecode::ADD_D && op <= Bytecode::DIV_D) ||
+                               (op == Bytecode::MOV && isDouble[instr.a]));
+        }
+    }
+}
+
+// Live intervals, one range per vreg from its first to its last live
+// point. Within a block that comes from where the vreg is read and
+// written; across blocks from backward liveness over the vregs some block
+// reads before writing. Every other vreg is dead between blocks.
+void X64Translator::computeIntervals() {
+    const uint32_t n = static_cast<uint32_t>(code.size());
+    start.assign(slotCount, UINT32_MAX);
+    end.assign(slotCount, 0);
+    std::vector<uint32_t> uses(slotCount, 0);
+
+    std::vector<bool> leader(n + 1, false);
+    leader[0] = true;
+    for (uint32_t i = 0; i < n; ++i) {
+        Op op = code[i].op;
+        if (isJump(op)) leader[code[i].c] = true;
+        if (isJump(op) || op == Bytecode::HALT) leader[i + 1] = true;
+    }
+    std::vector<uint32_t> blockStart, blockOf(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (leader[i]) blockStart.push_back(i);
+        blockOf[i] = static_cast<uint32_t>(blockStart.size() - 1);
+    }
+    const size_t blockCount = blockStart.size();
+    auto blockEnd = [&](size_t b) { return b + 1 < blockCount ? blockStart[b + 1] - 1 : n - 1; };
+
+    // Reads before any write in their block, and writes, as (block, vreg).
+    std::vector<std::pair<uint32_t, uint32_t>> exposed, defined;
+    std::vector<uint32_t> writtenIn(slotCount, UINT32_MAX);
+    std::vector<bool> global(slotCount, false);
+    for (uint32_t i = 0; i < n; ++i) {
+        const Instr& instr = code[i];
+        uint32_t b = blockOf[i];
+        unsigned reads = readMask(instr.op), writes = writeMask(instr.op);
+        const uint32_t ops[] = {instr.a, instr.b, instr.c, instr.d};
+        for (int k = 0; k < 4; ++k) {
+            uint32_t r = ops[k];
+            if (!((reads | writes) >> k & 1) || isConstant(r)) continue;
+            start[r] = std::min(start[r], i);
+            end[r] = std::max(end[r], i);
+            ++uses[r];
+            if ((reads >> k & 1) && writtenIn[r] != b) {
+                global[r] = true;
+                exposed.push_back({b, r});
+            }
+        }
+        for (int k = 0; k < 4; ++k) {
+            if (!(writes >> k & 1)) continue;
+            writtenIn[ops[k]] = b;
+            defined.push_back({b, ops[k]});
+        }
+    }
+
+    std::vector<uint32_t> globals;
+    for (uint32_t r = 0; r < slotCount; ++r) {
+        if (global[r]) globals.push_back(r);
+    }
+    size_t limit = std::max<size_t>(64, kMaxLivenessWords / blockCount * 64);
+    if (globals.size() > limit) {
+        std::nth_element(globals.begin(), globals.begin() + limit, globals.end(),
+                         [&](uint32_t x, uint32_t y) { return uses[x] > uses[y]; });
+        // The rest stay in their slots, which start out zero.
+        for (size_t g = limit; g < globals.size(); ++g) start[globals[g]] = UINT32_MAX;
+        globals.resize(limit);
+    }
+    std::vector<uint32_t> globalIndex(slotCount, UINT32_MAX);
+    for (size_t g = 0; g < globals.size(); ++g) globalIndex[globals[g]] = static_cast<uint32_t>(g);
+
+    const size_t words = (globals.size() + 63) / 64;
+    std::vector<uint64_t> gen(blockCount * words), kill(blockCount * words);
+    auto set = [&](std::vector<uint64_t>& bits, uint32_t b, uint32_t r) {
+        uint32_t g = globalIndex[r];
+        if (g != UINT32_MAX) bits[b * words + g / 64] |= uint64_t(1) << (g % 64);
+    };
+    for (const auto& use : exposed) set(gen, use.first, use.second);
+    for (const auto& def : defined) set(kill, def.first, def.second);
+
+    // Blocks no path from the entry reaches never run, so their variables
+    // need no liveness across them.
+    BytecodeGraph graph(code, blockStart, blockOf);
+    DataflowResult<Liveness::Value> live =
+        solveDataflow(graph, Liveness{gen, kill, words}, DataflowDirection::BACKWARD);
+    const std::vector<Liveness::Value>& liveIn = live.before;
+    const std::vector<Liveness::Value>& liveOut = live.after;
+
+    for (size_t b = 0; b < blockCount; ++b) {
+        for (size_t w = 0; w < words; ++w) {
+            for (uint64_t in = liveIn[b][w]; in; in &= in - 1) {
+                uint32_t r = globals[w * 64 + __builtin_ctzll(in)];
+                start[r] = std::min(start[r], blockStart[b]);
+            }
+            for (uint64_t out = liveOut[b][w]; out; out &= out - 1) {
+                uint32_t r = globals[w * 64 + __builtin_ctzll(out)];
+                end[r] = std::max(end[r], static_cast<uint32_t>(blockEnd(b)));
+            }
+        }
+    }
+    for (size_t w = 0; w < words; ++w) {
+        for (uint64_t in = liveIn[0][w]; in; in &= in - 1) zeroOnEntry.push_back(globals[w * 64 + __builtin_ctzll(in)]);
+    }
+}
+
+// Linear scan: intervals by start, each taking a free register of its
+// class, or the one of the active interval ending last when that ends
+// after it, which then lives in its slot. A register is free again only
+// after the instruction its interval ends at, so no instruction reads and
+// writes different vregs through one register.
+void X64Translator::allocate() {
+    reg.assign(slotCount, -1);
+    for (uint32_t r = 0; r < slotCount; ++r) {
+        if (start[r] != UINT32_MAX) byStart.push_back(r);
+    }
+    std::sort(byStart.begin(), byStart.end(), [&](uint32_t x, uint32_t y) {
+        return start[x] != start[y] ? start[x] < start[y] : x < y;
+    });
+
+    std::vector<int> freeRegs[2];
+    for (int k = sizeof(kGprPool) / sizeof(int); k-- > 0;) freeRegs[0].push_back(kGprPool[k]);
+    for (int k = sizeof(kXmmPool) / sizeof(int); k-- > 0;) freeRegs[1].push_back(kXmmPool[k]);
+    // Per class, by end.
+    std::vector<uint32_t> active[2];
+    auto byEnd = [&](uint32_t x, uint32_t y) { return end[x] < end[y]; };
+
+    for (uint32_t r : byStart) {
+        for (int cls = 0; cls < 2; ++cls) {
+            std::vector<uint32_t>& list = active[cls];
+            size_t expired = 0;
+            while (expired < list.size() && end[list[expired]] < start[r]) freeRegs[cls].push_back(reg[list[expired++]]);
+            list.erase(list.begin(), list.begin() + expired);
+        }
+        int cls = isDouble[r] ? 1 : 0;
+        std::vector<uint32_t>& list = active[cls];
+        if (!freeRegs[cls].empty()) {
+            reg[r] = freeRegs[cls].back();
+            freeRegs[cls].pop_back();
+        } else if (end[list.back()] > end[r]) {
+            reg[r] = reg[list.back()];
+            reg[list.back()] = -1;
+            list.pop_back();
+        } else {
+            continue;
+        }
+        list.insert(std::upper_bound(list.begin(), list.end(), r, byEnd), r);
+    }
+    byStart.erase(std::remove_if(byStart.begin(), byStart.end(), [&](uint32_t r) { return reg[r] < 0; }),
+                  byStart.end());
+}
+
+Loc X64Translator::loc(uint32_t r) const {
+    if (isConstant(r)) {
+        if (program.types[r] == CType::DOUBLE) return {Loc::POOL, static_cast<int32_t>(r - program.firstConstant)};
+        return {Loc::IMM, program.constants[r - program.firstConstant].i};
+    }
+    return reg[r] >= 0 ? inReg(reg[r]) : inSlot(r);
+}
+
+void X64Translator::movGpr(int dst, const Loc& src) {
+    if (src.kind == Loc::IMM) {
+        if (src.value == 0) {
+            as.modrm(0, false, 0x33, dst, inReg(dst));
+            return;
+        }
+        as.movImm(dst, static_cast<uint32_t>(src.value));
+        return;
+    }
+    if (src.kind == Loc::REG && src.value == dst) return;
+    as.modrm(0, false, 0x8B, dst, src);
+}
+
+void X64Translator::storeGpr(const Loc& dst, int src) {
+    if (dst.kind == Loc::REG) movGpr(dst.value, inReg(src));
+    else as.modrm(0, false, 0x89, src, dst);
+}
+
+void X64Translator::movXmm(int dst, const Loc& src) {
+    if (src.kind == Loc::REG) {
+        if (src.value != dst) as.modrm(0x66, false, 0x0F28, dst, src);
+        return;
+    }
+    as.modrm(0xF2, false, 0x0F10, dst, src);
+}
+
+void X64Translator::storeXmm(const Loc& dst, int src) {
+    if (dst.kind == Loc::REG) movXmm(dst.value, inReg(src));
+    else as.modrm(0xF2, false, 0x0F11, src, dst);
+}
+
+int X64Translator::xmmOf(const Loc& src, int scratch) {
+    if (src.kind == Loc::REG) return src.value;
+    movXmm(scratch, src);
+    return scratch;
+}
+
+// Flags for a signed compare of a with b.
+void X64Translator::intCompare(const Loc& a, const Loc& b) {
+    if (a.kind == Loc::SLOT && b.kind == Loc::REG) {
+        as.modrm(0, false, 0x39, b.value, a);
+        return;
+    }
+    if (a.kind == Loc::SLOT && b.kind == Loc::IMM) {
+        as.aluImm(7, a, b.value);
+        return;
+    }
+    int x = a.kind == Loc::REG ? a.value : RAX;
+    movGpr(x, a);
+    if (b.kind == Loc::IMM) as.aluImm(7, inReg(x), b.value);
+    else as.modrm(0, false, 0x3B, x, b);
+}
+
+// ucomisd, ordered so relation `rel` (LT..GE) holds exactly when the
+// carry and zero flags say "above" (LT, GT) or "above or equal" (LE, GE):
+// both are clear for NaN.
+void X64Translator::doubleCompare(int rel, const Loc& a, const Loc& b) {
+    const Loc& x = rel <= 1 ? b : a;
+    const Loc& y = rel <= 1 ? a : b;
+    as.modrm(0x66, false, 0x0F2E, xmmOf(x, XMM_SCRATCH), y);
+}
+
+// Jumps to `target` when relation `rel` of the last doubleCompare holds
+// (or does not). Equality needs the parity flag: unordered is not equal.
+void X64Translator::branchDouble(int rel, bool holds, uint32_t target) {
+    if (rel < 4) {
+        bool orEqual = rel == 1 || rel == 3;
+        as.jump(holds ? (orEqual ? CC_AE : CC_A) : (orEqual ? CC_B : CC_BE), target);
+        return;
+    }
+    if ((rel == 4) == holds) {
+        as.byte(0x7A);
+        as.byte(6);
+        as.jump(CC_E, target);
+    } else {
+        as.jump(CC_P, target);
+        as.jump(CC_NE, target);
+    }
+}
+
+// al = relation `rel` of the last doubleCompare.
+void X64Translator::setDouble(int rel) {
+    if (rel < 4) {
+        as.modrm(0, false, 0x0F90 | (rel == 1 || rel == 3 ? CC_AE : CC_A), 0, inReg(RAX));
+        return;
+    }
+    as.modrm(0, false, 0x0F90 | (rel == 4 ? CC_E : CC_NE), 0, inReg(RAX));
+    as.modrm(0, false, 0x0F90 | (rel == 4 ? CC_NP : CC_P), 0, inReg(RDX));
+    as.modrm(0, false, rel == 4 ? 0x20 : 0x08, RDX, inReg(RAX));
+}
+
+// Saves the caller-saved registers of everything live across the runtime
+// call at instruction i, makes the call, and reloads them. `open` holds
+// the allocated intervals started so far that may still be live.
+void X64Translator::emitCall(uint32_t i, std::vector<uint32_t>& open, size_t& nextOpen) {
+    const Instr& instr = code[i];
+    while (nextOpen < byStart.size() && start[byStart[nextOpen]] <= i) open.push_back(byStart[nextOpen++]);
+    open.erase(std::remove_if(open.begin(), open.end(), [&](uint32_t r) { return end[r] <= i; }), open.end());
+
+    bool isInput = instr.op <= Bytecode::IN_S;
+    std::vector<uint32_t> saved;
+    for (uint32_t r : open) {
+        if ((isInput && r == instr.a) || (!isDouble[r] && isCalleeSaved(reg[r]))) continue;
+        saved.push_back(r);
+    }
+    if (isInput && reg[instr.a] >= 0) saved.push_back(instr.a);
+    for (uint32_t r : saved) {
+        if (isDouble[r]) storeXmm(inSlot(r), reg[r]);
+        else storeGpr(inSlot(r), reg[r]);
+    }
+
+    int routine;
+    switch (instr.op) {
+        case Bytecode::IN_I:
+        case Bytecode::IN_D:
+        case Bytecode::IN_S:
+            movGpr(RSI, {Loc::IMM, static_cast<int32_t>(instr.a)});
+            as.modrm(0, true, 0x8D, RDX, inSlot(instr.a));
+            movGpr(RCX, {Loc::IMM, static_cast<int32_t>(instr.op == Bytecode::IN_I   ? INPUT_INT
+                                                        : instr.op == Bytecode::IN_D ? INPUT_DOUBLE
+                                                                                     : INPUT_STRING)});
+            routine = ROUTINE_INPUT;
+            break;
+        case Bytecode::OUT_I:
+            movGpr(RSI, loc(instr.a));
+            routine = ROUTINE_OUTPUT_INT;
+            break;
+        case Bytecode::OUT_D:
+            movXmm(XMM0, loc(instr.a));
+            routine = ROUTINE_OUTPUT_DOUBLE;
+            break;
+        case Bytecode::OUT_S:
+            movGpr(RSI, loc(instr.a));
+            routine = ROUTINE_OUTPUT_STRING;
+            break;
+        default:
+            movGpr(RSI, {Loc::IMM, static_cast<int32_t>(instr.a)});
+            routine = ROUTINE_OUTPUT_FORMAT;
+            break;
+    }
+    as.modrm(0, true, 0x8B, RDI, inReg(R12));
+    if (routines) as.call(routines[routine]);
+    else as.callLabel(routineLabels[routine]);
+
+    for (uint32_t r : saved) {
+        if (isDouble[r]) movXmm(reg[r], inSlot(r));
+        else movGpr(reg[r], inSlot(r));
+    }
+}
+
+void X64Translator::emitInstruction(uint32_t i) {
+    const Instr& instr = code[i];
+    const Op op = instr.op;
+    const Loc a = loc(instr.a), b = loc(instr.b);
+    switch (op) {
+        case Bytecode::MOV: {
+            Loc c = loc(instr.c);
+            if (sameLoc(a, c)) break;
+            if (isDouble[instr.a]) {
+                if (c.kind == Loc::REG) movXmm(c.value, a);
+                else storeXmm(c, xmmOf(a, XMM_SCRATCH));
+            } else if (c.kind == Loc::REG) {
+                movGpr(c.value, a);
+            } else if (a.kind == Loc::IMM) {
+                as.modrm(0, false, 0xC7, 0, c);
+                as.dword(static_cast<uint32_t>(a.value));
+            } else {
+                int x = a.kind == Loc::REG ? a.value : RAX;
+                movGpr(x, a);
+                storeGpr(c, x);
+            }
+            break;
+        }
+        case Bytecode::I2D: {
+            Loc c = loc(instr.c);
+            int x = c.kind == Loc::REG ? c.value : XMM_SCRATCH;
+            Loc from = a;
+            if (a.kind == Loc::IMM) {
+                movGpr(RAX, a);
+                from = inReg(RAX);
+            }
+            // Clearing first keeps cvtsi2sd from waiting on the old value.
+            as.modrm(0, false, 0x0F57, x, inReg(x));
+            as.modrm(0xF2, false, 0x0F2A, x, from);
+            if (c.kind != Loc::REG) storeXmm(c, x);
+            break;
+        }
+        case Bytecode::D2I: {
+            Loc c = loc(instr.c);
+            int x = c.kind == Loc::REG ? c.value : RAX;
+            as.modrm(0xF2, false, 0x0F2C, x, a);
+            if (c.kind != Loc::REG) storeGpr(c, x);
+            break;
+        }
+        case Bytecode::CLEAR: {
+            Loc c = loc(instr.c);
+            if (c.kind != Loc::REG) {
+                as.modrm(0, true, 0xC7, 0, c);
+                as.dword(0);
+            } else if (isDouble[instr.c]) {
+                as.modrm(0, false, 0x0F57, c.value, c);
+            } else {
+                movGpr(c.value, {Loc::IMM, 0});
+            }
+            break;
+        }
+        case Bytecode::ADD_I:
+        case Bytecode::SUB_I:
+        case Bytecode::MUL_I:
+        case Bytecode::ADD_MOV_I: {
+            Loc c = loc(instr.c);
+            Loc x = a, y = b;
+            int dst = c.kind == Loc::REG ? c.value : RAX;
+            if (y.kind == Loc::REG && y.value == dst && !sameLoc(x, y)) {
+                if (op == Bytecode::SUB_I) dst = RAX;
+                else std::swap(x, y);
+            }
+            movGpr(dst, x);
+            if (op == Bytecode::MUL_I) {
+                if (y.kind == Loc::IMM) {
+                    as.modrm(0, false, 0x69, dst, inReg(dst));
+                    as.dword(static_cast<uint32_t>(y.value));
+                } else {
+                    as.modrm(0, false, 0x0FAF, dst, y);
+                }
+            } else if (y.kind == Loc::IMM) {
+                as.aluImm(op == Bytecode::SUB_I ? 5 : 0, inReg(dst), y.value);
+            } else {
+                as.modrm(0, false, op == Bytecode::SUB_I ? 0x2B : 0x03, dst, y);
+            }
+            if (!(c.kind == Loc::REG && c.value == dst)) storeGpr(c, dst);
+            if (op == Bytecode::ADD_MOV_I) storeGpr(loc(instr.d), dst);
+            break;
+        }
+        case Bytecode::DIV_I: {
+            movGpr(RAX, a);
+            int divisor = b.kind == Loc::REG ? b.value : R11;
+            movGpr(divisor, b);
+            if (b.kind != Loc::IMM || b.value == 0 || b.value == -1) {
+                stubs.push_back({program.lines[i], kX64DivisionByZero});
+                as.modrm(0, false, 0x85, divisor, inReg(divisor));
+                as.jumpToStub(CC_E, static_cast<uint32_t>(stubs.size() - 1));
+                as.aluImm(7, inReg(divisor), -1);
+                as.byte(0x75);
+                size_t skip = as.here();
+                as.byte(0);
+                as.aluImm(7, inReg(RAX), INT32_MIN);
+                stubs.push_back({program.lines[i], kX64DivisionOverflow});
+                as.jumpToStub(CC_E, static_cast<uint32_t>(stubs.size() - 1));
+                as.bytes[skip] = static_cast<uint8_t>(as.here() - skip - 1);
+            }
+            as.byte(0x99);
+            as.modrm(0, false, 0xF7, 7, inReg(divisor));
+            storeGpr(loc(instr.c), RAX);
+            break;
+        }
+        case Bytecode::ADD_D:
+        case Bytecode::SUB_D:
+        case Bytecode::MUL_D:
+        case Bytecode::DIV_D: {
+            static const uint32_t opcodes[] = {0x0F58, 0x0F5C, 0x0F59, 0x0F5E};
+            Loc c = loc(instr.c);
+            int dst = c.kind == Loc::REG ? c.value : XMM_SCRATCH;
+            // Not swapped when commutative: with two NaNs the first
+            // operand's sign is the one printed.
+            if (b.kind == Loc::REG && b.value == dst && !sameLoc(a, b)) dst = XMM_SCRATCH;
+            movXmm(dst, a);
+            as.modrm(0xF2, false, opcodes[op - Bytecode::ADD_D], dst, b);
+            if (!(c.kind == Loc::REG && c.value == dst)) storeXmm(c, dst);
+            break;
+        }
+        case Bytecode::LT_I:
+        case Bytecode::LE_I:
+        case Bytecode::GT_I:
+        case Bytecode::GE_I:
+        case Bytecode::EQ_I:
+        case Bytecode::NE_I:
+        case Bytecode::LT_D:
+        case Bytecode::LE_D:
+        case Bytecode::GT_D:
+        case Bytecode::GE_D:
+        case Bytecode::EQ_D:
+        case Bytecode::NE_D: {
+            bool isInt = op <= Bytecode::NE_I;
+            int rel = isInt ? op - Bytecode::LT_I : op - Bytecode::LT_D;
+            if (isInt) {
+                intCompare(a, b);
+                as.modrm(0, false, 0x0F90 | kIntCondition[rel], 0, inReg(RAX));
+            } else {
+                doubleCompare(rel, a, b);
+                setDouble(rel);
+            }
+            Loc c = loc(instr.c);
+            int dst = c.kind == Loc::REG ? c.value : RAX;
+            as.modrm(0, false, 0x0FB6, dst, inReg(RAX));
+            if (c.kind != Loc::REG) storeGpr(c, dst);
+            break;
+        }
+        case Bytecode::JMP:
+            if (instr.c != i + 1) as.jump(-1, instr.c);
+            break;
+        case Bytecode::JZ_I:
+        case Bytecode::JNZ_I: {
+            bool onZero = op == Bytecode::JZ_I;
+            if (a.kind == Loc::IMM) {
+                if ((a.value == 0) == onZero) as.jump(-1, instr.c);
+                break;
+            }
+            if (a.kind == Loc::REG) as.modrm(0, false, 0x85, a.value, a);
+            else as.aluImm(7, a, 0);
+            as.jump(onZero ? CC_E : CC_NE, instr.c);
+            break;
+        }
+        case Bytecode::JZ_D:
+        case Bytecode::JNZ_D:
+            as.modrm(0, false, 0x0F57, XMM_ZERO, inReg(XMM_ZERO));
+            as.modrm(0x66, false, 0x0F2E, xmmOf(a, XMM_SCRATCH), inReg(XMM_ZERO));
+            branchDouble(4, op == Bytecode::JZ_D, instr.c);
+            break;
+        case Bytecode::BLT_I:
+        case Bytecode::BLE_I:
+        case Bytecode::BGT_I:
+        case Bytecode::BGE_I:
+        case Bytecode::BEQ_I:
+        case Bytecode::BNE_I:
+            intCompare(a, b);
+            as.jump(kIntCondition[op - Bytecode::BLT_I], instr.c);
+            break;
+        case Bytecode::BLT_D:
+        case Bytecode::BLE_D:
+        case Bytecode::BGT_D:
+        case Bytecode::BGE_D:
+        case Bytecode::BEQ_D:
+        case Bytecode::BNE_D:
+        case Bytecode::BNLT_D:
+        case Bytecode::BNLE_D:
+        case Bytecode::BNGT_D:
+        case Bytecode::BNGE_D:
+        case Bytecode::BNEQ_D:
+        case Bytecode::BNNE_D: {
+            bool holds = op <= Bytecode::BNE_D;
+            int rel = holds ? op - Bytecode::BLT_D : op - Bytecode::BNLT_D;
+            doubleCompare(rel, a, b);
+            branchDouble(rel, holds, instr.c);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Entry: uint32_t (Value* frame, void* runtime), returning 0 or an error
+// from a stub.
+void X64Translator::emitCode() {
+    static const int kSaved[] = {RBP, RBX, R12, R13, R14, R15};
+    for (int r : kSaved) as.push(r);
+    as.modrm(0, true, 0x83, 5, inReg(RSP));
+    as.byte(8);
+    as.modrm(0, true, 0x8B, RBX, inReg(RDI));
+    as.modrm(0, true, 0x8B, R12, inReg(RSI));
+    for (uint32_t r : zeroOnEntry) {
+        if (reg[r] < 0) continue;
+        if (isDouble[r]) as.modrm(0, false, 0x0F57, reg[r], inReg(reg[r]));
+        else movGpr(reg[r], {Loc::IMM, 0});
+    }
+
+    const uint32_t n = static_cast<uint32_t>(code.size());
+    std::vector<size_t> offsets(n);
+    std::vector<size_t> exits;
+    std::vector<uint32_t> open;
+    size_t nextOpen = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        offsets[i] = as.here();
+        if (code[i].op == Bytecode::HALT) {
+            movGpr(RAX, {Loc::IMM, 0});
+            if (i + 1 < n) {
+                as.byte(0xE9);
+                exits.push_back(as.here());
+                as.dword(0);
+            }
+        } else if (isCall(code[i].op)) {
+            emitCall(i, open, nextOpen);
+        } else {
+            emitInstruction(i);
+        }
+    }
+
+    size_t exit = as.here();
+    as.modrm(0, true, 0x83, 0, inReg(RSP));
+    as.byte(8);
+    for (int k = sizeof(kSaved) / sizeof(int); k-- > 0;) as.pop(kSaved[k]);
+    as.byte(0xC3);
+
+    std::vector<size_t> stubOffsets;
+    for (const Stub& stub : stubs) {
+        stubOffsets.push_back(as.here());
+        movGpr(RAX, {Loc::IMM, static_cast<int32_t>(static_cast<uint32_t>(stub.line) << 2 | stub.kind)});
+        as.byte(0xE9);
+        exits.push_back(as.here());
+        as.dword(0);
+    }
+
+    while (as.here() % 8) as.byte(0xCC);
+    size_t pool = as.here();
+    for (const Value& value : program.constants) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, 8);
+        as.qword(bits);
+    }
+
+    auto relative = [&](size_t at, size_t target) { as.patch32(at, static_cast<int32_t>(target - (at + 4))); };
+    for (const auto& ref : as.jumpRefs) relative(ref.first, offsets[ref.second]);
+    for (const auto& ref : as.stubRefs) relative(ref.first, stubOffsets[ref.second]);
+    for (const auto& ref : as.poolRefs) relative(ref.first, pool + 8 * ref.second);
+    for (size_t at : exits) relative(at, exit);
+}
+
+void X64Translator::translate() {
+    renameScratch();
+    computeIntervals();
+    allocate();
+    emitCode();
+}
\ No newline at end of file
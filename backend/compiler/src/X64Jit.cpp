@@ -0,0 +1,110 @@
+#include "X64Jit.h"
+#include "X64CodeGen.h"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_HAVE_X64 1
+#include <sys/mman.h>
+#else
+#define JIT_HAVE_X64 0
+#endif
+
+#if JIT_HAVE_X64
+
+namespace {
+
+using Value = Bytecode::Value;
+
+// What generated code calls INPUT and OUTPUT through, with the interpreter's
+// formats.
+struct Runtime {
+    std::FILE* in;
+    std::FILE* out;
+    const Bytecode* program;
+};
+
+void runtimeInput(Runtime* rt, uint32_t symbol, Value* slot, uint32_t kind) {
+    std::fprintf(rt->out, "Enter value for %s: ", rt->program->symbolNames[symbol].c_str());
+    std::fflush(rt->out);
+    double value;
+    if (std::fscanf(rt->in, "%lf", &value) != 1) return;
+    if (kind == INPUT_INT) slot->i = truncateToInt(value);
+    else if (kind == INPUT_DOUBLE) slot->d = value;
+    else slot->d = 0.0;
+}
+
+void runtimeOutputInt(Runtime* rt, int32_t value) {
+    std::fprintf(rt->out, "%d\n", value);
+}
+
+void runtimeOutputDouble(Runtime* rt, double value) {
+    std::fprintf(rt->out, "%lf\n", value);
+}
+
+void runtimeOutputString(Runtime* rt, uint32_t value) {
+    std::fputs(rt->program->texts[value].c_str(), rt->out);
+    std::fputc('\n', rt->out);
+}
+
+void runtimeOutputFormat(Runtime* rt, uint32_t index) {
+    std::fputs(rt->program->formats[index].c_str(), rt->out);
+}
+
+}  // namespace
+
+X64Jit::X64Jit(const IRProgram& ir) : program(ir) {
+    static const void* const kRoutines[ROUTINE_COUNT] = {
+        reinterpret_cast<const void*>(&runtimeInput), reinterpret_cast<const void*>(&runtimeOutputInt),
+        reinterpret_cast<const void*>(&runtimeOutputDouble), reinterpret_cast<const void*>(&runtimeOutputString),
+        reinterpret_cast<const void*>(&runtimeOutputFormat)};
+    X64Translator translator(program, kRoutines);
+    translator.translate();
+    slotCount = translator.slotCount;
+
+    const std::vector<uint8_t>& bytes = translator.as.bytes;
+    codeSize = bytes.size();
+    void* memory = mmap(nullptr, codeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        errorMessage = "Could not map memory for the generated code.";
+        return;
+    }
+    std::memcpy(memory, bytes.data(), codeSize);
+    if (mprotect(memory, codeSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, codeSize);
+        errorMessage = "Could not make the generated code executable.";
+        return;
+    }
+    codeMemory = memory;
+}
+
+X64Jit::~X64Jit() {
+    if (codeMemory) munmap(codeMemory, codeSize);
+}
+
+bool X64Jit::run(std::FILE* in, std::FILE* out) {
+    if (!codeMemory) return false;
+    errorMessage.clear();
+    std::vector<Value> frame(slotCount);
+    Runtime runtime = {in, out, &program};
+    using Entry = uint32_t (*)(Value*, Runtime*);
+    uint32_t status = reinterpret_cast<Entry>(codeMemory)(frame.data(), &runtime);
+    std::fflush(out);
+    if (status == 0) return true;
+    errorMessage = "Line " + std::to_string(status >> 2) + ": " +
+                   ((status & 3) == kX64DivisionByZero ? "Integer division by zero." : "Integer overflow in division.");
+    return false;
+}
+
+#else
+
+X64Jit::X64Jit(const IRProgram& ir) : program(ir) {
+    errorMessage = "The JIT backend needs an x86-64 Linux build.";
+}
+
+X64Jit::~X64Jit() {}
+
+bool X64Jit::run(std::FILE*, std::FILE*) {
+    return false;
+}
+
+#endif
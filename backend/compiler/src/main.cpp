@@ -1,137 +1,237 @@
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
-#include <filesystem>
-#include <vector>
+#include <memory>
 #include <string>
-#include <sstream>
-
-#include "Lexer.h"
-#include "Parser.h"
-#include "SemanticAnalyzer.h"
-#include "IntermediateCodeGen.h"
-#include "Optimizer.h"
-#include "CodeGenerator.h"
-
-namespace fs = std::filesystem;
+#include <vector>
 
+#include "SourceBuffer.h"
+#include "Driver.h"
+#include "Server.h"
+#include "Batch.h"
+#include "CompileCache.h"
+#include "Interpreter.h"
+#include "X64Jit.h"
+#include "ElfWriter.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static void printUsage() {
+    std::cerr << "Usage: compiler.exe [--emit=tokens,errors,ir,opt-ir,c,stats] [--stream] [--stats] [--cache=<dir>] <input_file> <output_dir|->\n"
+              << "       compiler.exe --batch [--jobs=N] [--emit=...] [--cache=<dir>] <manifest|dir> <output_dir|->\n"
+              << "       compiler.exe --serve[=unix:<socket_path>] [--cache=<dir>]\n"
+              << "       compiler.exe --run[=vm|jit] <input_file>\n"
+              << "       compiler.exe --native <input_file> <executable>\n"
+              << "An output_dir of '-' writes the selected artifacts to stdout as one section stream.\n"
+              << "--stream compiles statement by statement into output_dir with flat memory use.\n"
+              << "--stats adds per-phase timings, allocations and counters (stats.json) and a Chrome trace (trace.json).\n"
+              << "--cache=<dir> reuses results stored for identical sources; --cache-size=<MB> bounds it (default 256).\n"
+              << "--run compiles and runs the program in process, reading its input from stdin and printing to stdout;\n"
+              << "  --run=jit runs it as x86-64 machine code instead of in the bytecode interpreter.\n"
+              << "--native writes the program as a standalone x86-64 Linux executable, without a C compiler.\n";
+}
 
-std::string irInstructionToString(const IRInstruction& instr) {
-    std::stringstream ss;
-    ss << "Line " << instr.line << ": " << instr.opcode;
-    if (!instr.operands.empty()) {
-        ss << " ";
-        for (size_t i = 0; i < instr.operands.size(); ++i) {
-            ss << instr.operands[i];
-            if (i != instr.operands.size() - 1) ss << ", ";
-        }
+// --run: compile errors go to stderr; a program that compiles runs on this
+// process's stdin and stdout, in the interpreter or as machine code.
+template <typename Backend>
+static int runOn(Backend& backend) {
+    if (!backend.run(stdin, stdout)) {
+        std::cerr << backend.error() << "\n";
+        return 1;
     }
-    return ss.str();
+    return 0;
 }
 
-void writeToFile(const fs::path& path, const std::string& content) {
-    std::ofstream out(path);
-    if (out.is_open()) {
-        out << content;
+static int runProgram(const std::string& inputPath, bool jit) {
+    SourceBuffer code;
+    if (!code.open(inputPath)) {
+        std::cerr << "Failed to open input file.\n";
+        return 1;
     }
+    CompilerDriver driver;
+    const CompileArtifacts& artifacts = driver.compile(code.view(), EMIT_ERRORS | EMIT_PROGRAM);
+    if (!artifacts.errors.empty()) {
+        for (const auto& error : artifacts.errors) std::cerr << error << "\n";
+        return 1;
+    }
+    if (jit) {
+        X64Jit backend(driver.getProgram());
+        return runOn(backend);
+    }
+    IRInterpreter backend(driver.getProgram());
+    return runOn(backend);
 }
 
-std::string vectorToString(const std::vector<IRInstruction>& vec) {
-    std::stringstream ss;
-    for (const auto& instr : vec) {
-        ss << irInstructionToString(instr) << "\n";  
+// --native: compile errors go to stderr; a program that compiles is
+// written out as an executable.
+static int writeNative(const std::string& inputPath, const std::string& outputPath) {
+    SourceBuffer code;
+    if (!code.open(inputPath)) {
+        std::cerr << "Failed to open input file.\n";
+        return 1;
+    }
+    CompilerDriver driver;
+    const CompileArtifacts& artifacts = driver.compile(code.view(), EMIT_ERRORS | EMIT_PROGRAM);
+    if (!artifacts.errors.empty()) {
+        for (const auto& error : artifacts.errors) std::cerr << error << "\n";
+        return 1;
     }
-    return ss.str();
+    ElfWriter writer(driver.getProgram());
+    if (!writer.write(outputPath)) {
+        std::cerr << writer.error() << "\n";
+        return 1;
+    }
+    return 0;
 }
 
-void writeListToFile(const fs::path& path, const std::vector<std::string>& lines) {
-    std::ofstream out(path);
-    if (out.is_open()) {
-        for (const auto& line : lines) {
-            out << line << "\n";
+int main(int argc, char* argv[]) {
+    unsigned emit = EMIT_ALL;
+    bool streaming = false;
+    bool stats = false;
+    bool batch = false;
+    unsigned jobs = 0;
+    bool serve = false;
+    bool run = false;
+    bool jit = false;
+    bool native = false;
+    std::string endpoint;
+    std::string cacheDir;
+    uint64_t cacheMegabytes = 256;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--serve" || arg.compare(0, 8, "--serve=") == 0) {
+            serve = true;
+            endpoint = arg.size() > 7 ? arg.substr(8) : "";
+            continue;
+        }
+        if (arg.compare(0, 8, "--cache=") == 0) {
+            cacheDir = arg.substr(8);
+            continue;
+        }
+        if (arg.compare(0, 13, "--cache-size=") == 0) {
+            cacheMegabytes = std::strtoull(arg.c_str() + 13, nullptr, 10);
+            continue;
+        }
+        if (arg.compare(0, 7, "--emit=") == 0) {
+            if (!parseEmitList(arg.substr(7), emit)) {
+                std::cerr << "Unknown artifact in " << arg << "\n";
+                printUsage();
+                return 1;
+            }
+            continue;
+        }
+        if (arg == "--stream") {
+            streaming = true;
+            continue;
+        }
+        if (arg == "--stats") {
+            stats = true;
+            continue;
+        }
+        if (arg == "--run" || arg == "--run=vm" || arg == "--run=jit") {
+            run = true;
+            jit = arg == "--run=jit";
+            continue;
         }
+        if (arg == "--native") {
+            native = true;
+            continue;
+        }
+        if (arg == "--batch") {
+            batch = true;
+            continue;
+        }
+        if (arg.compare(0, 7, "--jobs=") == 0) {
+            jobs = static_cast<unsigned>(std::strtoul(arg.c_str() + 7, nullptr, 10));
+            continue;
+        }
+        positional.push_back(arg);
     }
-}
 
-int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        std::cerr << "Usage: compiler.exe <input_file> <output_dir>\n";
-        return 1;
+    if (stats) emit |= EMIT_STATS;
+
+    std::unique_ptr<CompileCache> cache;
+    if (!cacheDir.empty()) {
+        if (streaming) {
+            std::cerr << "--cache cannot be combined with --stream.\n";
+            return 1;
+        }
+        cache = std::make_unique<CompileCache>(cacheDir, cacheMegabytes * 1024 * 1024);
     }
 
-    std::string inputPath = argv[1];
-    std::string outputDir = argv[2];
+    if (serve) return runCompileServer(endpoint, cache.get());
 
-    std::ifstream inFile(inputPath);
-    if (!inFile.is_open()) {
-        std::cerr << "Failed to open input file.\n";
-        return 1;
+    if (run) {
+        if (streaming || batch || !cacheDir.empty() || positional.size() != 1) {
+            printUsage();
+            return 1;
+        }
+        return runProgram(positional[0], jit);
     }
 
-    std::string code((std::istreambuf_iterator<char>(inFile)),
-                     std::istreambuf_iterator<char>());
+    if (native) {
+        if (streaming || batch || !cacheDir.empty() || positional.size() != 2) {
+            printUsage();
+            return 1;
+        }
+        return writeNative(positional[0], positional[1]);
+    }
 
-    fs::create_directories(outputDir);
+    if (positional.size() < 2) {
+        printUsage();
+        return 1;
+    }
 
-    std::vector<std::string> errors;
-    std::string ccode;
-    std::vector<IRInstruction> irCode;
-    std::vector<IRInstruction> optimizedIR;
+    const std::string& inputPath = positional[0];
+    const std::string& outputDir = positional[1];
 
-    Lexer lexer(code);
-    auto tokens = lexer.tokenize();
-    std::ostringstream tokenStream;
-    for (const auto& token : tokens) {
-        tokenStream << "Type: " << static_cast<int>(token.type)
-                    << ", Lexeme: " << token.lexeme
-                    << ", Line: " << token.line
-                    << ", Col: " << token.column << "\n";
-        if (token.type == TokenType::INVALID) {
-            errors.push_back("Lexical error at line " + std::to_string(token.line) +
-                             ", column " + std::to_string(token.column) + ": Invalid token '" + token.lexeme + "'");
+    if (batch) {
+        if (streaming) {
+            std::cerr << "--stream cannot be combined with --batch.\n";
+            return 1;
         }
+        return runBatchCompile(inputPath, outputDir, emit, jobs, cache.get());
     }
-    
-    writeToFile(fs::path(outputDir) / "tokens.txt", tokenStream.str());
-
-    Parser parser(tokens);
-    auto ast = parser.parse();
-    auto parseErrors = parser.getErrors();
-    errors.insert(errors.end(), parseErrors.begin(), parseErrors.end());
 
-    SemanticAnalyzer sema;
-    sema.analyze(ast.get());
-    auto semaErrors = sema.getErrors();
-    errors.insert(errors.end(), semaErrors.begin(), semaErrors.end());
+    SourceBuffer code;
+    if (!code.open(inputPath)) {
+        std::cerr << "Failed to open input file.\n";
+        return 1;
+    }
 
-    if (!errors.empty()) {
-        writeListToFile(fs::path(outputDir) / "errors.txt", errors);
-        writeToFile(fs::path(outputDir) / "c_code.txt", "// No C code generated due to errors.\n");
+    CompilerDriver driver;
+    driver.setCache(cache.get());
+    if (streaming) {
+        if (outputDir == "-") {
+            std::cerr << "--stream needs an output directory.\n";
+            return 1;
+        }
+        if (!driver.compileStreaming(code, outputDir, emit)) {
+            std::cerr << "Failed to create output files.\n";
+            return 1;
+        }
         return 0;
-    } else {
-        writeListToFile(fs::path(outputDir) / "errors.txt", { "No errors." });
     }
 
-    IntermediateCodeGen icg;
-    icg.generate(ast.get());
-    irCode = icg.getIR();
-    std::string irstr = vectorToString(irCode);
-    writeToFile(fs::path(outputDir) / "ir.txt", irstr);
+    const CompileArtifacts& artifacts = driver.compile(code.view(), emit);
 
-    Optimizer optimizer;
-    optimizer.optimize(irCode);
-    optimizedIR = optimizer.getOptimizedIR();
-    std::string oIrstr = vectorToString(optimizedIR);
-    writeToFile(fs::path(outputDir) / "optimized_ir.txt", oIrstr);
-
-    CodeGenerator codegen;
-    codegen.generate(optimizedIR);
-    ccode = codegen.getCCode();
-    writeToFile(fs::path(outputDir) / "c_code.txt", ccode);
+    if (outputDir == "-") {
+        std::string stream;
+        appendArtifactSections(stream, artifacts);
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::fwrite(stream.data(), 1, stream.size(), stdout);
+        std::fflush(stdout);
+        return 0;
+    }
 
-    writeToFile(fs::path(outputDir) / "output.txt", "Program compiled successfully.");
+    writeArtifactFiles(outputDir, artifacts);
 
     return 0;
 }
-
-
-
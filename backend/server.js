@@ -3,15 +3,11 @@ import express from "express";
 import cors from "cors";
 import {
   writeFile,
-  unlink,
   mkdir,
-  rm,
-  readFile,
   readdir,
   stat,
 } from "fs/promises";
-import { execFile, spawn } from "child_process";
-import { promisify } from "util";
+import { spawn } from "child_process";
 import path from "path";
 import { fileURLToPath } from "url";
 import { Server as SocketServer } from "socket.io";
@@ -55,8 +51,13 @@ io.on("connection", (socket) => {
   console.log("✅ Socket connected:", socket.id);
   socket.emit("file:refresh");
 
+  // The program started by run:ir, if one is running. It owns terminal
+  // input until it exits.
+  let irRun = null;
+
   // Live terminal input from frontend
   socket.on("terminal:write", (data) => {
+    if (irRun) return;
     ptyProcess.write(data);
   });
 
@@ -67,6 +68,41 @@ io.on("connection", (socket) => {
     await writeFile(fullPath, content);
   });
 
+  // === Codepie Execution in the compiler's IR interpreter (no gcc) ===
+  socket.on("run:ir", () => {
+    // A new run replaces the previous one rather than sharing its input.
+    if (irRun) irRun.kill();
+
+    const sourcePath = path.join(userDir, "code.cpie");
+    const runProcess = spawn(COMPILER_PATH, ["--run", sourcePath]);
+    const forwardInput = (input) => {
+      runProcess.stdin.write(input);
+    };
+    irRun = runProcess;
+    socket.on("terminal:write", forwardInput);
+
+    runProcess.stdout.on("data", (data) => {
+      socket.emit("terminal:data", data.toString());
+    });
+
+    runProcess.stderr.on("data", (data) => {
+      socket.emit("terminal:data", `stderr: ${data.toString()}`);
+    });
+
+    runProcess.on("close", (code) => {
+      socket.off("terminal:write", forwardInput);
+      if (irRun === runProcess) irRun = null;
+      socket.emit("terminal:data", `\n✅ Program exited with code ${code}`);
+    });
+
+    // Input typed after the program has closed stdin must not crash the server.
+    runProcess.stdin.on("error", () => {});
+  });
+
+  socket.on("disconnect", () => {
+    if (irRun) irRun.kill();
+  });
+
   // === C Code Compilation + Execution ===
   socket.on("run:c", async () => {
     const cFilePath = path.join(userDir, "code.c");
@@ -118,31 +154,131 @@ chokidar.watch(userDir).on("all", (event, changedPath) => {
 
 // === Compiler Integration ===
 const COMPILER_PATH = path.resolve("./compiler/compiler.exe");
-const execFileAsync = promisify(execFile);
+// Compiles slower than this keep their stats and Chrome trace on disk.
+const SLOW_COMPILE_MS = Number(process.env.SLOW_COMPILE_MS ?? 500);
+const statsDir = path.join(__dirname, "compile-stats");
+// Results for sources compiled before (even by an earlier server run).
+const cacheDir = path.join(__dirname, "compile-cache");
+
+// Parses one framed response from `compiler.exe --serve`:
+//   CODEPIE <sectionCount>\n then <name> <byteLength>\n<bytes> per section.
+// Returns null until the whole response has arrived.
+function parseSections(buffer) {
+  let offset = 0;
+  const readLine = () => {
+    const nl = buffer.indexOf(0x0a, offset);
+    if (nl < 0) return null;
+    const line = buffer.toString("utf-8", offset, nl);
+    offset = nl + 1;
+    return line;
+  };
+
+  const header = readLine();
+  if (header === null) return null;
+  const count = Number(header.split(" ")[1]);
+  const sections = {};
+  for (let i = 0; i < count; i++) {
+    const line = readLine();
+    if (line === null) return null;
+    const [name, length] = line.split(" ");
+    const end = offset + Number(length);
+    if (end > buffer.length) return null;
+    sections[name] = buffer.toString("utf-8", offset, end);
+    offset = end;
+  }
+  return { sections, consumed: offset };
+}
+
+// A single long-running compiler process serves every /compile request.
+// Requests are answered in order, so pending promises form a FIFO queue.
+class CompilerDaemon {
+  constructor(binary) {
+    this.binary = binary;
+    this.proc = null;
+    this.buffer = Buffer.alloc(0);
+    this.pending = [];
+  }
+
+  start() {
+    const proc = spawn(this.binary, ["--serve", `--cache=${cacheDir}`]);
+    this.proc = proc;
+    proc.stdout.on("data", (chunk) => {
+      this.buffer = Buffer.concat([this.buffer, chunk]);
+      this.drain();
+    });
+    proc.stderr.on("data", (data) => {
+      console.error("compiler:", data.toString());
+    });
+    // A dead daemon is reported once, by whichever event comes first; the
+    // next compile starts a new one.
+    const fail = (err) => {
+      if (this.proc !== proc) return;
+      this.proc = null;
+      this.buffer = Buffer.alloc(0);
+      this.pending.splice(0).forEach(({ reject }) => reject(err));
+    };
+    proc.on("error", fail);
+    // Writing to a daemon that has died raises EPIPE here, not in compile().
+    proc.stdin.on("error", fail);
+    proc.on("exit", (code) =>
+      fail(new Error(`Compiler daemon exited with code ${code}`))
+    );
+  }
+
+  compile(code) {
+    if (!this.proc) this.start();
+    return new Promise((resolve, reject) => {
+      this.pending.push({ resolve, reject });
+      const body = Buffer.from(code, "utf-8");
+      this.proc.stdin.write(`COMPILE ${body.length} all,stats\n`);
+      this.proc.stdin.write(body);
+    });
+  }
+
+  drain() {
+    while (this.pending.length) {
+      const response = parseSections(this.buffer);
+      if (!response) return;
+      this.buffer = this.buffer.subarray(response.consumed);
+      this.pending.shift().resolve(response.sections);
+    }
+  }
+}
+
+const compilerDaemon = new CompilerDaemon(COMPILER_PATH);
 
 app.post("/compile", async (req, res) => {
   const { code } = req.body;
   console.log("🚧 Compiling via custom compiler...");
 
-  const inputPath = "./compiler/temp_input.code";
-  const outputDir = "./compiler/temp_output";
-
   try {
-    await writeFile(inputPath, code, "utf-8");
-    await mkdir(outputDir, { recursive: true });
-
-    await execFileAsync(COMPILER_PATH, [inputPath, outputDir]);
-
-    const [tokens, errors, ir, optimizedIR, cCode, output] = await Promise.all([
-      readFile(path.join(outputDir, "tokens.txt"), "utf-8").catch(() => ""),
-      readFile(path.join(outputDir, "errors.txt"), "utf-8").catch(() => ""),
-      readFile(path.join(outputDir, "ir.txt"), "utf-8").catch(() => ""),
-      readFile(path.join(outputDir, "optimized_ir.txt"), "utf-8").catch(
-        () => ""
-      ),
-      readFile(path.join(outputDir, "c_code.txt"), "utf-8").catch(() => ""),
-      readFile(path.join(outputDir, "output.txt"), "utf-8").catch(() => ""),
-    ]);
+    const sections = await compilerDaemon.compile(code ?? "");
+    if (sections.error) throw new Error(sections.error);
+
+    const {
+      tokens = "",
+      errors = "",
+      ir = "",
+      optimized_ir: optimizedIR = "",
+      c_code: cCode = "",
+      output = "",
+      stats = "",
+      trace = "",
+    } = sections;
+
+    if (stats) {
+      const { total_ms: totalMs = 0 } = JSON.parse(stats);
+      if (totalMs > SLOW_COMPILE_MS) {
+        const stamp = new Date().toISOString().replace(/[:.]/g, "-");
+        await mkdir(statsDir, { recursive: true });
+        await writeFile(path.join(statsDir, `${stamp}.stats.json`), stats, "utf-8");
+        await writeFile(path.join(statsDir, `${stamp}.trace.json`), trace, "utf-8");
+        console.warn(`🐢 Slow compile (${totalMs} ms), stats saved to ${statsDir}`);
+      }
+    }
+
+    // Keep the source for run:ir, which runs it in the compiler itself.
+    await writeFile(path.join(userDir, "code.cpie"), code ?? "", "utf-8");
 
     // Permanently store generated C code
     const cFilePath = path.join(userDir, "code.c");
@@ -151,10 +287,6 @@ app.post("/compile", async (req, res) => {
       console.log(`💾 Saved generated C code to: ${cFilePath}`);
     }
 
-    // Cleanup temp files
-    await unlink(inputPath);
-    await rm(outputDir, { recursive: true, force: true });
-
     res.json({
       tokens: tokens.split("\n").filter(Boolean),
       errors: errors.split("\n").filter(Boolean),
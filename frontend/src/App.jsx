@@ -24,8 +24,10 @@ output a`
       );
   }, []);
 
-  const runCompiledCCode = () => {
-    socket.emit("run:c");
+  // Runs the compiled program in the compiler's own interpreter, which
+  // starts at once; "run:c" still builds and runs the generated C.
+  const runProgram = () => {
+    socket.emit("run:ir");
   };
 
   const handleCompile = async () => {
@@ -105,10 +107,10 @@ output a`
           </button>
 
           <button
-            onClick={runCompiledCCode}
+            onClick={runProgram}
             className="px-3 py-1 rounded bg-blue-600 hover:bg-blue-700 text-white"
           >
-            Run C Code
+            Run
           </button>
 
           <button